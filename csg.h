@@ -2,7 +2,9 @@
 #define _CSG_H
 
 #include "include/Point.hpp"
+#include "include/Predicates.hpp"
 #include "include/GeomUtils.hpp"
+#include "include/SpaceFillingCurve.hpp"
 #include "include/PrimitiveTypes.hpp"
 #include "include/Primitive2D.hpp"
 #include "include/Primitive3D.hpp"
@@ -0,0 +1,164 @@
+#include <iostream>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+#include "include/DynamicKDTree.hpp"
+
+using namespace std;
+using namespace csg;
+
+
+// brute-force check and timing of DynamicKDTree
+//
+// the check runs random single inserts, bulk inserts and removes at
+// several buffer sizes, and every 50 steps compares knn, nearest,
+// radius_search and radius_count against a linear scan of the live
+// points. The timings cover single inserts, single inserts after one
+// large bulk insert (which must not be slower per insert), knn on the
+// forest against one static tree, and removal and compaction
+//
+// compile this with command:
+// 			g++ -std=c++14 -O2 -pthread -I./ dynkdbench.cpp -o dynkdbench
+
+typedef chrono::steady_clock bench_clock;
+
+static double since(bench_clock::time_point t0){
+	return chrono::duration<double>(bench_clock::now() - t0).count();
+}
+
+// compare every query against a linear scan; returns the mismatches
+static size_t check_queries(const DynamicKDTree<3> & t, const map<size_t, Point<3>> & live, const Point<3> & q){
+	size_t bad = (t.size() != live.size());
+	vector<double> all;
+	for (auto & kv : live) all.push_back((kv.second - q).norm());
+	sort(all.begin(), all.end());
+
+	const size_t k = 7;
+	vector<size_t> idx(k);
+	vector<double> d(k);
+	t.knn(q, k, &idx.front(), &d.front());
+	for (size_t j=0; j<k; j++){
+		if (j >= all.size()) {bad += (idx[j] != t.npos); continue;}
+		auto it = live.find(idx[j]);
+		bad += (it == live.end() || abs(d[j] - all[j]) > 1e-12 || abs((it->second - q).norm() - d[j]) > 1e-12);
+	}
+	if (!all.empty()){
+		auto it = live.find(t.nearest(q));
+		bad += (it == live.end() || abs((it->second - q).norm() - all[0]) > 1e-12);
+	}
+
+	double r = 15;
+	size_t cnt = 0, visited = 0;
+	for (auto x : all) cnt += (x <= r);
+	bad += (t.radius_count(q, r) != cnt);
+	bad += (t.radius_count(q, r, 3) != min<size_t>(cnt, 3));
+	t.radius_search(q, r, [&](size_t id, double dsq){
+		visited++;
+		auto it = live.find(id);
+		bad += (it == live.end() || abs(sqrt(dsq) - (it->second - q).norm()) > 1e-12);
+	});
+	bad += (visited != cnt);
+	return bad;
+}
+
+int main(int argc, char * argv[])
+{
+	mt19937 gen(7);
+	uniform_real_distribution<double> u(0.0, 100.0);
+	auto rand_point = [&](){return Point<3>(u(gen), u(gen), u(gen));};
+
+	// ***** brute-force check *****
+	size_t bad = 0, checks = 0;
+	for (size_t bs : {1, 4, 64}){
+		DynamicKDTree<3> t(bs, 0.5, 4);
+		map<size_t, Point<3>> live;
+		for (int step=0; step<20000; step++){
+			int op = gen() % 10;
+			if (op < 5 || live.empty()){
+				Point<3> p = rand_point();
+				live[t.insert(p)] = p;
+			}
+			else if (op < 6){
+				vector<Point<3>> v(gen() % 300);
+				for (auto & p : v) p = rand_point();
+				size_t first = t.insert(v);
+				for (size_t i=0; i<v.size(); i++) live[first + i] = v[i];
+			}
+			else if (op < 9){
+				auto it = live.begin();
+				advance(it, gen() % live.size());
+				bad += !t.remove(it->first);
+				bad += t.remove(it->first);		// a second time must fail
+				live.erase(it);
+			}
+			else {
+				size_t id = gen() % (t.size() + 10);
+				if (!live.count(id)) bad += t.remove(id);
+			}
+			if (step % 50 == 0) {bad += check_queries(t, live, rand_point()); checks++;}
+		}
+	}
+
+	// one bulk insert much larger than the buffer, then single inserts
+	{
+		DynamicKDTree<3> t(4, 0.5, 4);
+		map<size_t, Point<3>> live;
+		vector<Point<3>> v(5000);
+		for (auto & p : v) p = rand_point();
+		size_t first = t.insert(v);
+		for (size_t i=0; i<v.size(); i++) live[first + i] = v[i];
+		for (int step=0; step<2000; step++){
+			Point<3> p = rand_point();
+			live[t.insert(p)] = p;
+			if (step % 50 == 0) {bad += check_queries(t, live, rand_point()); checks++;}
+		}
+	}
+	cout << "brute-force check: " << bad << " mismatches in " << checks << " checks" << endl;
+
+	// ***** timing *****
+	const size_t n = 1000000;
+	vector<Point<3>> pts(n), extra(1<<14);
+	for (auto & p : pts) p = rand_point();
+	for (auto & p : extra) p = rand_point();
+
+	DynamicKDTree<3> t;
+	auto t0 = bench_clock::now();
+	for (auto & p : pts) t.insert(p);
+	cout << "1M single inserts: " << since(t0) << " s (" << t.blocks() << " blocks)" << endl;
+	t0 = bench_clock::now();
+	for (auto & p : extra) t.insert(p);
+	cout << "  then 16k single inserts: " << since(t0) << " s" << endl;
+
+	DynamicKDTree<3> tb;
+	t0 = bench_clock::now();
+	tb.insert(pts);
+	cout << "1M bulk insert: " << since(t0) << " s" << endl;
+	t0 = bench_clock::now();
+	for (auto & p : extra) tb.insert(p);
+	cout << "  then 16k single inserts: " << since(t0) << " s" << endl;
+
+	const size_t k = 8;
+	vector<Point<3>> q(pts);
+	shuffle(q.begin(), q.end(), gen);
+	vector<size_t> idx(k*q.size());
+	vector<double> dist(idx.size());
+	t0 = bench_clock::now();
+	t.knn(q, k, &idx.front(), &dist.front());
+	cout << "1M knn k=8 on the forest: " << since(t0) << " s" << endl;
+	KDTree<3> st(pts);
+	t0 = bench_clock::now();
+	st.knn(q, k, &idx.front(), &dist.front());
+	cout << "1M knn k=8 on one static tree: " << since(t0) << " s" << endl;
+
+	t0 = bench_clock::now();
+	for (size_t i=0; i<n/2; i++) t.remove(2*i);
+	cout << "500k removes: " << since(t0) << " s (" << t.blocks() << " blocks)" << endl;
+	t0 = bench_clock::now();
+	t.compact();
+	cout << "compact: " << since(t0) << " s" << endl;
+
+	return (bad == 0)? 0 : 1;
+}
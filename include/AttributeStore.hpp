@@ -0,0 +1,244 @@
+#ifndef _ATTRIBUTESTORE_H
+#define _ATTRIBUTESTORE_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "MappedAllocator.hpp"
+
+// typed, per-point attribute columns for PointCloud
+//
+// each attribute is a dense, 64-byte-aligned column of one of a few
+// scalar types. Names are resolved once into a typed handle, after
+// which access is a plain array index:
+//
+//    AttributeHandle<float> h = store.add<float>("reflectance");
+//    float * r = store.data(h);
+//    for (i...) r[i] = ...;
+//
+// whole-column operations (resize, append, gather, permute) work on
+// the raw bytes, so they don't care about the element type.
+// Columns can be kept in memory-mapped scratch files (set_mapped)
+
+
+enum AttributeType {ATTR_UINT8, ATTR_UINT16, ATTR_INT32, ATTR_FLOAT, ATTR_DOUBLE};
+
+// compile-time mapping from element type to AttributeType
+template <class T> struct attribute_type;
+template <> struct attribute_type<std::uint8_t>  {static const AttributeType value = ATTR_UINT8;};
+template <> struct attribute_type<std::uint16_t> {static const AttributeType value = ATTR_UINT16;};
+template <> struct attribute_type<std::int32_t>  {static const AttributeType value = ATTR_INT32;};
+template <> struct attribute_type<float>         {static const AttributeType value = ATTR_FLOAT;};
+template <> struct attribute_type<double>        {static const AttributeType value = ATTR_DOUBLE;};
+
+inline std::size_t attribute_size(AttributeType t){
+  switch (t){
+    case ATTR_UINT8: return 1;
+    case ATTR_UINT16: return 2;
+    case ATTR_INT32: return 4;
+    case ATTR_FLOAT: return 4;
+    case ATTR_DOUBLE: return 8;
+  }
+  return 0;
+}
+
+
+// a resolved attribute: index of the column in its store
+template <class T>
+struct AttributeHandle{
+  std::size_t index;
+};
+
+
+class AttributeStore{
+public:
+  typedef std::vector<char, csg::MappedAllocator<char, 64>> buffer_type;
+
+  AttributeStore() : _size(0), _mapped(false) {};
+
+  // number of points / number of attributes
+  std::size_t size() const {return _size;};
+  std::size_t count() const {return _columns.size();};
+
+  // attribute metadata by column index
+  const std::string & name(std::size_t k) const {return _columns[k].name;};
+  AttributeType type(std::size_t k) const {return _columns[k].type;};
+  const char * bytes(std::size_t k) const {return _columns[k].data.data();};
+  char * bytes(std::size_t k) {return _columns[k].data.data();};
+
+  // column index by name, or -1
+  long find(const std::string & name) const{
+    for (std::size_t k=0; k<_columns.size(); k++) if (_columns[k].name == name) return k;
+    return -1;
+  }
+  bool present(const std::string & name) const {return find(name) >= 0;};
+
+  // add a zero-filled column sized to the current point count
+  template <class T>
+  AttributeHandle<T> add(const std::string & name){
+    long k = find(name);
+    if (k >= 0) return handle<T>(name);
+    add_column(name, attribute_type<T>::value);
+    return AttributeHandle<T>{_columns.size()-1};
+  }
+
+  // untyped version of the above, for readers that only know the type at runtime
+  std::size_t add(const std::string & name, AttributeType type){
+    long k = find(name);
+    if (k >= 0){
+      if (_columns[k].type != type) type_error(name);
+      return k;
+    }
+    add_column(name, type);
+    return _columns.size()-1;
+  }
+
+  // resolve a name into a typed handle (once, outside of any loop)
+  template <class T>
+  AttributeHandle<T> handle(const std::string & name) const{
+    long k = find(name);
+    if (k < 0){
+      std::cout << "AttributeStore: no attribute named " << name << std::endl;
+      throw -1;
+    }
+    if (_columns[k].type != attribute_type<T>::value) type_error(name);
+    return AttributeHandle<T>{std::size_t(k)};
+  }
+
+  template <class T> T * data(AttributeHandle<T> h) {return reinterpret_cast<T *>(_columns[h.index].data.data());};
+  template <class T> const T * data(AttributeHandle<T> h) const {return reinterpret_cast<const T *>(_columns[h.index].data.data());};
+
+  void remove(const std::string & name){
+    long k = find(name);
+    if (k >= 0) _columns.erase(_columns.begin() + k);
+  }
+
+  void clear() {_columns.clear(); _size = 0;};
+
+  // keep the columns in memory-mapped scratch files (or move them back)
+  bool mapped() const {return _mapped;};
+  void set_mapped(bool mapped){
+    _mapped = mapped;
+    for (auto & c : _columns){
+      if (c.data.get_allocator().file_backed == mapped) continue;
+      buffer_type d(c.data.begin(), c.data.end(), csg::MappedAllocator<char, 64>(mapped));
+      c.data.swap(d);
+    }
+  }
+
+  void advise(csg::MappedAdvice advice) const{
+    for (auto & c : _columns) csg::mapped::advise(c.data.data(), advice);
+  }
+
+  // resize every column (new points are zero)
+  void resize(std::size_t n){
+    for (auto & c : _columns) c.data.resize(n*attribute_size(c.type), 0);
+    _size = n;
+  }
+
+  // room for n points in every column, without changing size()
+  void reserve(std::size_t n){
+    for (auto & c : _columns) c.data.reserve(n*attribute_size(c.type));
+  }
+
+  // same columns, n zeroed points
+  AttributeStore empty_like(std::size_t n) const{
+    AttributeStore s;
+    s._size = n;
+    s._mapped = _mapped;
+    s._columns.resize(_columns.size());
+    for (std::size_t k=0; k<_columns.size(); k++){
+      s._columns[k].name = _columns[k].name;
+      s._columns[k].type = _columns[k].type;
+      s._columns[k].data = buffer_type(n*attribute_size(_columns[k].type), 0, csg::MappedAllocator<char, 64>(_mapped));
+    }
+    return s;
+  }
+
+  // append the points of another store, one bulk copy per column.
+  // Columns missing from other are zero-filled; columns only in
+  // other can't be kept, and are reported
+  void append(const AttributeStore & other){
+    std::size_t n = _size;
+    resize(_size + other._size);
+    for (auto & c : _columns){
+      long j = other.find(c.name);
+      if (j < 0 || other._columns[j].type != c.type) continue;
+      std::size_t es = attribute_size(c.type);
+      if (other._size > 0) memcpy(&c.data[n*es], other._columns[j].data.data(), other._size*es);
+    }
+    for (auto & c : other._columns){
+      if (!present(c.name)) std::cout << "WARNING: attribute " << c.name << " is being lost in append" << std::endl;
+    }
+  }
+
+  // append, moving other's columns wholesale when this store is empty
+  void append(AttributeStore && other){
+    if (_size == 0 && _columns.empty()){
+      bool mapped = _mapped;
+      *this = std::move(other);
+      set_mapped(mapped);
+      return;
+    }
+    append(static_cast<const AttributeStore &>(other));
+  }
+
+  // dst[o+j] = this[idx[j]] for j in [0, m), for every column
+  // (dst must have the same columns in the same order, e.g. from empty_like)
+  void gather_into(AttributeStore & dst, const std::size_t * idx, std::size_t m, std::size_t o) const{
+    for (std::size_t k=0; k<_columns.size(); k++){
+      const char * s = _columns[k].data.data();
+      char * d = dst._columns[k].data.data();
+      switch (attribute_size(_columns[k].type)){
+        case 1: gather_bytes<std::uint8_t>(s, d, idx, m, o); break;
+        case 2: gather_bytes<std::uint16_t>(s, d, idx, m, o); break;
+        case 4: gather_bytes<std::uint32_t>(s, d, idx, m, o); break;
+        case 8: gather_bytes<std::uint64_t>(s, d, idx, m, o); break;
+      }
+    }
+  }
+
+  // new point i is old point order[i]
+  void permute(const std::vector<std::size_t> & order){
+    AttributeStore s = empty_like(order.size());
+    if (order.size() > 0) gather_into(s, &order.front(), order.size(), 0);
+    *this = std::move(s);
+  }
+
+private:
+  struct Column{
+    std::string name;
+    AttributeType type;
+    buffer_type data;
+  };
+
+  std::size_t _size;
+  bool _mapped;
+  std::vector<Column> _columns;
+
+  void add_column(const std::string & name, AttributeType type){
+    Column c;
+    c.name = name;
+    c.type = type;
+    c.data = buffer_type(_size*attribute_size(type), 0, csg::MappedAllocator<char, 64>(_mapped));
+    _columns.push_back(std::move(c));
+  }
+
+  static void type_error(const std::string & name){
+    std::cout << "AttributeStore: attribute " << name << " has a different type" << std::endl;
+    throw -1;
+  }
+
+  template <class U>
+  static void gather_bytes(const char * s, char * d, const std::size_t * idx, std::size_t m, std::size_t o){
+    const U * src = reinterpret_cast<const U *>(s);
+    U * dst = reinterpret_cast<U *>(d) + o;
+    for (std::size_t j=0; j<m; j++) dst[j] = src[idx[j]];
+  }
+};
+
+#endif
@@ -40,27 +40,27 @@ struct RandomHash{
 
 // Return positive, zero, or negative value if point d is respectively inside, 
 // on, or outside the circle through points a, b, and c.
-inline double in_circle(const Point<2> & d, const Point<2> & a, const Point<2> & b, const Point<2> & c) {
-	
-	// Circle cc = Circle::circumcircle(a,b,c);
-	// Point<2> ccen = cc.center();
-	Point<2> ccen = circumcenter(a,b,c);
-	// double crad = cc.radius();
-	double crad = circumradius(a,b,c);
-	double radd = (d.x[0]-ccen.x[0])*(d.x[0]-ccen.x[0]) + (d.x[1]-ccen.x[1])*(d.x[1]-ccen.x[1]);
-	return ((crad)*(crad) - radd);
+// (uses the robust incircle predicate, so the sign is exact
+//  whatever the point storage type)
+template <class T>
+double in_circle(const GeneralPoint<2, T> & d, const GeneralPoint<2, T> & a, const GeneralPoint<2, T> & b, const GeneralPoint<2, T> & c) {
+	double det = incircle(a, b, c, d);
+	return (orient2d(a, b, c) < 0.0)? -det : det;
 }
 
 
 
 
-struct TriElem{
-	const Point<2> * 			points;	// the vector of points that this references
+template <class T>
+struct GeneralTriElem{
+	typedef GeneralPoint<2, T> 	PointT;
+
+	const PointT * 				points;	// the vector of points that this references
 	Int  						vertices[3];	// the 3 vertices in this element
 	Int 						daughters[3];	// locations of up to 3 daughters
 	Int 						state;		// nonzero if the element is live
 
-	void set(Int a, Int b, Int c, const Point<2> * pts)
+	void set(Int a, Int b, Int c, const PointT * pts)
 	{
 		points = pts;
 		vertices[0] = a;
@@ -70,16 +70,13 @@ struct TriElem{
 		state = 1;
 	}
 
-	Int contains_point(const Point<2> & pt){
+	Int contains_point(const PointT & pt){
 		Doub d;
 		Int ztest = 0;
 		Int i,j;
 		for (auto i=0; i<3; i++){
 			j = (i+1)%3;
-			d = (points[vertices[j]].x[0] - points[vertices[i]].x[0])
-				*(pt.x[1]-points[vertices[i]].x[1])
-				- (points[vertices[j]].x[1] - points[vertices[i]].x[1])
-				*(pt.x[0]-points[vertices[i]].x[0]);
+			d = orient2d(points[vertices[i]], points[vertices[j]], pt);
 			if (d<0.0) return -1;
 			if (d == 0.0) ztest = true;
 		}
@@ -95,11 +92,16 @@ struct TriElem{
 
 // const std::function<std::size_t(unsigned long int)> nullhash{return *(unsigned long int *)key;};
 
-struct Delaunay {
+// the points may be stored in any precision (e.g. float);
+// all predicates are evaluated in double
+template <class T>
+struct GeneralDelaunay {
+	typedef GeneralPoint<2, T> 	PointT;
+
 	Int 						npts, ntri, ntree, ntreemax, opt;
 	Doub 								delx, dely;
-	std::vector<Point<2>> 				points;
-	std::vector<TriElem> 				triangles;
+	std::vector<PointT> 				points;
+	std::vector<GeneralTriElem<T>> 		triangles;
 	std::unordered_map<Ullong, Int> 	linehash;
 	std::unordered_map<Ullong, Int> 	trihash;
 	std::vector<Int> 					perm;	//Permutation for randomizing point order.
@@ -112,7 +114,7 @@ struct Delaunay {
 	//Construct Delaunay triangulation from a vector of points pvec. If bit 0 in options is nonzero,
 	//hash memories used in the construction are deleted. (Some applications may want to use them
 	//and will set options to 1.)
-	Delaunay(std::vector<Point<2> > &pvec, Int options) 
+	GeneralDelaunay(std::vector<PointT> &pvec, Int options) 
 	: npts(pvec.size()), ntri(0), ntree(0), ntreemax(10*npts+1000)
 	, opt(options), points(pvec){
 		
@@ -139,9 +141,9 @@ struct Delaunay {
 
 		//Store bounding box dimensions, then construct
 		//the three fictitious points and store them.
-		points.push_back(Point<2>(0.5*(xl + xh), yh + bigscale*dely));
-		points.push_back(Point<2>(xl - 0.5*bigscale*delx,yl - 0.5*bigscale*dely));
-		points.push_back(Point<2>(xh + 0.5*bigscale*delx,yl - 0.5*bigscale*dely));
+		points.push_back(PointT(0.5*(xl + xh), yh + bigscale*dely));
+		points.push_back(PointT(xl - 0.5*bigscale*delx,yl - 0.5*bigscale*dely));
+		points.push_back(PointT(xh + 0.5*bigscale*delx,yl - 0.5*bigscale*dely));
 		store_triangle(npts,npts+1,npts+2);
 
 		// mix up the order of insertion
@@ -173,18 +175,30 @@ struct Delaunay {
 	//Add the point with index r incrementally to the Delaunay triangulation.
 	void insert_point(Int r) {
 		
-		Int i,j,k,l,s,tno,ntask,d0,d1,d2;
-		Ullong key;
+		Int i,j,k,e,tno,ntask,d0,d1,d2;
 		std::stack<Int> tasks, taski, taskj;
 		//Stacks (3 vertices) for legalizing edges.
 
-		//Find triangle containing point. Fuzz if it lies on an edge.
+		//Find triangle containing point. If it lies exactly on an edge, split
+		//the two triangles sharing that edge. Fuzz only if that fails (e.g.
+		//the point duplicates an existing vertex).
 		for (j=0; j<3; j++) {
 			
 			tno = which_contains_point(points[r],1);
 
 			if (tno >= 0) break; //The desired result: Point is OK
 
+			//The strict search also fails when the point lies on an edge of
+			//an erased ancestor, so look again allowing edges.
+			tno = which_contains_point(points[r],0);
+			if (tno >= 0) {
+				e = edge_containing_point(tno, r);
+				if (e < 0) break;
+				if (e < 3) {
+					split_edge(tno, e, r);
+					return;
+				}
+			}
 
 			points[r].x[0] += fuzz * delx * (hashfn.doub(jran++)-0.5);
 			points[r].x[1] += fuzz * dely * (hashfn.doub(jran++)-0.5);
@@ -217,6 +231,72 @@ struct Delaunay {
 		erase_triangle(i,j,k,d0,d1,d2);
 
 		//Legalize edges recursively.
+		legalize(tasks, taski, taskj);
+	}
+
+
+	//Return -1 if point r lies strictly inside live triangle tno, or the index e of the single edge
+	//(vertices[e], vertices[e+1]) it lies on, or 3 if it lies on more than one edge (i.e. on a vertex).
+	Int edge_containing_point(Int tno, Int r) {
+		Int e, nzero=0, ezero=-1;
+		for (e=0; e<3; e++) {
+			if (orient2d(points[triangles[tno].vertices[e]], points[triangles[tno].vertices[(e+1)%3]], points[r]) == 0.0) {
+				nzero++;
+				ezero = e;
+			}
+		}
+		if (nzero > 1) return 3;
+		return ezero;
+	}
+
+
+	//Insert point r that lies exactly on edge e = (i,j) of triangle tno = (i,j,k). The neighbor across
+	//the edge is (j,i,l), and both are replaced by four triangles fanning out from r.
+	void split_edge(Int tno, Int e, Int r) {
+
+		Int i,j,k,l,d0,d1,d2,d3;
+		Ullong key;
+		std::stack<Int> tasks, taski, taskj;
+
+		i = triangles[tno].vertices[e];
+		j = triangles[tno].vertices[(e+1)%3];
+		k = triangles[tno].vertices[(e+2)%3];
+
+		//Look up the vertex opposite the edge in the neighboring triangle.
+		//(the fictitious root triangle guarantees that it exists)
+		key = hashfn.int64(j) - hashfn.int64(i);
+		l = linehash[key];
+
+		if (opt & 2 && i < npts && j < npts && k < npts && l < npts) return;
+
+		//Create four triangles and queue them for legal edge tests.
+		d0 = store_triangle(r,j,k);
+		tasks.push(r); taski.push(j); taskj.push(k);
+		d1 = store_triangle(r,k,i);
+		tasks.push(r); taski.push(k); taskj.push(i);
+		d2 = store_triangle(r,i,l);
+		tasks.push(r); taski.push(i); taskj.push(l);
+		d3 = store_triangle(r,l,j);
+		tasks.push(r); taski.push(l); taskj.push(j);
+
+		//Erase the old triangles and the split edge in both directions.
+		erase_triangle(i,j,k,d0,d1,-1);
+		erase_triangle(j,i,l,d2,d3,-1);
+		key = hashfn.int64(i)-hashfn.int64(j);
+		linehash.erase(key);
+		key = 0 - key;
+		linehash.erase(key);
+
+		legalize(tasks, taski, taskj);
+	}
+
+
+	//Legalize the queued edges (s,i,j) recursively by flipping.
+	void legalize(std::stack<Int> & tasks, std::stack<Int> & taski, std::stack<Int> & taskj) {
+
+		Int i,j,l,s,d0,d1;
+		Ullong key;
+
 		while (tasks.size()>0) {
 			
 			s = tasks.top(); tasks.pop();
@@ -254,7 +334,7 @@ struct Delaunay {
 	//Given point p, return index in triangles of the triangle in the triangulation that contains it, or
 	//return -1 for failure. If strict is nonzero, require strict containment, otherwise allow the point
 	//to lie on an edge.
-	Int which_contains_point(const Point<2> &p, Int strict) {
+	Int which_contains_point(const PointT &p, Int strict) {
 		
 		Int i,j,k=0;
 		//Descend in tree until reach a “live” triangle.
@@ -333,9 +413,12 @@ struct Delaunay {
 	}
 };
 
-const Doub Delaunay::fuzz = 1.0e-6;
-const Doub Delaunay::bigscale = 1000.0;
-Uint Delaunay::jran = 14921620;
+template <class T> const Doub GeneralDelaunay<T>::fuzz = 1.0e-6;
+template <class T> const Doub GeneralDelaunay<T>::bigscale = 1000.0;
+template <class T> Uint GeneralDelaunay<T>::jran = 14921620;
+
+typedef GeneralTriElem<double> 		TriElem;
+typedef GeneralDelaunay<double> 	Delaunay;
 
 
 
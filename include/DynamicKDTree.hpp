@@ -0,0 +1,363 @@
+#ifndef _DYNAMICKDTREE_H
+#define _DYNAMICKDTREE_H
+
+#include <vector>
+#include <limits>
+#include <cmath>
+#include <cstddef>
+
+#include "KDTree.hpp"
+#include "Parallel.hpp"
+
+// k-d tree that takes inserts and removals, as a forest of static
+// KDTrees (the logarithmic method of Bentley and Saxe)
+//
+// new points collect in a small unindexed buffer. When the buffer
+// fills, it is merged with the blocks in the lowest occupied slots into
+// one new static tree in the first free slot that can hold them, slot i
+// holding up to buffer_size*2^i points, much like a carry in a binary
+// counter. A point is rebuilt into a bigger tree at most once per slot,
+// so an insert costs O(log^2 n) amortized, and every query is a search
+// of at most log(n/buffer_size) flat trees and one short linear scan.
+//
+// removed points are only marked dead in their block (and dropped when
+// the block is next merged); once dead points make up more than
+// compact_ratio of the forest, everything is rebuilt into one tree.
+// Points are named by the id insert() returns, in the order inserted:
+//
+//    DynamicKDTree<3> tree;
+//    std::size_t id = tree.insert(p);
+//    tree.remove(id);
+//    tree.knn(q, k, &idx.front(), &dist.front());     // ids, nearest first
+
+namespace csg{
+
+template <std::size_t dim>
+class DynamicKDTree{
+public:
+
+	typedef Point<dim> PointT;
+
+	DynamicKDTree(std::size_t buffer_size=256, double compact_ratio=0.5, std::size_t leaf_size=16, unsigned int nthreads=0)
+	: _buffer_size((buffer_size == 0)? 1 : buffer_size), _compact_ratio(compact_ratio)
+	, _leaf_size(leaf_size), _nthreads(nthreads), _live(0), _dead(0) {};
+
+	// metadata inspectors
+	std::size_t size() const {return _live;};			// points not removed
+	std::size_t dead() const {return _dead;};			// removed points still held in a block
+	std::size_t buffer_size() const {return _buffer_size;};
+	std::size_t blocks() const{
+		std::size_t n = 0;
+		for (auto & blk : _blocks) n += (blk.tree.size() > 0);
+		return n;
+	}
+
+	bool contains(std::size_t id) const {return id < _where.size() && _where[id].block != removed;};
+
+	// the point with this id, which must not have been removed
+	const PointT & point(std::size_t id) const{
+		const Location & loc = _where[id];
+		if (loc.block == buffered) return _buffer[loc.pos];
+		return _blocks[loc.block].tree.point(loc.pos);
+	}
+
+	// id returned for missing neighbors (k > size())
+	static constexpr std::size_t npos = KDTree<dim>::npos;
+
+	// add a point, and return its id
+	std::size_t insert(const PointT & p){
+		std::size_t id = _where.size();
+		_where.push_back(Location{buffered, _buffer.size()});
+		_buffer.push_back(p);
+		_buffer_ids.push_back(id);
+		_live++;
+		if (_buffer.size() >= _buffer_size) carry();
+		return id;
+	}
+
+	// add many points at once, with consecutive ids; returns the first.
+	// They go into one tree with whatever they overflow, rather than
+	// through the buffer one buffer-full at a time
+	std::size_t insert(const std::vector<PointT> & pts){
+		std::size_t first = _where.size();
+		for (std::size_t i=0; i<pts.size(); i++){
+			_where.push_back(Location{buffered, _buffer.size()});
+			_buffer.push_back(pts[i]);
+			_buffer_ids.push_back(first + i);
+		}
+		_live += pts.size();
+		if (_buffer.size() >= _buffer_size) carry();
+		return first;
+	}
+
+	// remove a point; false if there is no such id (or it is gone already)
+	bool remove(std::size_t id){
+		if (!contains(id)) return false;
+		Location loc = _where[id];
+		_where[id].block = removed;
+		_live--;
+
+		if (loc.block == buffered){
+			std::size_t last = _buffer.size() - 1;
+			_buffer[loc.pos] = _buffer[last];
+			_buffer_ids[loc.pos] = _buffer_ids[last];
+			if (loc.pos != last) _where[_buffer_ids[loc.pos]].pos = loc.pos;
+			_buffer.pop_back();
+			_buffer_ids.pop_back();
+			return true;
+		}
+
+		Block & blk = _blocks[loc.block];
+		blk.dead[loc.pos] = 1;
+		blk.ndead++;
+		_dead++;
+		if (blk.ndead == blk.tree.size()){
+			_dead -= blk.ndead;
+			blk = Block();
+		}
+		if (_dead > 0 && double(_dead) > _compact_ratio*double(_live + _dead)) compact();
+		return true;
+	}
+
+	// rebuild every live point into a single tree (or the buffer), which
+	// drops all dead points
+	void compact(){
+		std::vector<PointT> pts(_buffer);
+		std::vector<std::size_t> ids(_buffer_ids);
+		_buffer.clear();
+		_buffer_ids.clear();
+		for (std::size_t i=0; i<_blocks.size(); i++) take(i, pts, ids);
+		_blocks.clear();
+
+		if (pts.size() < _buffer_size){
+			_buffer.swap(pts);
+			_buffer_ids.swap(ids);
+			for (std::size_t j=0; j<_buffer.size(); j++) _where[_buffer_ids[j]] = Location{buffered, j};
+			return;
+		}
+		std::size_t slot = 0;
+		while ((_buffer_size << slot) < pts.size()) slot++;
+		build_block(slot, pts, ids);
+	}
+
+	// id of the point nearest to q, or npos if the tree is empty
+	std::size_t nearest(const PointT & q) const{
+		std::size_t id;
+		double d;
+		knn(q, 1, &id, &d);
+		return id;
+	}
+
+	// the k nearest neighbors of q, nearest first: their ids go to
+	// idx[0, k) and their distances to dist[0, k). One heap is shared
+	// by the buffer and all blocks, largest block first, so the bound
+	// from the big trees prunes the small ones; an approximate search
+	// spends a single leaf budget across the forest
+	void knn(const PointT & q, std::size_t k, std::size_t * idx, double * dist,
+			 const ApproxSearch & approx=ApproxSearch()) const{
+		if (k == 0) return;			// the heap has no bound to read
+		KNearest nn(k, idx, dist, approx);
+		for (std::size_t j=0; j<_buffer.size(); j++) nn.offer(KDTree<dim>::distsq(_buffer[j], q), _buffer_ids[j]);
+		for (std::size_t i=_blocks.size(); i-- > 0;){
+			nn.blk = &_blocks[i];
+			_blocks[i].tree.search(q, nn);
+		}
+
+		nn.sort();
+		for (std::size_t c=0; c<nn.count; c++) dist[c] = std::sqrt(dist[c]);
+		for (std::size_t c=nn.count; c<k; c++){
+			idx[c] = npos;
+			dist[c] = std::numeric_limits<double>::infinity();
+		}
+	}
+
+	// the k nearest neighbors of every query, in parallel and in Morton
+	// order, laid out as for KDTree::knn
+	void knn(const std::vector<PointT> & queries, std::size_t k, std::size_t * idx, double * dist,
+			 const ApproxSearch & approx=ApproxSearch(), unsigned int nthreads=0) const{
+		if (k == 0) return;
+		std::vector<std::size_t> order = KDTree<dim>::query_order(queries);
+		parallel_for(queries.size(), nthreads, [&](std::size_t b, std::size_t e, unsigned int t){
+			for (std::size_t j=b; j<e; j++){
+				std::size_t i = order[j];
+				knn(queries[i], k, idx + k*i, dist + k*i, approx);
+			}
+		});
+	}
+
+	// call visitor(id, squared distance) for every point within r of
+	// center (inclusive), in no particular order
+	template <class Visitor>
+	void radius_search(const PointT & center, double r, Visitor && visitor) const{
+		Radius<Visitor> s(r*r, visitor);
+		for (std::size_t j=0; j<_buffer.size(); j++){
+			double dsq = KDTree<dim>::distsq(_buffer[j], center);
+			if (dsq <= s.rsq) visitor(_buffer_ids[j], dsq);
+		}
+		for (std::size_t i=_blocks.size(); i-- > 0;){
+			s.blk = &_blocks[i];
+			_blocks[i].tree.search(center, s);
+		}
+	}
+
+	// number of points within r of center, stopping once it reaches
+	// limit (0 counts them all)
+	std::size_t radius_count(const PointT & center, double r, std::size_t limit=0) const{
+		Count s(r*r, (limit == 0)? npos : limit);
+		for (std::size_t j=0; j<_buffer.size() && s.count<s.limit; j++) s.count += KDTree<dim>::distsq(_buffer[j], center) <= s.rsq;
+		for (std::size_t i=_blocks.size(); i-- > 0;){
+			s.blk = &_blocks[i];
+			_blocks[i].tree.search(center, s);
+		}
+		return s.count;
+	}
+
+	void radius_count(const std::vector<PointT> & queries, double r, std::size_t * counts,
+					  std::size_t limit=0, unsigned int nthreads=0) const{
+		std::vector<std::size_t> order = KDTree<dim>::query_order(queries);
+		parallel_for(queries.size(), nthreads, [&](std::size_t b, std::size_t e, unsigned int t){
+			for (std::size_t j=b; j<e; j++) counts[order[j]] = radius_count(queries[order[j]], r, limit);
+		});
+	}
+
+private:
+
+	// a static tree, with the id and removal mark of each point in
+	// tree order
+	struct Block{
+		KDTree<dim> tree;
+		std::vector<std::size_t> ids;
+		std::vector<char> dead;
+		std::size_t ndead = 0;
+	};
+
+	// where each id lives: a block slot and tree position, or a buffer
+	// position
+	struct Location{
+		std::size_t block;
+		std::size_t pos;
+	};
+
+	static constexpr std::size_t removed = std::size_t(-1);
+	static constexpr std::size_t buffered = std::size_t(-2);
+
+	std::size_t _buffer_size;
+	double _compact_ratio;
+	std::size_t _leaf_size;
+	unsigned int _nthreads;
+	std::size_t _live, _dead;
+
+	std::vector<Block> _blocks;				// slot i holds up to _buffer_size << i points, or is empty
+	std::vector<PointT> _buffer;
+	std::vector<std::size_t> _buffer_ids;
+	std::vector<Location> _where;			// by id
+
+	// merge the buffer and the full low slots into the first free slot
+	// that can hold them all
+	void carry(){
+		std::vector<PointT> pts;
+		std::vector<std::size_t> ids;
+		pts.swap(_buffer);
+		ids.swap(_buffer_ids);
+		std::size_t slot = 0;
+		for (; slot<_blocks.size(); slot++){
+			if (_blocks[slot].tree.size() == 0 && (_buffer_size << slot) >= pts.size()) break;
+			take(slot, pts, ids);
+		}
+		// past the last slot, a bulk insert may still be too big for it
+		while ((_buffer_size << slot) < pts.size()) slot++;
+		build_block(slot, pts, ids);
+	}
+
+	// move the live points of a slot out to pts, emptying it
+	void take(std::size_t slot, std::vector<PointT> & pts, std::vector<std::size_t> & ids){
+		Block & blk = _blocks[slot];
+		for (std::size_t j=0; j<blk.tree.size(); j++){
+			if (blk.dead[j]) continue;
+			pts.push_back(blk.tree.point(j));
+			ids.push_back(blk.ids[j]);
+		}
+		_dead -= blk.ndead;
+		blk = Block();
+	}
+
+	void build_block(std::size_t slot, const std::vector<PointT> & pts, const std::vector<std::size_t> & ids){
+		if (slot >= _blocks.size()) _blocks.resize(slot+1);
+		Block & blk = _blocks[slot];
+		// the frequent small blocks stay on this thread
+		unsigned int nthreads = (pts.size() < KDTree<dim>::parallel_grain)? 1 : _nthreads;
+		blk.tree = KDTree<dim>(pts, _leaf_size, nthreads);
+		blk.ids.resize(pts.size());
+		blk.dead.assign(pts.size(), 0);
+		blk.ndead = 0;
+		for (std::size_t j=0; j<pts.size(); j++){
+			blk.ids[j] = ids[blk.tree.index(j)];
+			_where[blk.ids[j]] = Location{slot, j};
+		}
+	}
+
+	// search states for KDTree::search, run on one block at a time, that
+	// skip dead points and report ids
+
+	struct KNearest : public NeighborHeap{
+		const Block * blk;
+		double shrink;
+		std::size_t leaves, max_leaves;
+
+		KNearest(std::size_t kk, std::size_t * ii, double * dd, const ApproxSearch & approx)
+		: NeighborHeap(kk, ii, dd), blk(nullptr), leaves(0){
+			shrink = 1.0/((1.0 + approx.eps)*(1.0 + approx.eps));
+			max_leaves = (approx.max_leaves == 0)? npos : approx.max_leaves;
+		};
+
+		double bound() const{
+			if (leaves >= max_leaves) return -1.0;
+			return NeighborHeap::bound()*shrink;
+		};
+		void visit(const KDTree<dim> & tree, const PointT & q, std::size_t b, std::size_t e){
+			leaves++;
+			for (std::size_t j=b; j<e; j++){
+				if (!blk->dead[j]) offer(KDTree<dim>::distsq(tree.point(j), q), blk->ids[j]);
+			}
+		}
+	};
+
+	template <class Visitor>
+	struct Radius{
+		const Block * blk;
+		double rsq;
+		Visitor & visitor;
+
+		Radius(double rr, Visitor & v) : blk(nullptr), rsq(rr), visitor(v) {};
+
+		double bound() const {return rsq;};
+		void visit(const KDTree<dim> & tree, const PointT & q, std::size_t b, std::size_t e){
+			for (std::size_t j=b; j<e; j++){
+				double dsq = KDTree<dim>::distsq(tree.point(j), q);
+				if (dsq <= rsq && !blk->dead[j]) visitor(blk->ids[j], dsq);
+			}
+		}
+	};
+
+	struct Count{
+		const Block * blk;
+		double rsq;
+		std::size_t limit, count;
+
+		Count(double rr, std::size_t l) : blk(nullptr), rsq(rr), limit(l), count(0) {};
+
+		double bound() const {return (count < limit)? rsq : -1.0;};
+		void visit(const KDTree<dim> & tree, const PointT & q, std::size_t b, std::size_t e){
+			for (std::size_t j=b; j<e && count<limit; j++){
+				count += !blk->dead[j] && KDTree<dim>::distsq(tree.point(j), q) <= rsq;
+			}
+		}
+	};
+};
+
+template <std::size_t dim>
+constexpr std::size_t DynamicKDTree<dim>::npos;
+
+}
+
+#endif
@@ -0,0 +1,186 @@
+#ifndef _GEODESY_H
+#define _GEODESY_H
+
+#include <cmath>
+#include <cstddef>
+
+// batch conversions between geodetic (longitude, latitude, height),
+// earth-centered earth-fixed (ECEF) and transverse Mercator / UTM
+// coordinates. Angles are in degrees, lengths in meters.
+//
+// every conversion works on whole arrays, element by element with no
+// branches in the loop body, so the same array may be passed as input
+// and output to convert in place, and compilers with a vector math
+// library can vectorize the loops
+
+namespace csg{
+
+struct ReferenceEllipsoid{
+	double a;		// semi-major axis
+	double f;		// flattening
+
+	double b() const {return a*(1.0 - f);};
+	double e2() const {return f*(2.0 - f);};		// first eccentricity squared
+
+	static ReferenceEllipsoid WGS84() {return ReferenceEllipsoid{6378137.0, 1.0/298.257223563};};
+	static ReferenceEllipsoid GRS80() {return ReferenceEllipsoid{6378137.0, 1.0/298.257222101};};
+};
+
+
+namespace geodesy{
+	constexpr double deg = 3.14159265358979323846/180.0;
+}
+
+
+// (lon, lat, h) -> (X, Y, Z)
+inline void geodetic_to_ECEF(const ReferenceEllipsoid & ell, std::size_t n,
+							 const double * lon, const double * lat, const double * h,
+							 double * X, double * Y, double * Z){
+	const double a = ell.a, e2 = ell.e2();
+	for (std::size_t i=0; i<n; i++){
+		double sp = std::sin(lat[i]*geodesy::deg), cp = std::cos(lat[i]*geodesy::deg);
+		double sl = std::sin(lon[i]*geodesy::deg), cl = std::cos(lon[i]*geodesy::deg);
+		double N = a/std::sqrt(1.0 - e2*sp*sp);		// prime vertical radius
+		double hi = h[i];
+		X[i] = (N + hi)*cp*cl;
+		Y[i] = (N + hi)*cp*sl;
+		Z[i] = (N*(1.0 - e2) + hi)*sp;
+	}
+}
+
+// (X, Y, Z) -> (lon, lat, h), with Vermeille's closed form
+// (exact for any point outside the evolute of the ellipsoid, i.e.
+// farther than ~43 km from the center of the earth)
+inline void ECEF_to_geodetic(const ReferenceEllipsoid & ell, std::size_t n,
+							 const double * X, const double * Y, const double * Z,
+							 double * lon, double * lat, double * h){
+	const double a2 = ell.a*ell.a, e2 = ell.e2(), e4 = e2*e2;
+	for (std::size_t i=0; i<n; i++){
+		double x = X[i], y = Y[i], z = Z[i];
+		double rho2 = x*x + y*y, rho = std::sqrt(rho2);
+		double p = rho2/a2;
+		double q = (1.0 - e2)*z*z/a2;
+		double r = (p + q - e4)/6.0;
+		double s = e4*p*q/(4.0*r*r*r);
+		double t = std::cbrt(1.0 + s + std::sqrt(s*(2.0 + s)));
+		double u = r*(1.0 + t + 1.0/t);
+		double v = std::sqrt(u*u + e4*q);
+		double w = e2*(u + v - q)/(2.0*v);
+		double k = std::sqrt(u + v + w*w) - w;
+		double D = k*rho/(k + e2);
+		double Dz = std::sqrt(D*D + z*z);
+		lon[i] = std::atan2(y, x)/geodesy::deg;
+		lat[i] = 2.0*std::atan2(z, D + Dz)/geodesy::deg;
+		h[i] = (k + e2 - 1.0)/k*Dz;
+	}
+}
+
+
+// transverse Mercator projection with Krüger's series to sixth order
+// in the third flattening (Karney 2011), accurate to a few nanometers
+// within the UTM zones, and to about a millimeter 3900 km from the
+// central meridian
+class TransverseMercator{
+public:
+
+	TransverseMercator(const ReferenceEllipsoid & ell, double lon0, double k0,
+					   double false_easting=0.0, double false_northing=0.0)
+	: _lon0(lon0), _k0(k0), _fe(false_easting), _fn(false_northing){
+		double f = ell.f, n = f/(2.0 - f);
+		double n2 = n*n, n3 = n2*n, n4 = n3*n, n5 = n4*n, n6 = n5*n;
+		_e = std::sqrt(ell.e2());
+		_e2m = 1.0 - ell.e2();
+		_A = ell.a/(1.0 + n)*(1.0 + n2/4.0 + n4/64.0 + n6/256.0);
+
+		_alpha[0] = n/2.0 - 2.0*n2/3.0 + 5.0*n3/16.0 + 41.0*n4/180.0 - 127.0*n5/288.0 + 7891.0*n6/37800.0;
+		_alpha[1] = 13.0*n2/48.0 - 3.0*n3/5.0 + 557.0*n4/1440.0 + 281.0*n5/630.0 - 1983433.0*n6/1935360.0;
+		_alpha[2] = 61.0*n3/240.0 - 103.0*n4/140.0 + 15061.0*n5/26880.0 + 167603.0*n6/181440.0;
+		_alpha[3] = 49561.0*n4/161280.0 - 179.0*n5/168.0 + 6601661.0*n6/7257600.0;
+		_alpha[4] = 34729.0*n5/80640.0 - 3418889.0*n6/1995840.0;
+		_alpha[5] = 212378941.0*n6/319334400.0;
+
+		_beta[0] = n/2.0 - 2.0*n2/3.0 + 37.0*n3/96.0 - n4/360.0 - 81.0*n5/512.0 + 96199.0*n6/604800.0;
+		_beta[1] = n2/48.0 + n3/15.0 - 437.0*n4/1440.0 + 46.0*n5/105.0 - 1118711.0*n6/3870720.0;
+		_beta[2] = 17.0*n3/480.0 - 37.0*n4/840.0 - 209.0*n5/4480.0 + 5569.0*n6/90720.0;
+		_beta[3] = 4397.0*n4/161280.0 - 11.0*n5/504.0 - 830251.0*n6/7257600.0;
+		_beta[4] = 4583.0*n5/161280.0 - 108847.0*n6/3991680.0;
+		_beta[5] = 20648693.0*n6/638668800.0;
+	}
+
+	// UTM zone 1-60 on the given ellipsoid
+	static TransverseMercator UTM(int zone, bool north, const ReferenceEllipsoid & ell=ReferenceEllipsoid::WGS84()){
+		if (zone < 1 || zone > 60) throw("UTM zone must be 1-60");
+		return TransverseMercator(ell, 6.0*zone - 183.0, 0.9996, 500000.0, north? 0.0 : 10000000.0);
+	}
+
+	double central_meridian() const {return _lon0;};
+
+	// (lon, lat) -> (E, N)
+	void forward(std::size_t n, const double * lon, const double * lat, double * E, double * N) const{
+		for (std::size_t i=0; i<n; i++){
+			double lam = (lon[i] - _lon0)*geodesy::deg;
+			lam = std::remainder(lam, 2.0*3.14159265358979323846);
+			double tau = std::tan(lat[i]*geodesy::deg);
+
+			// conformal latitude
+			double sig = std::sinh(_e*std::atanh(_e*tau/std::sqrt(1.0 + tau*tau)));
+			double taup = tau*std::sqrt(1.0 + sig*sig) - sig*std::sqrt(1.0 + tau*tau);
+
+			double cl = std::cos(lam);
+			double xip = std::atan2(taup, cl);
+			double etap = std::asinh(std::sin(lam)/std::sqrt(taup*taup + cl*cl));
+
+			double xi = xip, eta = etap;
+			for (int j=0; j<6; j++){
+				double c = 2.0*(j+1);
+				xi += _alpha[j]*std::sin(c*xip)*std::cosh(c*etap);
+				eta += _alpha[j]*std::cos(c*xip)*std::sinh(c*etap);
+			}
+			E[i] = _fe + _k0*_A*eta;
+			N[i] = _fn + _k0*_A*xi;
+		}
+	}
+
+	// (E, N) -> (lon, lat)
+	void reverse(std::size_t n, const double * E, const double * N, double * lon, double * lat) const{
+		for (std::size_t i=0; i<n; i++){
+			double xi = (N[i] - _fn)/(_k0*_A), eta = (E[i] - _fe)/(_k0*_A);
+			double xip = xi, etap = eta;
+			for (int j=0; j<6; j++){
+				double c = 2.0*(j+1);
+				xip -= _beta[j]*std::sin(c*xi)*std::cosh(c*eta);
+				etap -= _beta[j]*std::cos(c*xi)*std::sinh(c*eta);
+			}
+			double she = std::sinh(etap), cx = std::cos(xip);
+			double taup = std::sin(xip)/std::sqrt(she*she + cx*cx);
+			double lam = std::atan2(she, cx);
+
+			// invert the conformal latitude with Newton's method (Karney 2011, eq. 19-21)
+			double tau = taup/_e2m;
+			for (int it=0; it<3; it++){
+				double t1 = std::sqrt(1.0 + tau*tau);
+				double sig = std::sinh(_e*std::atanh(_e*tau/t1));
+				double taui = tau*std::sqrt(1.0 + sig*sig) - sig*t1;
+				tau += (taup - taui)/std::sqrt(1.0 + taui*taui)*(1.0 + _e2m*tau*tau)/(_e2m*t1);
+			}
+			lat[i] = std::atan(tau)/geodesy::deg;
+			lon[i] = _lon0 + lam/geodesy::deg;
+		}
+	}
+
+private:
+	double _lon0, _k0, _fe, _fn;
+	double _e, _e2m, _A;
+	double _alpha[6], _beta[6];
+};
+
+
+// UTM zone of a longitude (without the Norway/Svalbard exceptions)
+inline int UTM_zone(double lon){
+	int zone = int(std::floor((lon + 180.0)/6.0)) + 1;
+	return (zone < 1)? 1 : (zone > 60)? 60 : zone;
+}
+
+}
+
+#endif
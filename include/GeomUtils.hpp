@@ -13,6 +13,7 @@
 #include <fcntl.h>
 
 #include "Point.hpp"
+#include "Predicates.hpp"
 
 namespace csg{
 
@@ -32,44 +33,42 @@ template <typename T> int sgn(T val) {
 
 
 
-template <std::size_t dim>
+template <std::size_t dim, class T = double>
 struct Box{
+	typedef GeneralPoint<dim, T> PointT;
+
 	// data
-	Point<dim> lo, hi;
+	PointT lo, hi;
 
 	// empty constructor
 	Box(){};
 
 	// constructor
-	Box(const Point<dim> & lopt, const Point<dim> & hipt)
+	Box(const PointT & lopt, const PointT & hipt)
 	: lo(lopt), hi(hipt) {}
 
 	
-	static double dist(const Box & bx, const Point<dim> & pt){
-		double dsq = 0.0;
-		for (auto i=0; i<dim; i++){
-			if (pt.x[i] < bx.lo.x[i]) dsq += (pt.x[i] - bx.lo.x[i])*(pt.x[i] - bx.lo.x[i]);
-			if (pt.x[i] > bx.hi.x[i]) dsq += (pt.x[i] - bx.hi.x[i])*(pt.x[i] - bx.hi.x[i]);
-		}
-		return sqrt(dsq);
+	static double dist(const Box & bx, const PointT & pt){
+		return sqrt(distsq(bx, pt));
 	}
 
-	static double distsq(const Box & bx, const Point<dim> & pt){
+	// distances are always accumulated in double precision
+	static double distsq(const Box & bx, const PointT & pt){
 		double dsq = 0.0;
 		for (auto i=0; i<dim; i++){
-			if (pt.x[i] < bx.lo.x[i]) dsq += (pt.x[i] - bx.lo.x[i])*(pt.x[i] - bx.lo.x[i]);
-			if (pt.x[i] > bx.hi.x[i]) dsq += (pt.x[i] - bx.hi.x[i])*(pt.x[i] - bx.hi.x[i]);
+			if (pt.x[i] < bx.lo.x[i]) dsq += (double(pt.x[i]) - bx.lo.x[i])*(double(pt.x[i]) - bx.lo.x[i]);
+			if (pt.x[i] > bx.hi.x[i]) dsq += (double(pt.x[i]) - bx.hi.x[i])*(double(pt.x[i]) - bx.hi.x[i]);
 		}
 		return dsq;
 	}
 
-	static bool contains(const Box & bx, const Point<dim> & pt){
+	static bool contains(const Box & bx, const PointT & pt){
 		return distsq(bx, pt) == 0;
 	}
 
 	static Box bounding_box(const Box & bx1, const Box & bx2){
-		Point<dim> lo;
-		Point<dim> hi;
+		PointT lo;
+		PointT hi;
 		for (auto i=0; i<dim; i++){
 			lo.x[i] = std::min(bx1.lo.x[i], bx2.lo.x[i]);
 			hi.x[i] = std::max(bx1.hi.x[i], bx2.hi.x[i]);
@@ -77,18 +76,18 @@ struct Box{
 		return Box(lo,hi);
 	}
 
-	static Box translate(const Box & bx1, const Point<dim> & pt){
+	static Box translate(const Box & bx1, const PointT & pt){
 		return Box(bx1.lo+pt, bx1.hi+pt);
 	}
 
 	// print to std::out
-	template<std::size_t d>
-	friend std::ostream & operator<<(std::ostream & os, const Box<d> & bx);
+	template<std::size_t d, class t>
+	friend std::ostream & operator<<(std::ostream & os, const Box<d, t> & bx);
 
 };
 
-template<std::size_t dim>
-std::ostream & operator<<(std::ostream & os, const Box<dim> & bx){
+template<std::size_t dim, class T>
+std::ostream & operator<<(std::ostream & os, const Box<dim, T> & bx){
 	os << "lo:" << bx.lo << " hi:" << bx.hi ;
 	return os;
 }
@@ -107,10 +106,13 @@ BoxType bounding_box(const BoxType & bx1, const BoxType & bx2){
 
 
 
-inline Point<2> circumcenter(const Point<2> & p1, const Point<2> & p2, const Point<2> & p3){
-	double a0, a1, c0, c1, det, asq, csq, ctr0, ctr1, rad2;
-	a0 = p1.x[0] - p2.x[0]; a1 = p1.x[1] - p2.x[1];
-	c0 = p3.x[0] - p2.x[0]; c1 = p3.x[1] - p2.x[1];
+// the circumcircle is always evaluated in double precision,
+// whatever the storage type of the points
+template <class T>
+GeneralPoint<2, T> circumcenter(const GeneralPoint<2, T> & p1, const GeneralPoint<2, T> & p2, const GeneralPoint<2, T> & p3){
+	double a0, a1, c0, c1, det, asq, csq, ctr0, ctr1;
+	a0 = double(p1.x[0]) - p2.x[0]; a1 = double(p1.x[1]) - p2.x[1];
+	c0 = double(p3.x[0]) - p2.x[0]; c1 = double(p3.x[1]) - p2.x[1];
 	det = a0*c1 - c0*a1;
 	if (det == 0.0) throw("no circle thru colinear points");
 	det = 0.5/det;
@@ -118,14 +120,15 @@ inline Point<2> circumcenter(const Point<2> & p1, const Point<2> & p2, const Poi
 	csq = c0*c0 + c1*c1;
 	ctr0 = det*(asq*c1 - csq*a1);
 	ctr1 = det*(csq*a0 - asq*c0);
-	return Point<2>(ctr0 + p2.x[0], ctr1 + p2.x[1]);
+	return GeneralPoint<2, T>(ctr0 + p2.x[0], ctr1 + p2.x[1]);
 }
 
 
-inline double circumradius(const Point<2> & p1, const Point<2> & p2, const Point<2> & p3){
+template <class T>
+double circumradius(const GeneralPoint<2, T> & p1, const GeneralPoint<2, T> & p2, const GeneralPoint<2, T> & p3){
 	double a0, a1, c0, c1, det, asq, csq, ctr0, ctr1, rad2;
-	a0 = p1.x[0] - p2.x[0]; a1 = p1.x[1] - p2.x[1];
-	c0 = p3.x[0] - p2.x[0]; c1 = p3.x[1] - p2.x[1];
+	a0 = double(p1.x[0]) - p2.x[0]; a1 = double(p1.x[1]) - p2.x[1];
+	c0 = double(p3.x[0]) - p2.x[0]; c1 = double(p3.x[1]) - p2.x[1];
 	det = a0*c1 - c0*a1;
 	if (det == 0.0) throw("no circle thru colinear points");
 	det = 0.5/det;
@@ -288,8 +291,7 @@ struct LineSegment : public Segment<2>{
 
 	double isLeftImp(const Point<2> & pt) const {
 		// std::cout << "LINESEGMENT isLeft" << std::endl;
-		return ((end.x[0]-begin.x[0])*(pt.x[1]-begin.x[1])
-			  - (pt.x[0] - begin.x[0])*(end.x[1] - begin.x[1]));
+		return orient2d(begin, end, pt);
 	}
 
 	void print_summary(std::ostream & os = std::cout) const{
@@ -357,16 +359,16 @@ struct CircleSegment : public Segment<2>{
 };
 
 
-template<std::size_t dim>
+template<std::size_t dim, class T = double>
 struct Hull{
 	// list of points assumed to be in consecutive order
-	std::vector<Point<dim>> points;
+	std::vector<GeneralPoint<dim, T>> points;
 
 	// empty constructor
 	Hull(){};
 
 	// constructor
-	Hull(const std::vector<Point<dim>> & pts)
+	Hull(const std::vector<GeneralPoint<dim, T>> & pts)
 	: points(pts) {};
 
 
@@ -378,10 +380,10 @@ struct Hull{
 };
 
 
-template <std::size_t dim>
+template <std::size_t dim, class T = double>
 struct Triangulation{
 
-	std::vector<Point<dim>> points;		// list of points
+	std::vector<GeneralPoint<dim, T>> points;	// list of points
 	std::vector<IntPoint3> triangles;	// list of triangles as indices in the points vector
 
 	Triangulation() {};
@@ -413,9 +415,10 @@ struct stl_tri{
 };
 #pragma pack(pop)
 
-inline std::shared_ptr<Triangulation<3>> read_STL(std::string filename, unsigned int byte_offset=0){
+// STL vertices are float32 on disk, and are kept that way
+inline std::shared_ptr<Triangulation<3, float>> read_STL(std::string filename, unsigned int byte_offset=0){
 	// declare vars
-	std::shared_ptr<Triangulation<3>> out(new Triangulation<3>());
+	std::shared_ptr<Triangulation<3, float>> out(new Triangulation<3, float>());
 	int fd;
 	unsigned int tricount;
 	char * stlmap;
@@ -440,19 +443,16 @@ inline std::shared_ptr<Triangulation<3>> read_STL(std::string filename, unsigned
 	throw -1;
 	}
 
-	// copy the triangle data into structures
-	// stl_tri * triangles = new stl_tri[tricount];
-	std::vector<stl_tri> triangles(tricount);
-	// memcpy(triangles, &stlmap[84], sizeof(stl_tri)*tricount);
-	std::copy(&stlmap[84], &stlmap[84+sizeof(stl_tri)*tricount], (char *) &triangles.front());
+	// the packed triangle records are read straight out of the map
+	const stl_tri * triangles = reinterpret_cast<const stl_tri *>(&stlmap[84]);
 
 	// copy the structure data into the member data
 	out->points.resize(tricount*3);
 	out->triangles.resize(tricount);
 	for (unsigned int i=0; i<tricount; i++){
-		out->points[i*3] = Point<3>(triangles[i].v1_x, triangles[i].v1_y, triangles[i].v1_z);
-		out->points[i*3+1] = Point<3>(triangles[i].v2_x, triangles[i].v2_y, triangles[i].v2_z);
-		out->points[i*3+2] = Point<3>(triangles[i].v3_x, triangles[i].v3_y, triangles[i].v3_z);
+		out->points[i*3] = FloatPoint<3>(triangles[i].v1_x, triangles[i].v1_y, triangles[i].v1_z);
+		out->points[i*3+1] = FloatPoint<3>(triangles[i].v2_x, triangles[i].v2_y, triangles[i].v2_z);
+		out->points[i*3+2] = FloatPoint<3>(triangles[i].v3_x, triangles[i].v3_y, triangles[i].v3_z);
 
 		out->triangles[i] = IntPoint3(i*3, i*3+1, i*3+2);
 	}
@@ -1,41 +1,476 @@
 #ifndef _KDTREE_H
 #define _KDTREE_H
 
-#include <iostream>
 #include <vector>
+#include <thread>
+#include <algorithm>
+#include <utility>
+#include <limits>
+#include <type_traits>
+#include <cmath>
+#include <cstddef>
 
-#include "Point.hpp"
+#include "GeomUtils.hpp"
+#include "Parallel.hpp"
+#include "SpaceFillingCurve.hpp"
 
-using namespace std;
+// static k-d tree over a fixed set of points
+//
+// the tree is complete: every level splits each cell's points at their
+// median along the cell's widest axis, down to a depth where every
+// leaf holds at most leaf_size points. The node of a cell is then
+// implicit (children of node k are 2k+1 and 2k+2), and so is its range
+// of points, so a node only stores its split axis and value. The points
+// are copied in tree order, so every leaf is one contiguous bucket:
+//
+//    KDTree<3> tree(pts);
+//    std::size_t i = tree.nearest(q);     // index into pts
+//    tree.knn(queries, k, &idx.front(), &dist.front());
+//    tree.radius_search(q, r, [&](std::size_t i, double dsq){ ... });
 
+namespace csg{
 
-template <size_t dim>
+// settings of an approximate nearest neighbor search. Cells that could
+// only improve a neighbor distance by a factor of less than 1+eps are
+// skipped, so every reported distance is within (1+eps) of the true
+// one; and the search gives up after max_leaves leaf buckets (0 for no
+// limit), returning the best neighbors found by then (which can be
+// fewer than k, padded as for k > size())
+struct ApproxSearch{
+	double eps = 0.0;
+	std::size_t max_leaves = 0;
+
+	ApproxSearch() {};
+	ApproxSearch(double e, std::size_t ml=0) : eps(e), max_leaves(ml) {};
+};
+
+// bounded max-heap of the k nearest candidates (squared distance d,
+// index idx) seen so far, kept in caller-provided arrays of k entries
+struct NeighborHeap{
+	std::size_t k, count;
+	std::size_t * idx;
+	double * d;
+
+	NeighborHeap(std::size_t kk, std::size_t * ii, double * dd) : k(kk), count(0), idx(ii), d(dd) {};
+
+	// squared distance a candidate has to beat
+	double bound() const {return (count < k)? std::numeric_limits<double>::infinity() : d[0];};
+
+	void offer(double dsq, std::size_t j){
+		if (count < k) push(dsq, j);
+		else if (dsq < d[0]) sift_down(0, count, dsq, j);
+	}
+
+	void push(double dsq, std::size_t j){
+		std::size_t c = count++;
+		while (c > 0){
+			std::size_t p = (c - 1)/2;
+			if (d[p] >= dsq) break;
+			d[c] = d[p]; idx[c] = idx[p];
+			c = p;
+		}
+		d[c] = dsq; idx[c] = j;
+	}
+
+	// put (dsq, j) in the hole at c of the heap [0, n)
+	void sift_down(std::size_t c, std::size_t n, double dsq, std::size_t j){
+		while (2*c+1 < n){
+			std::size_t ch = 2*c+1;
+			if (ch+1 < n && d[ch+1] > d[ch]) ch++;
+			if (d[ch] <= dsq) break;
+			d[c] = d[ch]; idx[c] = idx[ch];
+			c = ch;
+		}
+		d[c] = dsq; idx[c] = j;
+	}
+
+	// sort the candidates nearest first (the heap is gone after this)
+	void sort(){
+		for (std::size_t n=count; n>1; n--){
+			double top = d[0];
+			std::size_t j = idx[0];
+			sift_down(0, n-1, d[n-1], idx[n-1]);
+			d[n-1] = top; idx[n-1] = j;
+		}
+	}
+};
+
+
+template <std::size_t dim>
 class KDTree{
 public:
 
-	// constructor
-	KDTree(vector<Point<dim>> & pts);
+	typedef Point<dim> PointT;
+
+	// cells of fewer points than this are built on the calling thread,
+	// where starting a thread would cost more than it saves
+	static constexpr std::size_t parallel_grain = std::size_t(1) << 15;
+
+	KDTree() : _leaf_size(16), _depth(0), _bounds(PointT(), PointT()) {};
+
+	KDTree(const std::vector<PointT> & pts, std::size_t leaf_size=16, unsigned int nthreads=0)
+	: _leaf_size(leaf_size){
+		std::vector<Entry> entries(pts.size());
+		for (std::size_t i=0; i<pts.size(); i++) entries[i] = Entry{pts[i], i};
+		build(entries, nthreads);
+	}
+
+	// any cloud with pointcount() and batch x/y/z(begin, end, out)
+	// accessors, such as PointCloud
+	template <class CloudT, class = decltype(std::declval<const CloudT &>().pointcount())>
+	KDTree(const CloudT & cloud, std::size_t leaf_size=16, unsigned int nthreads=0)
+	: KDTree(cloud_points(cloud), leaf_size, nthreads) {};
+
+	// metadata inspectors
+	std::size_t size() const {return _points.size();};
+	std::size_t leaf_size() const {return _leaf_size;};
+	std::size_t depth() const {return _depth;};
+	const Box<dim> & bounds() const {return _bounds;};
+
+	// points in tree order, and the input index of each
+	const PointT & point(std::size_t j) const {return _points[j];};
+	std::size_t index(std::size_t j) const {return _index[j];};
+
+	// input index of the point nearest to q (ties go to either);
+	// the tree must not be empty
+	std::size_t nearest(const PointT & q) const{
+		Nearest nn;
+		search(q, nn);
+		return _index[nn.best];
+	}
+
+	// input index returned for missing neighbors (k > size())
+	static constexpr std::size_t npos = std::size_t(-1);
+
+	// the k nearest neighbors of q, nearest first: their input indices
+	// go to idx[0, k) and their distances to dist[0, k)
+	void knn(const PointT & q, std::size_t k, std::size_t * idx, double * dist,
+			 const ApproxSearch & approx=ApproxSearch()) const{
+		if (k == 0) return;			// the heap has no bound to read
+		KNearest nn(k, idx, dist, approx);
+		search(q, nn);
+		finish(nn);
+	}
+
+	// the k nearest neighbors of every query, in parallel: those of
+	// query i go to idx[k*i, k*i+k) and dist[k*i, k*i+k). The queries
+	// are visited in Morton order, so that consecutive searches on a
+	// thread walk mostly the same nodes
+	void knn(const std::vector<PointT> & queries, std::size_t k, std::size_t * idx, double * dist, unsigned int nthreads=0) const{
+		knn(queries, k, idx, dist, ApproxSearch(), nthreads);
+	}
+
+	void knn(const std::vector<PointT> & queries, std::size_t k, std::size_t * idx, double * dist,
+			 const ApproxSearch & approx, unsigned int nthreads=0) const{
+		if (k == 0) return;
+		std::vector<std::size_t> order = query_order(queries);
+		parallel_for(queries.size(), nthreads, [&](std::size_t b, std::size_t e, unsigned int t){
+			for (std::size_t j=b; j<e; j++){
+				std::size_t i = order[j];
+				knn(queries[i], k, idx + k*i, dist + k*i, approx);
+			}
+		});
+	}
+
+	// the same with the points of a cloud as the queries
+	template <class CloudT, class = decltype(std::declval<const CloudT &>().pointcount())>
+	void knn(const CloudT & cloud, std::size_t k, std::size_t * idx, double * dist, unsigned int nthreads=0) const{
+		knn(cloud_points(cloud), k, idx, dist, ApproxSearch(), nthreads);
+	}
+
+	template <class CloudT, class = decltype(std::declval<const CloudT &>().pointcount())>
+	void knn(const CloudT & cloud, std::size_t k, std::size_t * idx, double * dist,
+			 const ApproxSearch & approx, unsigned int nthreads=0) const{
+		knn(cloud_points(cloud), k, idx, dist, approx, nthreads);
+	}
+
+	// call visitor(index, squared distance) for every point within r of
+	// center (inclusive), in no particular order
+	template <class Visitor>
+	void radius_search(const PointT & center, double r, Visitor && visitor) const{
+		Radius<Visitor> s(r*r, visitor);
+		search(center, s);
+	}
+
+	// number of points within r of center, stopping once it reaches
+	// limit (0 counts them all)
+	std::size_t radius_count(const PointT & center, double r, std::size_t limit=0) const{
+		Count s(r*r, (limit == 0)? npos : limit);
+		search(center, s);
+		return s.count;
+	}
+
+	// radius_count of every query into counts, in parallel and in
+	// Morton order
+	void radius_count(const std::vector<PointT> & queries, double r, std::size_t * counts,
+					  std::size_t limit=0, unsigned int nthreads=0) const{
+		std::vector<std::size_t> order = query_order(queries);
+		parallel_for(queries.size(), nthreads, [&](std::size_t b, std::size_t e, unsigned int t){
+			for (std::size_t j=b; j<e; j++) counts[order[j]] = radius_count(queries[order[j]], r, limit);
+		});
+	}
+
+	template <class CloudT, class = decltype(std::declval<const CloudT &>().pointcount())>
+	void radius_count(const CloudT & cloud, double r, std::size_t * counts,
+					  std::size_t limit=0, unsigned int nthreads=0) const{
+		radius_count(cloud_points(cloud), r, counts, limit, nthreads);
+	}
+
+	// the search all queries run on, open for custom ones: a depth-first
+	// search for q, nearer child first. S decides what happens in each
+	// leaf, s.visit(tree, q, b, e) for the points b <= j < e in tree
+	// order, and which cells can be skipped: a cell is only entered
+	// while the squared distance from q to it is at most s.bound(). The
+	// distance to a cell is kept incrementally from the per-axis offsets
+	// of q outside it (Arya and Mount)
+	template <class S>
+	void search(const PointT & q, S & s) const{
+		if (_points.empty()) return;
+		double off[dim];
+		for (std::size_t i=0; i<dim; i++) off[i] = 0.0;
+		search_node(q, s, 0, 0, _points.size(), 0, 0.0, off);
+	}
+
+	// the order batched queries run in: Morton order within their
+	// bounds (input order where there is no curve for dim)
+	static std::vector<std::size_t> query_order(const std::vector<PointT> & queries){
+		return query_order(queries, std::integral_constant<bool, dim == 2 || dim == 3>());
+	}
 
+	static double distsq(const PointT & a, const PointT & b){
+		double d = 0.0;
+		for (std::size_t i=0; i<dim; i++) d += (a.x[i] - b.x[i])*(a.x[i] - b.x[i]);
+		return d;
+	}
 
 private:
 
-	unsigned int m_num_dims;
-	vector<double> m_data;
+	struct Entry{
+		PointT p;
+		std::size_t idx;
+	};
 
-};
+	std::size_t _leaf_size;
+	std::size_t _depth;						// levels of splits; there are 2^depth leaves
+	Box<dim> _bounds;
+	std::vector<PointT> _points;			// in tree order
+	std::vector<std::size_t> _index;		// input index of each point
+	std::vector<double> _split;				// split value of each internal node
+	std::vector<unsigned char> _axis;		// split axis of each internal node
+
+	static std::vector<std::size_t> query_order(const std::vector<PointT> & queries, std::true_type){
+		return curve_order(MORTON, queries);
+	}
+
+	static std::vector<std::size_t> query_order(const std::vector<PointT> & queries, std::false_type){
+		std::vector<std::size_t> order(queries.size());
+		for (std::size_t i=0; i<order.size(); i++) order[i] = i;
+		return order;
+	}
+
+	template <class CloudT>
+	static std::vector<PointT> cloud_points(const CloudT & cloud){
+		static_assert(dim == 3, "ERROR: point clouds are 3D");
+		std::size_t n = cloud.pointcount();
+		std::vector<PointT> pts(n);
+		const std::size_t block = 4096;
+		double x[block], y[block], z[block];
+		for (std::size_t s=0; s<n; s+=block){
+			std::size_t m = std::min(block, n-s);
+			cloud.x(s, s+m, x);
+			cloud.y(s, s+m, y);
+			cloud.z(s, s+m, z);
+			for (std::size_t i=0; i<m; i++) pts[s+i] = PointT(x[i], y[i], z[i]);
+		}
+		return pts;
+	}
+
+	void build(std::vector<Entry> & entries, unsigned int nthreads){
+		std::size_t n = entries.size();
+		if (_leaf_size == 0) _leaf_size = 1;
+		if (nthreads == 0) nthreads = default_threads();
+
+		// the shallowest complete tree whose leaves all fit in a bucket
+		_depth = 0;
+		while (((n + (std::size_t(1) << _depth) - 1) >> _depth) > _leaf_size) _depth++;
+		std::size_t internal = (std::size_t(1) << _depth) - 1;
+		_split.assign(internal, 0.0);
+		_axis.assign(internal, 0);
+
+		// an empty tree has zero bounds
+		if (n > 0){
+			_bounds = cell_bounds(entries, 0, n);
+			build_node(entries, 0, 0, n, 0, _bounds, nthreads);
+		}
+		else _bounds = Box<dim>(PointT(), PointT());
 
-namespace KDTree{
+		_points.resize(n);
+		_index.resize(n);
+		for (std::size_t j=0; j<n; j++){
+			_points[j] = entries[j].p;
+			_index[j] = entries[j].idx;
+		}
+	}
 
-	struct Node{
-		unsigned int nodeIdx;
-		unsigned int parentIdx;
-		unsigned int leftChildIdx;
-		unsigned int rightChildIdx;
+	static Box<dim> cell_bounds(const std::vector<Entry> & entries, std::size_t b, std::size_t e){
+		Box<dim> bx(entries[b].p, entries[b].p);
+		for (std::size_t j=b+1; j<e; j++){
+			for (std::size_t i=0; i<dim; i++){
+				bx.lo.x[i] = std::min(bx.lo.x[i], entries[j].p.x[i]);
+				bx.hi.x[i] = std::max(bx.hi.x[i], entries[j].p.x[i]);
+			}
+		}
+		return bx;
+	}
+
+	// split [b, e) at its median along the widest axis of its bounds;
+	// the two halves are built concurrently while threads remain and
+	// the cell holds at least parallel_grain points
+	void build_node(std::vector<Entry> & entries, std::size_t node, std::size_t b, std::size_t e,
+					std::size_t level, const Box<dim> & bx, unsigned int nthreads){
+		if (level == _depth) return;
+
+		unsigned char axis = 0;
+		for (std::size_t i=1; i<dim; i++){
+			if (bx.hi.x[i] - bx.lo.x[i] > bx.hi.x[axis] - bx.lo.x[axis]) axis = i;
+		}
+		std::size_t m = b + (e - b)/2;
+		std::nth_element(entries.begin() + b, entries.begin() + m, entries.begin() + e,
+						 [axis](const Entry & u, const Entry & v){return u.p.x[axis] < v.p.x[axis];});
+		_axis[node] = axis;
+		_split[node] = (m < e)? entries[m].p.x[axis] : bx.lo.x[axis];
+
+		// the children's bounds are the parent's, cut at the split
+		Box<dim> lbx = bx, rbx = bx;
+		lbx.hi.x[axis] = _split[node];
+		rbx.lo.x[axis] = _split[node];
+
+		if (nthreads > 1 && e - b >= parallel_grain){
+			std::thread left([&, lbx](){build_node(entries, 2*node+1, b, m, level+1, lbx, nthreads/2);});
+			build_node(entries, 2*node+2, m, e, level+1, rbx, nthreads - nthreads/2);
+			left.join();
+		}
+		else {
+			build_node(entries, 2*node+1, b, m, level+1, lbx, 1);
+			build_node(entries, 2*node+2, m, e, level+1, rbx, 1);
+		}
+	}
+
+	// nearest neighbor search state
+	struct Nearest{
+		std::size_t best = 0;
+		double bestsq = std::numeric_limits<double>::infinity();
+
+		double bound() const {return bestsq;};
+		void visit(const KDTree & tree, const PointT & q, std::size_t b, std::size_t e){
+			for (std::size_t j=b; j<e; j++){
+				double d = distsq(tree._points[j], q);
+				if (d < bestsq) {bestsq = d; best = j;}
+			}
+		}
 	};
 
-}
+	// k nearest neighbor search state, with the heap in the caller's
+	// output slots. An approximate search shrinks the bound by
+	// (1+eps)^2, and closes every cell once its leaf budget is spent
+	struct KNearest : public NeighborHeap{
+		double shrink;
+		std::size_t leaves, max_leaves;
 
+		KNearest(std::size_t kk, std::size_t * ii, double * dd, const ApproxSearch & approx)
+		: NeighborHeap(kk, ii, dd), leaves(0){
+			shrink = 1.0/((1.0 + approx.eps)*(1.0 + approx.eps));
+			max_leaves = (approx.max_leaves == 0)? npos : approx.max_leaves;
+		};
 
+		double bound() const{
+			if (leaves >= max_leaves) return -1.0;
+			return NeighborHeap::bound()*shrink;
+		};
+		void visit(const KDTree & tree, const PointT & q, std::size_t b, std::size_t e){
+			leaves++;
+			for (std::size_t j=b; j<e; j++) offer(distsq(tree._points[j], q), j);
+		}
+	};
 
+	// fixed radius search state
+	template <class Visitor>
+	struct Radius{
+		double rsq;
+		Visitor & visitor;
+
+		Radius(double rr, Visitor & v) : rsq(rr), visitor(v) {};
+
+		double bound() const {return rsq;};
+		void visit(const KDTree & tree, const PointT & q, std::size_t b, std::size_t e){
+			for (std::size_t j=b; j<e; j++){
+				double dsq = distsq(tree._points[j], q);
+				if (dsq <= rsq) visitor(tree._index[j], dsq);
+			}
+		}
+	};
+
+	// counting state; once limit is reached the bound drops below zero,
+	// which closes every remaining cell
+	struct Count{
+		double rsq;
+		std::size_t limit, count;
+
+		Count(double rr, std::size_t l) : rsq(rr), limit(l), count(0) {};
+
+		double bound() const {return (count < limit)? rsq : -1.0;};
+		void visit(const KDTree & tree, const PointT & q, std::size_t b, std::size_t e){
+			for (std::size_t j=b; j<e && count<limit; j++) count += distsq(tree._points[j], q) <= rsq;
+		}
+	};
+
+	// sort the heap nearest first, and turn it into input indices and
+	// distances, padding missing neighbors
+	void finish(KNearest & nn) const{
+		nn.sort();
+		for (std::size_t c=0; c<nn.count; c++){
+			nn.idx[c] = _index[nn.idx[c]];
+			nn.d[c] = std::sqrt(nn.d[c]);
+		}
+		for (std::size_t c=nn.count; c<nn.k; c++){
+			nn.idx[c] = npos;
+			nn.d[c] = std::numeric_limits<double>::infinity();
+		}
+	}
+
+	template <class S>
+	void search_node(const PointT & q, S & s, std::size_t node, std::size_t b, std::size_t e,
+					 std::size_t level, double rd, double * off) const{
+		if (rd > s.bound()) return;
+		if (level == _depth){
+			s.visit(*this, q, b, e);
+			return;
+		}
+
+		std::size_t m = b + (e - b)/2;
+		unsigned char axis = _axis[node];
+		double diff = q.x[axis] - _split[node];
+		std::size_t near = (diff < 0)? 2*node+1 : 2*node+2, far = (diff < 0)? 2*node+2 : 2*node+1;
+		if (diff < 0) search_node(q, s, near, b, m, level+1, rd, off);
+		else search_node(q, s, near, m, e, level+1, rd, off);
+
+		// the far cell is diff away along axis
+		double old = off[axis];
+		double frd = rd - old*old + diff*diff;
+		if (frd <= s.bound()){
+			off[axis] = diff;
+			if (diff < 0) search_node(q, s, far, m, e, level+1, frd, off);
+			else search_node(q, s, far, b, m, level+1, frd, off);
+			off[axis] = old;
+		}
+	}
+};
+
+template <std::size_t dim>
+constexpr std::size_t KDTree<dim>::npos;
+template <std::size_t dim>
+constexpr std::size_t KDTree<dim>::parallel_grain;
+
+}
 
 #endif
@@ -0,0 +1,63 @@
+#ifndef _LASCATALOG_H
+#define _LASCATALOG_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "LASFile.hpp"
+
+// catalog of the LAS files in a directory
+//
+// only the public header block of each file is read (in parallel),
+// and the raw headers are cached in an index file alongside the file
+// size and modification time. Opening the catalog again only re-reads
+// the headers of files that were added or changed since:
+//
+//    LASCatalog cat("surveys/");
+//    for (auto k : cat.intersecting(box)) { ... cat.filename(k) ... }
+
+
+struct LASCatalogEntry{
+  std::string name;             // file name within the directory
+  std::int64_t mtime;           // modification time (ns)
+  std::uint64_t size;           // file size (bytes)
+  LASHeader header;             // counts, format, scales, offsets and bounds
+
+  csg::Box<3> bounds() const;
+};
+
+
+class LASCatalog{
+public:
+
+  // scan directory, reusing the index file where it is still valid
+  // (index_file defaults to directory/lascatalog.idx)
+  LASCatalog(std::string directory, std::string index_file="", unsigned int nthreads=0);
+
+  // rescan the directory; returns the number of headers that were re-read
+  // and parsed (files that fail to parse are skipped and not counted)
+  std::size_t refresh(unsigned int nthreads=0);
+
+  // metadata inspectors
+  const std::string & directory() const {return _directory;};
+  const std::vector<LASCatalogEntry> & entries() const {return _entries;};
+  std::size_t size() const {return _entries.size();};
+  std::string filename(std::size_t k) const {return _directory + "/" + _entries.at(k).name;};
+  std::size_t pointcount() const;
+  csg::Box<3> bounds() const;
+
+  // indices of the files whose header bounds intersect box
+  std::vector<std::size_t> intersecting(const csg::Box<3> & box) const;
+
+private:
+  std::string _directory;
+  std::string _index_file;
+  std::vector<LASCatalogEntry> _entries;
+  std::vector<std::vector<char>> _raw;    // raw header block of each entry, as cached
+
+  bool read_index(std::vector<LASCatalogEntry> & entries, std::vector<std::vector<char>> & raw) const;
+  void write_index() const;
+};
+
+#endif
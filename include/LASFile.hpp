@@ -0,0 +1,303 @@
+#ifndef _LASFILE_H
+#define _LASFILE_H
+
+#include <string>
+#include <vector>
+#include <iterator>
+
+#include "PointCloud.hpp"
+
+// memory-mapped, read-only view of a LAS file
+//
+// opening a file maps it and parses the public header block only.
+// point records are exposed in place through typed views over
+// las_pt_0 ... las_pt_5, and scaled coordinates/attributes are
+// decoded either in batches over a record range, or lazily into
+// whole columns the first time they are touched
+
+
+// public header block fields that we care about
+struct LASHeader{
+  unsigned char ver_major, ver_minor;
+  unsigned char point_format_id;
+  unsigned short header_size;
+  unsigned int point_offset;
+  unsigned int num_vlrs;
+  unsigned short point_record_bytes;
+  std::size_t pt_count;
+  unsigned long long pts_by_return[15];
+  double x_scale, y_scale, z_scale;
+  double x_offset, y_offset, z_offset;
+  double x_min, y_min, z_min, x_max, y_max, z_max;
+
+  // parse from the start of a header block (len bytes available)
+  static LASHeader parse(const char * buf, std::size_t len);
+
+  // whether the records can be read: a point format we know (0-5), a
+  // record length that holds at least its base record, and point data
+  // that starts after the header
+  bool records_readable() const;
+
+  // serialize into buf, which must hold header_size bytes
+  void write(char * buf) const;
+};
+
+
+// an attribute stored in the extra bytes at the end of each point
+// record, as described by the "LASF_Spec" extra bytes VLR (record 4)
+struct LASExtraBytes{
+  std::string name;
+  unsigned char data_type;    // LAS extra bytes data type (1=uchar, 3=ushort, 6=long, 9=float, 10=double, ...)
+  std::size_t offset;         // byte offset within the point record
+  std::size_t size;           // bytes per point
+
+  // size in bytes of a data type (0 for the "undocumented" type 0)
+  static std::size_t type_size(unsigned char data_type);
+};
+
+// size of the base record of each point format
+inline std::size_t las_record_size(unsigned char point_format_id){
+  static const std::size_t sizes[6] = {20, 28, 26, 34, 57, 63};
+  return (point_format_id < 6)? sizes[point_format_id] : 0;
+}
+
+
+// compile-time properties of each point record format
+template <class RecordT> struct las_format;
+
+template <> struct las_format<las_pt_0>{
+  static const unsigned char id = 0;
+  static const bool has_gpstime = false, has_RGB = false;
+  static double gpstime(const las_pt_0 & p) {return 0.0;};
+  static rgb48 RGB(const las_pt_0 & p) {return rgb48{0, 0, 0};};
+  static void set_gpstime(las_pt_0 & p, double t) {};
+  static void set_RGB(las_pt_0 & p, const rgb48 & c) {};
+};
+
+template <> struct las_format<las_pt_1>{
+  static const unsigned char id = 1;
+  static const bool has_gpstime = true, has_RGB = false;
+  static double gpstime(const las_pt_1 & p) {return p.GPSTime;};
+  static rgb48 RGB(const las_pt_1 & p) {return rgb48{0, 0, 0};};
+  static void set_gpstime(las_pt_1 & p, double t) {p.GPSTime = t;};
+  static void set_RGB(las_pt_1 & p, const rgb48 & c) {};
+};
+
+template <> struct las_format<las_pt_2>{
+  static const unsigned char id = 2;
+  static const bool has_gpstime = false, has_RGB = true;
+  static double gpstime(const las_pt_2 & p) {return 0.0;};
+  static rgb48 RGB(const las_pt_2 & p) {return rgb48{p.Red, p.Green, p.Blue};};
+  static void set_gpstime(las_pt_2 & p, double t) {};
+  static void set_RGB(las_pt_2 & p, const rgb48 & c) {p.Red = c.R; p.Green = c.G; p.Blue = c.B;};
+};
+
+template <> struct las_format<las_pt_3>{
+  static const unsigned char id = 3;
+  static const bool has_gpstime = true, has_RGB = true;
+  static double gpstime(const las_pt_3 & p) {return p.GPSTime;};
+  static rgb48 RGB(const las_pt_3 & p) {return rgb48{p.Red, p.Green, p.Blue};};
+  static void set_gpstime(las_pt_3 & p, double t) {p.GPSTime = t;};
+  static void set_RGB(las_pt_3 & p, const rgb48 & c) {p.Red = c.R; p.Green = c.G; p.Blue = c.B;};
+};
+
+template <> struct las_format<las_pt_4>{
+  static const unsigned char id = 4;
+  static const bool has_gpstime = true, has_RGB = false;
+  static double gpstime(const las_pt_4 & p) {return p.GPSTime;};
+  static rgb48 RGB(const las_pt_4 & p) {return rgb48{0, 0, 0};};
+  static void set_gpstime(las_pt_4 & p, double t) {p.GPSTime = t;};
+  static void set_RGB(las_pt_4 & p, const rgb48 & c) {};
+};
+
+template <> struct las_format<las_pt_5>{
+  static const unsigned char id = 5;
+  static const bool has_gpstime = true, has_RGB = true;
+  static double gpstime(const las_pt_5 & p) {return p.GPSTime;};
+  static rgb48 RGB(const las_pt_5 & p) {return rgb48{p.Red, p.Green, p.Blue};};
+  static void set_gpstime(las_pt_5 & p, double t) {p.GPSTime = t;};
+  static void set_RGB(las_pt_5 & p, const rgb48 & c) {p.Red = c.R; p.Green = c.G; p.Blue = c.B;};
+};
+
+
+// strided view of records of one format, directly over the mapped bytes
+// (the stride is point_record_bytes, which may include extra bytes)
+template <class RecordT>
+class LASRecordView{
+public:
+  typedef RecordT record_type;
+
+  class const_iterator{
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef RecordT value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const RecordT * pointer;
+    typedef const RecordT & reference;
+
+    const_iterator(const char * p, std::size_t stride) : _p(p), _stride(stride) {};
+    const RecordT & operator*() const {return *reinterpret_cast<const RecordT *>(_p);};
+    const RecordT * operator->() const {return reinterpret_cast<const RecordT *>(_p);};
+    const_iterator & operator++() {_p += _stride; return *this;};
+    const_iterator operator++(int) {const_iterator it(*this); _p += _stride; return it;};
+    bool operator==(const const_iterator & it) const {return _p == it._p;};
+    bool operator!=(const const_iterator & it) const {return _p != it._p;};
+  private:
+    const char * _p;
+    std::size_t _stride;
+  };
+
+  LASRecordView() : _base(nullptr), _count(0), _stride(sizeof(RecordT)) {};
+  LASRecordView(const char * base, std::size_t count, std::size_t stride)
+  : _base(base), _count(count), _stride(stride) {};
+
+  std::size_t size() const {return _count;};
+  std::size_t stride() const {return _stride;};
+  const RecordT & operator[](std::size_t i) const {return *reinterpret_cast<const RecordT *>(_base + i*_stride);};
+  const_iterator begin() const {return const_iterator(_base, _stride);};
+  const_iterator end() const {return const_iterator(_base + _count*_stride, _stride);};
+
+private:
+  const char * _base;
+  std::size_t _count, _stride;
+};
+
+
+class LASFile{
+public:
+
+  LASFile(std::string filename, std::size_t byte_offset=0);   // map file, read header
+  ~LASFile();
+  LASFile(const LASFile & las) = delete;
+  LASFile & operator=(const LASFile & las) = delete;
+
+  // metadata inspectors
+  const std::string & filename() const {return _filename;};
+  const LASHeader & header() const {return _header;};
+  std::size_t pointcount() const {return _header.pt_count;};
+  unsigned char point_format() const {return _header.point_format_id;};
+  bool gpstime_present() const;
+  bool RGB_present() const;
+  const std::vector<LASExtraBytes> & extra_bytes() const {return _extra_bytes;};
+
+  // raw and typed access to the records in the map
+  const char * record(std::size_t i) const {return _points + i*_header.point_record_bytes;};
+  template <class RecordT> LASRecordView<RecordT> records() const;
+
+  // scaled coordinates of a single record
+  double x_at(std::size_t i) const {return double(reinterpret_cast<const las_pt_0 *>(record(i))->X)*_header.x_scale + _header.x_offset;};
+  double y_at(std::size_t i) const {return double(reinterpret_cast<const las_pt_0 *>(record(i))->Y)*_header.y_scale + _header.y_offset;};
+  double z_at(std::size_t i) const {return double(reinterpret_cast<const las_pt_0 *>(record(i))->Z)*_header.z_scale + _header.z_offset;};
+
+  // batch decode of the records [begin, end) into caller-owned arrays
+  void decode_xyz(std::size_t begin, std::size_t end, double * x, double * y, double * z) const;
+  void decode_raw_xyz(std::size_t begin, std::size_t end, int * X, int * Y, int * Z) const;   // unscaled
+  void decode_intensity(std::size_t begin, std::size_t end, unsigned short * intensity) const;
+  void decode_classification(std::size_t begin, std::size_t end, unsigned char * classification) const;
+  void decode_return_info(std::size_t begin, std::size_t end, unsigned char * return_info) const;   // return number, number of returns, flags
+  void decode_gpstime(std::size_t begin, std::size_t end, double * gpstime) const;
+  void decode_RGB(std::size_t begin, std::size_t end, rgb48 * RGB) const;
+  void decode_extra_bytes(std::size_t k, std::size_t begin, std::size_t end, char * out) const;   // raw bytes of attribute k
+
+  // whole columns, decoded on first access and then cached
+  const double & x() const;
+  const double & y() const;
+  const double & z() const;
+  const unsigned short & intensity() const;
+  const unsigned char & classification() const;
+  const double & gpstime() const;
+  const rgb48 & RGB() const;
+
+  // drop any cached columns
+  void release_columns();
+
+  // tell the kernel that the records [begin, end) are no longer needed,
+  // so their pages can be dropped from this process (they are re-read
+  // from the file if touched again)
+  void release_records(std::size_t begin, std::size_t end) const;
+
+protected:
+
+private:
+  std::string _filename;
+  LASHeader _header;
+
+  int _fd;
+  char * _map;
+  std::size_t _mapsize;
+  const char * _points;
+  std::vector<LASExtraBytes> _extra_bytes;
+
+  void read_vlrs(const char * base);
+
+  // lazily decoded columns
+  mutable std::vector<double> _x, _y, _z, _gpstime;
+  mutable std::vector<unsigned short> _intensity;
+  mutable std::vector<unsigned char> _classification;
+  mutable std::vector<rgb48> _RGB;
+
+  void load_xyz() const;
+
+  // call fn with the typed record view for this file's point format
+  template <class Fn> void dispatch(Fn && fn) const;
+};
+
+
+
+// reads a LAS file front to back in fixed-size chunks into a
+// reusable PointCloud, so memory stays bounded by the chunk size
+//
+//    LASChunkReader reader("big.las", 1000000);
+//    PointCloud chunk;
+//    while (reader.next(chunk)) { ... }
+class LASChunkReader{
+public:
+
+  LASChunkReader(std::string filename, std::size_t chunk_size=1<<20,
+                 const LASReadOptions & opts=LASReadOptions());
+
+  // fill chunk with the next chunk_size records (fewer at the end of
+  // the file, or when the options filter records out);
+  // returns false once the file is exhausted
+  bool next(PointCloud & chunk);
+
+  // index of the first record the next chunk will hold
+  std::size_t position() const {return _pos;};
+  std::size_t chunk_size() const {return _chunk_size;};
+  const LASFile & file() const {return _las;};
+
+private:
+  LASFile _las;
+  std::size_t _chunk_size;
+  std::size_t _pos;
+  LASReadOptions _opts;
+};
+
+
+
+template <class RecordT>
+LASRecordView<RecordT> LASFile::records() const{
+  if (las_format<RecordT>::id != _header.point_format_id){
+    std::cout << "LASFile: requested record format " << int(las_format<RecordT>::id);
+    std::cout << " but " << _filename << " has format " << int(_header.point_format_id) << std::endl;
+    throw -1;
+  }
+  return LASRecordView<RecordT>(_points, pointcount(), _header.point_record_bytes);
+}
+
+template <class Fn>
+void LASFile::dispatch(Fn && fn) const{
+  switch (_header.point_format_id)
+  {
+    case 0: fn(records<las_pt_0>()); break;
+    case 1: fn(records<las_pt_1>()); break;
+    case 2: fn(records<las_pt_2>()); break;
+    case 3: fn(records<las_pt_3>()); break;
+    case 4: fn(records<las_pt_4>()); break;
+    case 5: fn(records<las_pt_5>()); break;
+    default:
+      std::cout << "this should not be possible" << std::endl;
+  }
+}
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef _MAPPEDALLOCATOR_H
+#define _MAPPEDALLOCATOR_H
+
+#include <string>
+#include <new>
+#include <type_traits>
+#include <cstdlib>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// allocator for large columns that can optionally live in
+// memory-mapped scratch files instead of anonymous memory
+//
+// a mapped block is a shared mapping of an unlinked temporary file,
+// so under memory pressure the kernel writes its pages back to the
+// file and drops them, rather than pushing the whole process to swap.
+// Whether a block is mapped is recorded in a small header in front of
+// it, so any allocator can free any block and all compare equal; the
+// mapped flag only decides where new blocks go, and it travels with
+// the container's buffer on copy, move and swap
+
+namespace csg{
+
+// where the scratch files are created ($TMPDIR, else /tmp)
+inline std::string & scratch_directory(){
+	static std::string dir = (getenv("TMPDIR") != nullptr)? getenv("TMPDIR") : "/tmp";
+	return dir;
+}
+
+inline void set_scratch_directory(const std::string & dir){
+	scratch_directory() = dir;
+}
+
+// access pattern hints for mapped blocks (see madvise)
+enum MappedAdvice {ADVISE_NORMAL, ADVISE_SEQUENTIAL, ADVISE_RANDOM, ADVISE_WILLNEED, ADVISE_DONTNEED};
+
+namespace mapped{
+
+	// every block is preceded by one of these, padded out to the
+	// block's alignment (a whole page for mapped blocks)
+	struct BlockHeader{
+		std::size_t length;		// bytes of the mapping, or 0 for a heap block
+		std::size_t prefix;		// bytes from the start of the allocation to the data
+	};
+
+	inline std::size_t page_size(){
+		static std::size_t page = sysconf(_SC_PAGESIZE);
+		return page;
+	}
+
+	inline void * allocate(std::size_t bytes, std::size_t align, bool file_backed){
+		if (align < sizeof(BlockHeader)) align = sizeof(BlockHeader);
+
+		if (!file_backed){
+			void * p = nullptr;
+			if (posix_memalign(&p, align, align + bytes) != 0) throw std::bad_alloc();
+			char * data = static_cast<char *>(p) + align;
+			*reinterpret_cast<BlockHeader *>(data - sizeof(BlockHeader)) = BlockHeader{0, align};
+			return data;
+		}
+
+		// an unlinked scratch file lives exactly as long as its mapping
+		std::size_t page = page_size();
+		std::size_t length = page + (bytes + page - 1)/page*page;
+		std::string path = scratch_directory() + "/csg_column_XXXXXX";
+		int fd = mkstemp(&path[0]);
+		if (fd < 0) throw std::bad_alloc();
+		unlink(path.c_str());
+		if (ftruncate(fd, length) != 0){
+			close(fd);
+			throw std::bad_alloc();
+		}
+		void * p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (p == MAP_FAILED) throw std::bad_alloc();
+		char * data = static_cast<char *>(p) + page;
+		*reinterpret_cast<BlockHeader *>(data - sizeof(BlockHeader)) = BlockHeader{length, page};
+		return data;
+	}
+
+	inline const BlockHeader & header(const void * data){
+		return *reinterpret_cast<const BlockHeader *>(static_cast<const char *>(data) - sizeof(BlockHeader));
+	}
+
+	inline void deallocate(void * data){
+		if (data == nullptr) return;
+		BlockHeader h = header(data);
+		char * p = static_cast<char *>(data) - h.prefix;
+		if (h.length == 0) free(p);
+		else munmap(p, h.length);
+	}
+
+	inline bool is_mapped(const void * data){
+		return data != nullptr && header(data).length > 0;
+	}
+
+	// pass an access pattern hint on to the kernel (mapped blocks only)
+	inline void advise(const void * data, MappedAdvice advice){
+		if (!is_mapped(data)) return;
+		const BlockHeader & h = header(data);
+		int a = MADV_NORMAL;
+		switch (advice){
+			case ADVISE_NORMAL: a = MADV_NORMAL; break;
+			case ADVISE_SEQUENTIAL: a = MADV_SEQUENTIAL; break;
+			case ADVISE_RANDOM: a = MADV_RANDOM; break;
+			case ADVISE_WILLNEED: a = MADV_WILLNEED; break;
+			case ADVISE_DONTNEED: a = MADV_DONTNEED; break;		// pages stay in the file
+		}
+		madvise(const_cast<char *>(static_cast<const char *>(data)), h.length - h.prefix, a);
+	}
+
+}
+
+
+template <class T, std::size_t Align = 64>
+struct MappedAllocator{
+	typedef T value_type;
+	typedef std::true_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+	typedef std::true_type is_always_equal;
+
+	template <class U>
+	struct rebind {typedef MappedAllocator<U, Align> other;};
+
+	bool file_backed;
+
+	MappedAllocator(bool mapped=false) : file_backed(mapped) {};
+
+	template <class U>
+	MappedAllocator(const MappedAllocator<U, Align> & a) : file_backed(a.file_backed) {};
+
+	T * allocate(std::size_t n){
+		if (n == 0) return nullptr;
+		return static_cast<T *>(mapped::allocate(n*sizeof(T), Align, file_backed));
+	}
+
+	void deallocate(T * p, std::size_t n){
+		mapped::deallocate(p);
+	}
+
+	template <class U>
+	bool operator==(const MappedAllocator<U, Align> & a) const {return true;};
+
+	template <class U>
+	bool operator!=(const MappedAllocator<U, Align> & a) const {return false;};
+};
+
+}
+
+#endif
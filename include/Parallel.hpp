@@ -0,0 +1,44 @@
+#ifndef _PARALLEL_H
+#define _PARALLEL_H
+
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+// minimal fork-join helpers on top of std::thread
+// (link with -pthread)
+
+namespace csg{
+
+// number of threads to use when the caller asks for 0
+inline unsigned int default_threads(){
+	unsigned int n = std::thread::hardware_concurrency();
+	return (n > 0)? n : 1;
+}
+
+// split [0, n) into nthreads contiguous blocks and call
+// fn(begin, end, thread_id) for each, one block per thread.
+// The calling thread does block 0. nthreads == 0 uses default_threads()
+template <class Fn>
+void parallel_for(std::size_t n, unsigned int nthreads, Fn && fn){
+	if (nthreads == 0) nthreads = default_threads();
+	if (std::size_t(nthreads) > n) nthreads = (n > 0)? n : 1;
+	if (nthreads <= 1){
+		fn(std::size_t(0), n, 0u);
+		return;
+	}
+
+	std::size_t block = (n + nthreads - 1)/nthreads;
+	std::vector<std::thread> workers;
+	workers.reserve(nthreads-1);
+	for (unsigned int t=1; t<nthreads; t++){
+		std::size_t b = std::min(n, t*block), e = std::min(n, b+block);
+		workers.emplace_back([&fn, b, e, t](){fn(b, e, t);});
+	}
+	fn(std::size_t(0), std::min(n, block), 0u);
+	for (auto & w : workers) w.join();
+}
+
+}
+
+#endif
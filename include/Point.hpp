@@ -6,35 +6,92 @@
 #include <math.h>
 #include <vector>
 #include <array>
+#include <limits>
+#include <cstdlib>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 namespace csg{
 
 template <std::size_t dim, class T>
-class GeneralPoint{
+class GeneralPoint;
+
+
+
+// base class for lazily-evaluated point expressions (CRTP).
+// Arithmetic on points builds a tree of these expression
+// nodes, and the whole tree is evaluated in a single fused
+// loop when it is assigned to a GeneralPoint, so that
+// something like 0.5*(a+b) never creates a temporary point
+template <class E>
+struct PointExpr{
+	constexpr const E & self() const {return static_cast<const E &>(*this);};
+
+	// evaluate the expression into a concrete point
+	constexpr auto eval() const {
+		return GeneralPoint<E::dimension, typename E::value_type>(self());
+	}
+
+	double norm() const{
+		double magn = 0;
+		for (std::size_t i=0; i<E::dimension; i++) magn += self()[i]*self()[i];
+		return sqrt(magn);
+	}
+
+	auto normalize() const{
+		double magn = norm();
+		return (1.0/magn*self()).eval();
+	}
+};
+
+template <class E>
+struct is_point_expr : public std::is_base_of<PointExpr<E>, E> {};
+
+// whether From converts to To without loss: the same type, or a
+// floating point type to one at least as wide
+template <class From, class To>
+struct is_widening : public std::integral_constant<bool, std::is_same<From, To>::value
+	|| (std::is_floating_point<From>::value && std::is_floating_point<To>::value && sizeof(From) <= sizeof(To))> {};
+
+
+
+template <std::size_t dim, class T>
+class GeneralPoint : public PointExpr<GeneralPoint<dim, T>>{
 public:
+	static constexpr std::size_t dimension = dim;
+	typedef T value_type;
+
 	// data
 	T x[dim];
 
 	constexpr std::size_t size() const {return dim;}; 
 
 	// default constructor
-	GeneralPoint(){};
+	GeneralPoint() = default;
 
 	// constructor
-	GeneralPoint(T x0){
+	constexpr GeneralPoint(T x0)
+	: x{} {
 		static_assert(dim == 1, "ERROR: That GeneralPoint constructor not implemented for dim > 1");
 		x[0] = x0;
 	}
 
 	// constructor
-	GeneralPoint(T x0, T x1){
+	constexpr GeneralPoint(T x0, T x1)
+	: x{} {
 		x[0] = x0;
 		if (dim > 1) x[1] = x1;
 		if (dim > 2) throw("ERROR: That GeneralPoint constructor not implemented for dim > 3");
 	}
 
-	// // constructor
-	GeneralPoint(T x0, T x1, T x2){
+	// constructor
+	constexpr GeneralPoint(T x0, T x1, T x2)
+	: x{} {
 		x[0] = x0;
 		if (dim > 1) x[1] = x1;
 		if (dim > 2) x[2] = x2;
@@ -46,91 +103,72 @@ public:
 		for (auto i=0; i<xin.size(); i++) x[i] = xin[i];
 	}
 
-	// copy constructor
-	GeneralPoint(const GeneralPoint & p){
-		for (auto i=0; i<dim; i++) x[i] = p.x[i];
-	}
-
-	// assignment
-	GeneralPoint & operator= (const GeneralPoint & p){
-		for (auto i=0; i<dim; i++) x[i] = p.x[i];
+	// evaluate an expression of the same scalar type (or one that
+	// widens to it, like float to double)
+	template <class E, typename std::enable_if<E::dimension == dim && is_widening<typename E::value_type, T>::value, int>::type = 0>
+	constexpr GeneralPoint(const PointExpr<E> & e)
+	: GeneralPoint(e.self(), std::make_index_sequence<dim>{}) {}
+
+	// any other scalar type has to be converted explicitly
+	template <class E, typename std::enable_if<E::dimension == dim && !is_widening<typename E::value_type, T>::value, int>::type = 0>
+	explicit constexpr GeneralPoint(const PointExpr<E> & e)
+	: GeneralPoint(e.self(), std::make_index_sequence<dim>{}) {}
+
+	// assignment from an expression.
+	// all expressions are elementwise, so aliasing is safe
+	template <class E, typename std::enable_if<is_widening<typename E::value_type, T>::value, int>::type = 0>
+	constexpr GeneralPoint & operator= (const PointExpr<E> & e){
+		static_assert(E::dimension == dim, "ERROR: GeneralPoint expression dimension mismatch");
+		assign(e.self(), std::make_index_sequence<dim>{});
 		return *this;
 	}
 
-	// addition
-	GeneralPoint operator+ (const GeneralPoint & p) const{
-		GeneralPoint out(p);
-		for (auto i=0; i<dim; i++) out.x[i] = x[i] + p.x[i];
-		return out;
-	}
+	// element access
+	constexpr const T & operator[](std::size_t i) const {return x[i];};
+	constexpr T & operator[](std::size_t i) {return x[i];};
 
-	// subtraction
-	GeneralPoint operator- (const GeneralPoint & p) const{
-		GeneralPoint out(p);
-		for (auto i=0; i<dim; i++) out.x[i] = x[i] - p.x[i];
-		return out;
-	}
-
-	// scalar multiplication
-	GeneralPoint operator* (T val) const{
-		GeneralPoint out(*this);
-		for (auto i=0; i<dim; i++) out.x[i] = val*x[i];
-		return out;
-	}
-
-	// division
-	GeneralPoint operator/ (T val) const{
-		GeneralPoint out(*this);
-		for (auto i=0; i<dim; i++) out.x[i] = x[i]/val;
-		return out;
-	}
-
-	// scalar addition 
-	GeneralPoint operator+ (T val) const{
-		GeneralPoint out(*this);
-		for (auto i=0; i<dim; i++) out.x[i] + val;
-		return out;
+	// compound assignment
+	template <class E>
+	constexpr GeneralPoint & operator+= (const PointExpr<E> & e){
+		for (std::size_t i=0; i<dim; i++) x[i] += e.self()[i];
+		return *this;
 	}
 
-	// scalar subtraction 
-	GeneralPoint operator- (T val) const{
-		GeneralPoint out(*this);
-		for (auto i=0; i<dim; i++) out.x[i] -= val;
-		return out;
+	template <class E>
+	constexpr GeneralPoint & operator-= (const PointExpr<E> & e){
+		for (std::size_t i=0; i<dim; i++) x[i] -= e.self()[i];
+		return *this;
 	}
 
-	double norm() const{
-		double magn = 0;
-		for (auto i=0; i<dim; i++) magn += x[i]*x[i];
-		return sqrt(magn);
+	constexpr GeneralPoint & operator*= (T val){
+		for (std::size_t i=0; i<dim; i++) x[i] *= val;
+		return *this;
 	}
 
-	GeneralPoint normalize() const{
-		double magn = norm();
-		return 1.0/magn*(*this);
+	constexpr GeneralPoint & operator/= (T val){
+		for (std::size_t i=0; i<dim; i++) x[i] /= val;
+		return *this;
 	}
 
 	// comparison
-	bool operator== (const GeneralPoint & p) const {
-		for (auto i=0; i<dim; i++) if (x[i] != p.x[i]) return false;
+	constexpr bool operator== (const GeneralPoint & p) const {
+		for (std::size_t i=0; i<dim; i++) if (x[i] != p.x[i]) return false;
 		return true;
 	}
 
 	static double dist(const GeneralPoint & p1, const GeneralPoint & p2){
-		double dsq = 0.0;
-		for (auto i=0; i<dim; i++) dsq += (p1.x[i] - p2.x[i])*(p1.x[i] - p2.x[i]);
-		return sqrt(dsq);
+		return sqrt(distsq(p1, p2));
 	}
 
-	static double distsq(const GeneralPoint & p1, const GeneralPoint & p2){
+	static constexpr double distsq(const GeneralPoint & p1, const GeneralPoint & p2){
 		double dsq = 0.0;
-		for (auto i=0; i<dim; i++) dsq += (p1.x[i] - p2.x[i])*(p1.x[i] - p2.x[i]);
+		for (std::size_t i=0; i<dim; i++) dsq += (p1.x[i] - p2.x[i])*(p1.x[i] - p2.x[i]);
 		return dsq;
 	}
 
-	static double dot(const GeneralPoint & p1, const GeneralPoint & p2){
+	static constexpr double dot(const GeneralPoint & p1, const GeneralPoint & p2){
 		double dt = 0.0;
-		for (auto i=0; i<dim; i++) dt += p1.x[i]*p2.x[i];
+		for (std::size_t i=0; i<dim; i++) dt += p1.x[i]*p2.x[i];
 		return dt;
 	}
 
@@ -143,8 +181,165 @@ public:
 	template<std::size_t d, class t>
 	friend std::istream & operator>>(std::istream & os, GeneralPoint<d, t> & p);
 
+private:
+	// the expression is expanded over the index sequence so that
+	// evaluation is fully unrolled and nothing is zero-filled first
+	template <class E, std::size_t... I>
+	constexpr GeneralPoint(const E & e, std::index_sequence<I...>)
+	: x{static_cast<T>(e[I])...} {}
+
+	template <class E, std::size_t... I>
+	constexpr void assign(const E & e, std::index_sequence<I...>){
+		T vals[dim] = {static_cast<T>(e[I])...};
+		for (std::size_t i=0; i<dim; i++) x[i] = vals[i];
+	}
+
+};
+
+template <std::size_t dim, class T>
+constexpr std::size_t GeneralPoint<dim, T>::dimension;
+
+static_assert(std::is_trivially_copyable<GeneralPoint<3, double>>::value, "GeneralPoint must stay trivially copyable");
+
+
+
+// points are leaves of the expression tree and are held
+// by reference when they are lvalues; expression nodes and
+// temporary points are held by value so that nothing dangles
+template <class E>
+struct PointExprStorage {typedef const E type;};
+
+template <std::size_t dim, class T>
+struct PointExprStorage<GeneralPoint<dim, T> &> {typedef const GeneralPoint<dim, T> & type;};
+
+template <std::size_t dim, class T>
+struct PointExprStorage<const GeneralPoint<dim, T> &> {typedef const GeneralPoint<dim, T> & type;};
+
+template <class E>
+struct PointExprStorage<E &> {typedef const E type;};
+
+template <class E>
+struct PointExprStorage<E &&> {typedef const E type;};
+
+template <class E>
+struct PointExprStorage<const E &> {typedef const E type;};
+
+
+// elementwise operations used by the expression nodes
+namespace pointop{
+	struct Add {template <class A, class B> static constexpr auto apply(A a, B b) {return a+b;};};
+	struct Sub {template <class A, class B> static constexpr auto apply(A a, B b) {return a-b;};};
+	struct Mul {template <class A, class B> static constexpr auto apply(A a, B b) {return a*b;};};
+	struct Div {template <class A, class B> static constexpr auto apply(A a, B b) {return a/b;};};
+	struct Mod {template <class A, class B> static constexpr auto apply(A a, B b) {return a%b;};};
+}
+
+
+// point (op) point
+template <class Op, class L, class R>
+struct PointBinaryExpr : public PointExpr<PointBinaryExpr<Op, L, R>>{
+	typedef typename std::decay<L>::type 	LE;
+	typedef typename std::decay<R>::type 	RE;
+	static constexpr std::size_t dimension = LE::dimension;
+	typedef decltype(Op::apply(std::declval<typename LE::value_type>(), std::declval<typename RE::value_type>())) value_type;
+	static_assert(LE::dimension == RE::dimension, "ERROR: point expression dimension mismatch");
+
+	constexpr PointBinaryExpr(L l, R r) : m_l(l), m_r(r) {};
+
+	constexpr value_type operator[](std::size_t i) const {return Op::apply(m_l[i], m_r[i]);};
+
+	L m_l;
+	R m_r;
+};
+
+// point (op) scalar
+template <class Op, class L, class S>
+struct PointScalarExpr : public PointExpr<PointScalarExpr<Op, L, S>>{
+	typedef typename std::decay<L>::type 	LE;
+	static constexpr std::size_t dimension = LE::dimension;
+	typedef decltype(Op::apply(std::declval<typename LE::value_type>(), std::declval<S>())) value_type;
+
+	constexpr PointScalarExpr(L l, S s) : m_l(l), m_s(s) {};
+
+	constexpr value_type operator[](std::size_t i) const {return Op::apply(m_l[i], m_s);};
+
+	L m_l;
+	S m_s;
 };
 
+// scalar (op) point
+template <class Op, class S, class R>
+struct ScalarPointExpr : public PointExpr<ScalarPointExpr<Op, S, R>>{
+	typedef typename std::decay<R>::type 	RE;
+	static constexpr std::size_t dimension = RE::dimension;
+	typedef decltype(Op::apply(std::declval<S>(), std::declval<typename RE::value_type>())) value_type;
+
+	constexpr ScalarPointExpr(S s, R r) : m_s(s), m_r(r) {};
+
+	constexpr value_type operator[](std::size_t i) const {return Op::apply(m_s, m_r[i]);};
+
+	S m_s;
+	R m_r;
+};
+
+
+#define CSG_POINT_EXPR_ENABLE(E) typename std::enable_if<is_point_expr<typename std::decay<E>::type>::value, int>::type = 0
+#define CSG_SCALAR_ENABLE(S) typename std::enable_if<std::is_arithmetic<S>::value, int>::type = 0
+
+#define CSG_POINT_BINARY_OPERATOR(OP, NAME) \
+template <class L, class R, CSG_POINT_EXPR_ENABLE(L), CSG_POINT_EXPR_ENABLE(R)> \
+constexpr PointBinaryExpr<pointop::NAME, typename PointExprStorage<L&&>::type, typename PointExprStorage<R&&>::type> \
+operator OP(L && l, R && r){ \
+	return {l, r}; \
+}
+
+#define CSG_POINT_SCALAR_OPERATOR(OP, NAME) \
+template <class L, class S, CSG_POINT_EXPR_ENABLE(L), CSG_SCALAR_ENABLE(S)> \
+constexpr PointScalarExpr<pointop::NAME, typename PointExprStorage<L&&>::type, S> \
+operator OP(L && l, S s){ \
+	return {l, s}; \
+}
+
+#define CSG_SCALAR_POINT_OPERATOR(OP, NAME) \
+template <class S, class R, CSG_SCALAR_ENABLE(S), CSG_POINT_EXPR_ENABLE(R)> \
+constexpr ScalarPointExpr<pointop::NAME, S, typename PointExprStorage<R&&>::type> \
+operator OP(S s, R && r){ \
+	return {s, r}; \
+}
+
+// addition, subtraction, elementwise multiplication
+CSG_POINT_BINARY_OPERATOR(+, Add)
+CSG_POINT_BINARY_OPERATOR(-, Sub)
+CSG_POINT_BINARY_OPERATOR(*, Mul)
+
+// scalar addition, subtraction, multiplication, division, modulo
+CSG_POINT_SCALAR_OPERATOR(+, Add)
+CSG_POINT_SCALAR_OPERATOR(-, Sub)
+CSG_POINT_SCALAR_OPERATOR(*, Mul)
+CSG_POINT_SCALAR_OPERATOR(/, Div)
+CSG_POINT_SCALAR_OPERATOR(%, Mod)
+CSG_SCALAR_POINT_OPERATOR(*, Mul)
+
+#undef CSG_POINT_BINARY_OPERATOR
+#undef CSG_POINT_SCALAR_OPERATOR
+#undef CSG_SCALAR_POINT_OPERATOR
+#undef CSG_POINT_EXPR_ENABLE
+#undef CSG_SCALAR_ENABLE
+
+// negation
+template <class E>
+constexpr ScalarPointExpr<pointop::Mul, typename E::value_type, const E> operator-(const PointExpr<E> & e){
+	return {typename E::value_type(-1), e.self()};
+}
+
+// print an unevaluated expression
+template <class E>
+std::ostream & operator<<(std::ostream & os, const PointExpr<E> & e){
+	return os << e.eval();
+}
+
+
+
 template<std::size_t dim, class T>
 std::ostream & operator<<(std::ostream & os, const GeneralPoint<dim, T> & p){
 	os << "(" ;
@@ -175,60 +370,6 @@ std::istream & operator>>(std::istream & is, GeneralPoint<dim, T> & p){
 }
 
 
-// template<std::size_t dim, class T>
-// GeneralPoint<dim, T> operator*(T val, const GeneralPoint<dim, T> & p){
-// 	GeneralPoint<dim, T> out(p);
-// 	for (auto i=0; i<dim; i++) out.x[i] = val*p.x[i];
-// 	return out;
-// 
-
-template<std::size_t dim, class T1, class T2>
-GeneralPoint<dim, decltype(std::declval<T1>()*std::declval<T2>())> 
-operator*(T1 val, const GeneralPoint<dim, T2> & p){
-	GeneralPoint<dim, decltype(std::declval<T1>()*std::declval<T2>())> out(p);
-	for (auto i=0; i<dim; i++) out.x[i] = val*p.x[i];
-	return out;
-}
-
-template<std::size_t dim, class T1, class T2>
-GeneralPoint<dim, decltype(std::declval<T1>()%std::declval<T2>())> 
-operator%(const GeneralPoint<dim, T1> & p, T2 val){
-	GeneralPoint<dim, decltype(std::declval<T1>()%std::declval<T2>())>  out(p);
-	for (auto i=0; i<dim; i++) out.x[i] = p.x[i]%val;
-	return out;
-}
-
-template<std::size_t dim, class T1, class T2> 
-GeneralPoint<dim, decltype(std::declval<T1>()*std::declval<T2>())> 
-operator*(const GeneralPoint<dim, T1> & pd, const GeneralPoint<dim, T2> & pi){
-	GeneralPoint<dim, decltype(std::declval<T1>()*std::declval<T2>())> out;
-	for (auto i=0; i<dim; i++) out.x[i] = pd.x[i]*pi.x[i];
-	return out;
-}
-
-
-
-// specializations/overloads
-template<> GeneralPoint<2,double>::GeneralPoint(double x0, double x1){
-	x[0] = x0; x[1] = x1;
-}
-
-template<> GeneralPoint<3,double>::GeneralPoint(double x0, double x1, double x2){
-	x[0] = x0; x[1] = x1; x[2] = x2;
-}
-
-template<> GeneralPoint<1,int>::GeneralPoint(int x0){
-	x[0] = x0;
-}
-
-template<> GeneralPoint<2,int>::GeneralPoint(int x0, int x1){
-	x[0] = x0; x[1] = x1;
-}
-
-template<> GeneralPoint<3,int>::GeneralPoint(int x0, int x1, int x2){
-	x[0] = x0; x[1] = x1; x[2] = x2;
-}
-
 // // return double when double arithmetic is performed on int
 // template<std::size_t dim> 
 // GeneralPoint<dim, double> operator*(double val, const GeneralPoint<dim, int> & p){
@@ -256,6 +397,9 @@ template<> GeneralPoint<3,int>::GeneralPoint(int x0, int x1, int x2){
 template<std::size_t dim>
 using Point = GeneralPoint<dim, double>;
 
+template<std::size_t dim>
+using FloatPoint = GeneralPoint<dim, float>;
+
 template<std::size_t dim>
 using IntPoint = GeneralPoint<dim, int>;
 
@@ -264,6 +408,8 @@ using IndexPoint = GeneralPoint<dim, std::size_t>;
 
 using Point2 = Point<2>;
 using Point3 = Point<3>;
+using FloatPoint2 = FloatPoint<2>;
+using FloatPoint3 = FloatPoint<3>;
 using IntPoint2 = IntPoint<2>;
 using IntPoint3 = IntPoint<3>;
 
@@ -280,6 +426,395 @@ inline double cross(Point2 p1, Point2 p2){
 }
 
 
+
+
+// allocator that returns memory aligned to Align bytes
+// (so that SIMD loads never straddle a cache line)
+template <class T, std::size_t Align = 64>
+struct AlignedAllocator{
+	typedef T value_type;
+
+	template <class U>
+	struct rebind {typedef AlignedAllocator<U, Align> other;};
+
+	AlignedAllocator(){};
+
+	template <class U>
+	AlignedAllocator(const AlignedAllocator<U, Align> & a){};
+
+	T * allocate(std::size_t n){
+		if (n == 0) return nullptr;
+		void * p = nullptr;
+		if (posix_memalign(&p, Align, n*sizeof(T)) != 0) throw std::bad_alloc();
+		return static_cast<T *>(p);
+	}
+
+	void deallocate(T * p, std::size_t n){
+		free(p);
+	}
+
+	template <class U>
+	bool operator==(const AlignedAllocator<U, Align> & a) const {return true;};
+
+	template <class U>
+	bool operator!=(const AlignedAllocator<U, Align> & a) const {return false;};
+};
+
+
+
+// thin wrappers around the SIMD registers used by the
+// PointArray batch kernels. The generic version is the
+// scalar fallback (width 1)
+namespace simd{
+
+template <class T>
+struct Batch{
+	typedef T 		type;
+	static constexpr std::size_t width = 1;
+
+	static type load(const T * p) {return *p;};
+	static type set1(T v) {return v;};
+	static void store(T * p, type v) {*p = v;};
+	static type add(type a, type b) {return a+b;};
+	static type sub(type a, type b) {return a-b;};
+	static type mul(type a, type b) {return a*b;};
+	static type div(type a, type b) {return a/b;};
+	static type fmadd(type a, type b, type c) {return a*b+c;};
+	static type min(type a, type b) {return (b < a)? b : a;};
+	static type sqrt(type a) {return ::sqrt(a);};
+	static T hmin(type a) {return a;};
+	// bitmask of lanes where lo <= a <= hi
+	static unsigned int inside(type a, type lo, type hi) {return (lo <= a && a <= hi)? 1 : 0;};
+};
+
+#if defined(__AVX512F__)
+
+template <>
+struct Batch<double>{
+	typedef __m512d type;
+	static constexpr std::size_t width = 8;
+
+	static type load(const double * p) {return _mm512_loadu_pd(p);};
+	static type set1(double v) {return _mm512_set1_pd(v);};
+	static void store(double * p, type v) {_mm512_storeu_pd(p, v);};
+	static type add(type a, type b) {return _mm512_add_pd(a, b);};
+	static type sub(type a, type b) {return _mm512_sub_pd(a, b);};
+	static type mul(type a, type b) {return _mm512_mul_pd(a, b);};
+	static type div(type a, type b) {return _mm512_div_pd(a, b);};
+	static type fmadd(type a, type b, type c) {return _mm512_fmadd_pd(a, b, c);};
+	static type min(type a, type b) {return _mm512_min_pd(a, b);};
+	static type sqrt(type a) {return _mm512_sqrt_pd(a);};
+	static double hmin(type a) {return _mm512_reduce_min_pd(a);};
+	static unsigned int inside(type a, type lo, type hi) {
+		return _mm512_cmp_pd_mask(lo, a, _CMP_LE_OQ) & _mm512_cmp_pd_mask(a, hi, _CMP_LE_OQ);
+	}
+};
+
+template <>
+struct Batch<float>{
+	typedef __m512 type;
+	static constexpr std::size_t width = 16;
+
+	static type load(const float * p) {return _mm512_loadu_ps(p);};
+	static type set1(float v) {return _mm512_set1_ps(v);};
+	static void store(float * p, type v) {_mm512_storeu_ps(p, v);};
+	static type add(type a, type b) {return _mm512_add_ps(a, b);};
+	static type sub(type a, type b) {return _mm512_sub_ps(a, b);};
+	static type mul(type a, type b) {return _mm512_mul_ps(a, b);};
+	static type div(type a, type b) {return _mm512_div_ps(a, b);};
+	static type fmadd(type a, type b, type c) {return _mm512_fmadd_ps(a, b, c);};
+	static type min(type a, type b) {return _mm512_min_ps(a, b);};
+	static type sqrt(type a) {return _mm512_sqrt_ps(a);};
+	static float hmin(type a) {return _mm512_reduce_min_ps(a);};
+	static unsigned int inside(type a, type lo, type hi) {
+		return _mm512_cmp_ps_mask(lo, a, _CMP_LE_OQ) & _mm512_cmp_ps_mask(a, hi, _CMP_LE_OQ);
+	}
+};
+
+#elif defined(__AVX2__)
+
+template <>
+struct Batch<double>{
+	typedef __m256d type;
+	static constexpr std::size_t width = 4;
+
+	static type load(const double * p) {return _mm256_loadu_pd(p);};
+	static type set1(double v) {return _mm256_set1_pd(v);};
+	static void store(double * p, type v) {_mm256_storeu_pd(p, v);};
+	static type add(type a, type b) {return _mm256_add_pd(a, b);};
+	static type sub(type a, type b) {return _mm256_sub_pd(a, b);};
+	static type mul(type a, type b) {return _mm256_mul_pd(a, b);};
+	static type div(type a, type b) {return _mm256_div_pd(a, b);};
+#if defined(__FMA__)
+	static type fmadd(type a, type b, type c) {return _mm256_fmadd_pd(a, b, c);};
+#else
+	static type fmadd(type a, type b, type c) {return _mm256_add_pd(_mm256_mul_pd(a, b), c);};
+#endif
+	static type min(type a, type b) {return _mm256_min_pd(a, b);};
+	static type sqrt(type a) {return _mm256_sqrt_pd(a);};
+	static double hmin(type a) {
+		__m128d m = _mm_min_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+		m = _mm_min_sd(m, _mm_unpackhi_pd(m, m));
+		return _mm_cvtsd_f64(m);
+	}
+	static unsigned int inside(type a, type lo, type hi) {
+		return _mm256_movemask_pd(_mm256_and_pd(_mm256_cmp_pd(lo, a, _CMP_LE_OQ), _mm256_cmp_pd(a, hi, _CMP_LE_OQ)));
+	}
+};
+
+template <>
+struct Batch<float>{
+	typedef __m256 type;
+	static constexpr std::size_t width = 8;
+
+	static type load(const float * p) {return _mm256_loadu_ps(p);};
+	static type set1(float v) {return _mm256_set1_ps(v);};
+	static void store(float * p, type v) {_mm256_storeu_ps(p, v);};
+	static type add(type a, type b) {return _mm256_add_ps(a, b);};
+	static type sub(type a, type b) {return _mm256_sub_ps(a, b);};
+	static type mul(type a, type b) {return _mm256_mul_ps(a, b);};
+	static type div(type a, type b) {return _mm256_div_ps(a, b);};
+#if defined(__FMA__)
+	static type fmadd(type a, type b, type c) {return _mm256_fmadd_ps(a, b, c);};
+#else
+	static type fmadd(type a, type b, type c) {return _mm256_add_ps(_mm256_mul_ps(a, b), c);};
+#endif
+	static type min(type a, type b) {return _mm256_min_ps(a, b);};
+	static type sqrt(type a) {return _mm256_sqrt_ps(a);};
+	static float hmin(type a) {
+		__m128 m = _mm_min_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+		m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+		m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 1));
+		return _mm_cvtss_f32(m);
+	}
+	static unsigned int inside(type a, type lo, type hi) {
+		return _mm256_movemask_ps(_mm256_and_ps(_mm256_cmp_ps(lo, a, _CMP_LE_OQ), _mm256_cmp_ps(a, hi, _CMP_LE_OQ)));
+	}
+};
+
+#endif
+
+}
+
+
+
+// structure-of-arrays container of points.
+// each coordinate is stored in its own contiguous (aligned)
+// array, so that the batch kernels below can process
+// Batch<T>::width points per instruction
+template <std::size_t dim, class T>
+class PointArray{
+public:
+	typedef GeneralPoint<dim, T> 						PointT;
+	typedef std::vector<T, AlignedAllocator<T>> 		ColumnT;
+
+	// default constructor
+	PointArray(){};
+
+	// constructor
+	PointArray(std::size_t n){
+		resize(n);
+	}
+
+	// constructor from array-of-structs
+	PointArray(const std::vector<PointT> & pts){
+		resize(pts.size());
+		for (auto i=0; i<pts.size(); i++) set(i, pts[i]);
+	}
+
+	std::size_t size() const {return m_x[0].size();};
+
+	void resize(std::size_t n){
+		for (auto d=0; d<dim; d++) m_x[d].resize(n);
+	}
+
+	void reserve(std::size_t n){
+		for (auto d=0; d<dim; d++) m_x[d].reserve(n);
+	}
+
+	void clear(){
+		for (auto d=0; d<dim; d++) m_x[d].clear();
+	}
+
+	void push_back(const PointT & p){
+		for (auto d=0; d<dim; d++) m_x[d].push_back(p.x[d]);
+	}
+
+	// gather a single point
+	PointT operator[](std::size_t i) const {
+		PointT p;
+		for (auto d=0; d<dim; d++) p.x[d] = m_x[d][i];
+		return p;
+	}
+
+	// scatter a single point
+	void set(std::size_t i, const PointT & p){
+		for (auto d=0; d<dim; d++) m_x[d][i] = p.x[d];
+	}
+
+	// raw coordinate columns
+	T * coord(std::size_t d) {return m_x[d].data();};
+	const T * coord(std::size_t d) const {return m_x[d].data();};
+
+	// convert back to array-of-structs
+	std::vector<PointT> to_vector() const {
+		std::vector<PointT> out(size());
+		for (auto i=0; i<size(); i++) out[i] = (*this)[i];
+		return out;
+	}
+
+
+
+	// ***** batch kernels *****
+
+	// out[i] = |p_i - q|^2
+	void distsq(const PointT & q, T * out) const {
+		distsq_range(q, 0, size(), out);
+	}
+
+	// out[i] = p_i . q
+	void dot(const PointT & q, T * out) const {
+		typedef simd::Batch<T> B;
+		std::size_t n = size(), i = 0;
+		typename B::type vq[dim];
+		for (auto d=0; d<dim; d++) vq[d] = B::set1(q.x[d]);
+		for (; i+B::width <= n; i+=B::width){
+			typename B::type acc = B::set1(0);
+			for (auto d=0; d<dim; d++) acc = B::fmadd(B::load(&m_x[d][i]), vq[d], acc);
+			B::store(&out[i], acc);
+		}
+		for (; i<n; i++){
+			T acc = 0;
+			for (auto d=0; d<dim; d++) acc += m_x[d][i]*q.x[d];
+			out[i] = acc;
+		}
+	}
+
+	// out[i] = |p_i|
+	void norm(T * out) const {
+		typedef simd::Batch<T> B;
+		std::size_t n = size(), i = 0;
+		for (; i+B::width <= n; i+=B::width){
+			typename B::type acc = B::set1(0);
+			for (auto d=0; d<dim; d++){
+				typename B::type v = B::load(&m_x[d][i]);
+				acc = B::fmadd(v, v, acc);
+			}
+			B::store(&out[i], B::sqrt(acc));
+		}
+		for (; i<n; i++){
+			T acc = 0;
+			for (auto d=0; d<dim; d++) acc += m_x[d][i]*m_x[d][i];
+			out[i] = ::sqrt(acc);
+		}
+	}
+
+	// scale every point to unit length (in place)
+	void normalize(){
+		typedef simd::Batch<T> B;
+		std::size_t n = size(), i = 0;
+		for (; i+B::width <= n; i+=B::width){
+			typename B::type acc = B::set1(0);
+			for (auto d=0; d<dim; d++){
+				typename B::type v = B::load(&m_x[d][i]);
+				acc = B::fmadd(v, v, acc);
+			}
+			typename B::type inv = B::div(B::set1(1), B::sqrt(acc));
+			for (auto d=0; d<dim; d++) B::store(&m_x[d][i], B::mul(B::load(&m_x[d][i]), inv));
+		}
+		for (; i<n; i++){
+			T acc = 0;
+			for (auto d=0; d<dim; d++) acc += m_x[d][i]*m_x[d][i];
+			T inv = 1.0/::sqrt(acc);
+			for (auto d=0; d<dim; d++) m_x[d][i] *= inv;
+		}
+	}
+
+	// out[i] = 1 if lo <= p_i <= hi (component-wise), 0 otherwise.
+	// returns the number of contained points
+	std::size_t contained_in(const PointT & lo, const PointT & hi, unsigned char * out) const {
+		typedef simd::Batch<T> B;
+		std::size_t n = size(), i = 0, count = 0;
+		typename B::type vlo[dim], vhi[dim];
+		for (auto d=0; d<dim; d++){
+			vlo[d] = B::set1(lo.x[d]);
+			vhi[d] = B::set1(hi.x[d]);
+		}
+		for (; i+B::width <= n; i+=B::width){
+			unsigned int mask = ~0u;
+			for (auto d=0; d<dim; d++) mask &= B::inside(B::load(&m_x[d][i]), vlo[d], vhi[d]);
+			for (auto l=0; l<B::width; l++){
+				out[i+l] = (mask >> l) & 1;
+				count += out[i+l];
+			}
+		}
+		for (; i<n; i++){
+			bool in = true;
+			for (auto d=0; d<dim; d++) in = in && (lo.x[d] <= m_x[d][i]) && (m_x[d][i] <= hi.x[d]);
+			out[i] = in;
+			count += in;
+		}
+		return count;
+	}
+
+	// index of the point closest to q (size() if empty)
+	std::size_t argmin_distsq(const PointT & q) const {
+		typedef simd::Batch<T> B;
+		static const std::size_t chunk = 1024;
+		T buf[chunk];
+		T best = std::numeric_limits<T>::max();
+		std::size_t besti = size();
+		for (std::size_t c=0; c<size(); c+=chunk){
+			std::size_t m = std::min(chunk, size()-c);
+			distsq_range(q, c, m, buf);
+
+			// vectorized minimum of the chunk; only
+			// search for the index if it improves
+			std::size_t i = 0;
+			typename B::type vmin = B::set1(best);
+			for (; i+B::width <= m; i+=B::width) vmin = B::min(vmin, B::load(&buf[i]));
+			T cmin = B::hmin(vmin);
+			for (; i<m; i++) cmin = std::min(cmin, buf[i]);
+			if (!(cmin < best)) continue;
+			for (i=0; i<m; i++){
+				if (buf[i] == cmin){
+					besti = c+i;
+					break;
+				}
+			}
+			best = cmin;
+		}
+		return besti;
+	}
+
+private:
+
+	ColumnT 		m_x[dim];
+
+	// distsq over the subrange [start, start+n)
+	void distsq_range(const PointT & q, std::size_t start, std::size_t n, T * out) const {
+		typedef simd::Batch<T> B;
+		std::size_t i = 0;
+		typename B::type vq[dim];
+		for (auto d=0; d<dim; d++) vq[d] = B::set1(q.x[d]);
+		for (; i+B::width <= n; i+=B::width){
+			typename B::type acc = B::set1(0);
+			for (auto d=0; d<dim; d++){
+				typename B::type df = B::sub(B::load(&m_x[d][start+i]), vq[d]);
+				acc = B::fmadd(df, df, acc);
+			}
+			B::store(&out[i], acc);
+		}
+		for (; i<n; i++){
+			T acc = 0;
+			for (auto d=0; d<dim; d++) acc += (m_x[d][start+i]-q.x[d])*(m_x[d][start+i]-q.x[d]);
+			out[i] = acc;
+		}
+	}
+
+};
+
+
 }
 
 #endif
\ No newline at end of file
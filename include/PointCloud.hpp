@@ -7,6 +7,9 @@
 #include <map>
 #include <vector>
 #include <algorithm>
+#include <functional>
+#include <limits>
+#include <cstdint>
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -16,6 +19,11 @@
 
 #include <sys/mman.h>
 
+#include "GeomUtils.hpp"
+#include "AttributeStore.hpp"
+#include "MappedAllocator.hpp"
+#include "Geodesy.hpp"
+
 // this is a placeholder for the PointCloud class
 
 // it should hold the following elements (at least):
@@ -37,10 +45,81 @@
 
 // forward declaration
 struct rgb48;
+class LASFile;
+
+
+// packed keep/drop flags, one bit per point
+struct PointMask{
+  std::vector<std::uint64_t> words;
+  std::size_t size;
+
+  explicit PointMask(std::size_t n=0) : words((n+63)/64, 0), size(n) {};
+  void set(std::size_t i, bool v=true) {if (v) words[i/64] |= std::uint64_t(1) << (i%64); else words[i/64] &= ~(std::uint64_t(1) << (i%64));};
+  bool test(std::size_t i) const {return (words[i/64] >> (i%64)) & 1;};
+};
+
+
+// options for reading LAS files into a PointCloud
+struct LASReadOptions{
+  unsigned int nthreads = 0;      // decode threads (0 = all hardware threads)
+  bool quantized = false;         // keep X/Y/Z as the file's int32 values + scale/offset
+
+  // optional columns to materialize (x/y/z are always read)
+  bool intensity = true;
+  bool classification = true;
+  bool return_info = true;        // return number / number of returns byte
+  bool gpstime = true;
+  bool RGB = true;
+  bool extra_bytes = true;        // attributes described by an extra bytes VLR
+  bool mapped = false;            // keep the columns in memory-mapped scratch files
+
+  // only keep records inside the box (inclusive) and/or time range
+  bool use_box = false;
+  csg::Box<3> box;
+  bool use_time = false;
+  double time_min = 0, time_max = 0;
+
+  void set_box(const csg::Box<3> & bx) {use_box = true; box = bx;};
+  void set_time_range(double tmin, double tmax) {use_time = true; time_min = tmin; time_max = tmax;};
+};
+
+
+// options for reading and writing delimited text (x,y,z,i,c...)
+struct ASCIIOptions{
+  // one letter per column: x, y, z, i (intensity), c (classification),
+  // t (gpstime), r/g/b (color) or - (ignored). Empty reads "xyz",
+  // "xyzi" or "xyzic" by the width of the first line, and writes x,y,z
+  // plus intensity and classification when present
+  std::string columns;
+  char delimiter = ' ';           // ' ' or '\t' split on any run of blanks
+  std::size_t skip_lines = 0;     // header lines (lines that don't parse are skipped anyway)
+  int precision = 3;              // decimals written for x,y,z (gpstime gets 6)
+  unsigned int nthreads = 0;      // 0 = all hardware threads
+};
+
+
+// summary statistics of one field
+struct FieldStats{
+  double min = 0, max = 0;
+  double mean = 0, variance = 0;  // population variance
+};
+
+// summary statistics of a whole cloud, from one parallel pass over
+// its columns (see PointCloud::stats)
+struct PointCloudStats{
+  std::size_t count = 0;
+  FieldStats x, y, z;
+  FieldStats gpstime, intensity;                       // when present
+  std::vector<std::size_t> classification_histogram;  // 256 bins, when present
+  std::vector<std::size_t> intensity_histogram;       // 65536 bins, when present
+  std::size_t returns[8] = {};                         // points by return number, when present
+};
 
 
 class PointCloud{
 public:
+  // storage of one per-point field
+  template <class T> using column = std::vector<T, csg::MappedAllocator<T>>;
 
   PointCloud();                       // ctor
   PointCloud(unsigned int numpts);    // ctor
@@ -51,25 +130,43 @@ public:
     _gpstime(cloud._gpstime),
     _intensity(cloud._intensity),
     _classification(cloud._classification),
+    _return_info(cloud._return_info),
     _RGB(cloud._RGB),
-    _extradata_names(cloud._extradata_names),
-    _extradata(cloud._extradata)
-    {_xmin = cloud._xmin; _xmax = cloud._xmax;
+    _attributes(cloud._attributes),
+    _quantized(cloud._quantized),
+    _qx(cloud._qx),
+    _qy(cloud._qy),
+    _qz(cloud._qz),
+    _stats(cloud._stats),
+    _stats_valid(cloud._stats_valid)
+    {for (int d=0; d<3; d++) {_qscale[d] = cloud._qscale[d]; _qoffset[d] = cloud._qoffset[d];}
+     _xmin = cloud._xmin; _xmax = cloud._xmax;
      _ymin = cloud._ymin; _ymax = cloud._ymax;
      _zmin = cloud._zmin; _zmax = cloud._zmax;
      _gpst_min = cloud._gpst_min; _gpst_max = cloud._gpst_max;}
+  PointCloud(PointCloud && cloud) = default;   // move ctor
   ~PointCloud();                      // dtor
 
   // operators
   PointCloud & operator=(const PointCloud & cloud);
+  PointCloud & operator=(PointCloud && cloud) = default;
   PointCloud & operator+=(const PointCloud & cloud);
 
+  // append many clouds at once: storage is reserved once, the clouds'
+  // buffers are released as they are consumed, and the extents are
+  // combined from each cloud's cached extents instead of rescanned
+  void merge(std::vector<PointCloud> && clouds);
+
   // terminal output
   void print_summary() const;
   void print_detailed() const;
 
+  // statistics of every field, computed in one parallel pass on first
+  // use and cached until the cloud is modified
+  const PointCloudStats & stats(unsigned int nthreads=0) const;
+
   // metadata inspectors
-  unsigned int pointcount() const {return _x.size();};
+  unsigned int pointcount() const {return _quantized? _qx.size() : _x.size();};
   double xmax() const {return _xmax;};
   double xmin() const {return _xmin;};
   double ymax() const {return _ymax;};
@@ -79,30 +176,97 @@ public:
   bool gpstime_present() const {if (_gpstime.size()>0) return true; else return false;};
   bool intensity_present() const {if (_intensity.size()>0) return true; else return false;};
   bool classification_present() const {if (_classification.size()>0) return true; else return false;};
+  bool return_info_present() const {return _return_info.size() > 0;};
   bool RGB_present() const {if (_RGB.size()>0) return true; else return false;};
-  bool extradata_present(std::string fieldname) const {for (auto i=0; i<_extradata.size(); i++) {if (_extradata_names.at(i).compare(fieldname)==0) return true;} return false;};
+  bool extradata_present(std::string fieldname) const {return _attributes.present(fieldname);};
 
 
   // main data accessors
-  const double & x() const {return _x.front();};
-  const double & y() const {return _y.front();};
-  const double & z() const {return _z.front();};
+  // (for a quantized cloud these decode whole double columns on first use)
+  const double & x() const {if (_quantized) materialize_xyz(); return _x.front();};
+  const double & y() const {if (_quantized) materialize_xyz(); return _y.front();};
+  const double & z() const {if (_quantized) materialize_xyz(); return _z.front();};
+
+  // single points and batches [begin, end), dequantized on the fly if needed
+  double x(std::size_t i) const {return _quantized? _qx[i]*_qscale[0] + _qoffset[0] : _x[i];};
+  double y(std::size_t i) const {return _quantized? _qy[i]*_qscale[1] + _qoffset[1] : _y[i];};
+  double z(std::size_t i) const {return _quantized? _qz[i]*_qscale[2] + _qoffset[2] : _z[i];};
+  void x(std::size_t begin, std::size_t end, double * out) const {get_coords(0, begin, end, out);};
+  void y(std::size_t begin, std::size_t end, double * out) const {get_coords(1, begin, end, out);};
+  void z(std::size_t begin, std::size_t end, double * out) const {get_coords(2, begin, end, out);};
+
+  // quantized storage: coordinate = q*scale + offset, with d = 0,1,2 for x,y,z
+  bool quantized() const {return _quantized;};
+  const int & qx() const {return _qx.front();};
+  const int & qy() const {return _qy.front();};
+  const int & qz() const {return _qz.front();};
+  double scale(int d) const {return _qscale[d];};
+  double offset(int d) const {return _qoffset[d];};
+  void quantize(double scale=0.0);    // scale 0 picks the finest decimal scale that fits int32
+  void dequantize();
+
+  // file-backed storage: the columns live in memory-mapped scratch files
+  // (see csg::set_scratch_directory), so the page cache decides what
+  // stays resident; advise() passes the coming access pattern on to it
+  bool mapped() const {return _x.get_allocator().file_backed;};
+  void set_mapped(bool mapped=true);
+  void advise(csg::MappedAdvice advice) const;
 
   // optional member data accessors
   const double & gpstime() const {return _gpstime.front();};
   const unsigned short & intensity() const {return _intensity.front();};
   const unsigned char & classification() const {return _classification.front();};
+  const unsigned char & return_info() const {return _return_info.front();};    // as in LAS formats 0-5
+  unsigned int return_number(std::size_t i) const {return _return_info[i] & 0x07;};
+  unsigned int number_of_returns(std::size_t i) const {return (_return_info[i] >> 3) & 0x07;};
   const rgb48 & RGB() const {return _RGB.front();};
 
   // user-defined member data accessors
-  const double & data(std::string field) const {return _extradata.at(field).front();};
+  // (resolve a handle once, then index the column directly)
+  const AttributeStore & attributes() const {return _attributes;};
+  template <class T> AttributeHandle<T> add_attribute(const std::string & name) {_attributes.resize(pointcount()); return _attributes.add<T>(name);};
+  template <class T> AttributeHandle<T> attribute(const std::string & name) const {return _attributes.handle<T>(name);};
+  template <class T> T * attribute_data(AttributeHandle<T> h) {return _attributes.data(h);};
+  template <class T> const T * attribute_data(AttributeHandle<T> h) const {return _attributes.data(h);};
+  void remove_attribute(const std::string & name) {_attributes.remove(name);};
+  const double & data(std::string field) const {return *_attributes.data(_attributes.handle<double>(field));};
 
   // mutators
   PointCloud subset(const bool & keep);
   PointCloud subset(const unsigned int & keep_inds, const unsigned int keep_count);
-
-  static PointCloud read_LAS(std::string filename, unsigned int byte_offset=0);
-  void write_LAS(std::string filename);
+  PointCloud subset(const PointMask & mask, unsigned int nthreads=0) const;                 // survivors in cloud order
+  PointCloud subset(const std::vector<std::size_t> & indices, unsigned int nthreads=0) const; // points in list order
+  void reorder(const std::vector<std::size_t> & order);   // new point i is old point order[i]
+  void sort_morton();                                      // reorder along a Z-order curve
+  void sort_hilbert();                                     // reorder along a Hilbert curve
+
+  // coordinate conversions, in place on x,y,z (geodetic coordinates are
+  // x = longitude and y = latitude in degrees, z = ellipsoidal height).
+  // A quantized cloud is dequantized first
+  void geodetic_to_ECEF(const csg::ReferenceEllipsoid & ell=csg::ReferenceEllipsoid::WGS84(), unsigned int nthreads=0);
+  void ECEF_to_geodetic(const csg::ReferenceEllipsoid & ell=csg::ReferenceEllipsoid::WGS84(), unsigned int nthreads=0);
+  // zone 0 picks the zone and hemisphere of the cloud's center; returns
+  // the zone used, negative in the southern hemisphere
+  int geodetic_to_UTM(int zone=0, bool north=true, const csg::ReferenceEllipsoid & ell=csg::ReferenceEllipsoid::WGS84(), unsigned int nthreads=0);
+  void UTM_to_geodetic(int zone, bool north=true, const csg::ReferenceEllipsoid & ell=csg::ReferenceEllipsoid::WGS84(), unsigned int nthreads=0);
+
+  // nthreads=0 decodes on all hardware threads
+  static PointCloud read_LAS(std::string filename, unsigned int byte_offset=0, unsigned int nthreads=0);
+  static PointCloud read_LAS(const LASFile & las, unsigned int nthreads=0);
+  static PointCloud read_LAS(std::string filename, const LASReadOptions & opts, unsigned int byte_offset=0);
+  static PointCloud read_LAS(const LASFile & las, const LASReadOptions & opts);
+  void load_LAS(const LASFile & las, std::size_t begin, std::size_t end, unsigned int nthreads=1);   // records [begin, end), reusing storage
+  void load_LAS(const LASFile & las, std::size_t begin, std::size_t end, const LASReadOptions & opts);
+  static void stream_LAS(std::string filename,
+                         std::function<void(PointCloud & chunk, std::size_t first)> fn,
+                         std::size_t chunk_size=1<<20,
+                         const LASReadOptions & opts=LASReadOptions());
+  // point_format -1 picks the smallest of formats 0-3 holding the present fields
+  void write_LAS(std::string filename, int point_format=-1, unsigned char ver_minor=2, unsigned int nthreads=0);
+
+  // delimited text, one point per line
+  static PointCloud read_ASCII(std::string filename, const ASCIIOptions & opts=ASCIIOptions());
+  void write_ASCII(std::string filename, const ASCIIOptions & opts=ASCIIOptions()) const;
 
 
 protected:
@@ -112,29 +276,49 @@ private:
   double _xmin, _xmax, _ymin, _ymax, _zmin, _zmax, _gpst_min, _gpst_max;
   unsigned int _pointcount;
 
-  // required data
-  std::vector<double> _x, _y, _z;
+  // required data (a cache of the quantized coordinates when _quantized)
+  mutable column<double> _x, _y, _z;
 
   // optional data
-  std::vector<double> _gpstime;
-  std::vector<unsigned short> _intensity;
-  std::vector<unsigned char> _classification;
-  std::vector<rgb48> _RGB;
+  column<double> _gpstime;
+  column<unsigned short> _intensity;
+  column<unsigned char> _classification;
+  column<unsigned char> _return_info;
+  column<rgb48> _RGB;
 
   // user-defined data
-  std::vector<std::string> _extradata_names;
-  std::map<std::string, std::vector<double>> _extradata;
+  AttributeStore _attributes;
+
+  // quantized coordinates
+  bool _quantized;
+  column<int> _qx, _qy, _qz;
+  double _qscale[3], _qoffset[3];
+
+  // cached statistics
+  mutable PointCloudStats _stats;
+  mutable bool _stats_valid = false;
 
   // initializing optional data fields
   void add_intensity();
   void add_classification();
+  void add_return_info();
   void add_gpstime();
   void add_RGB();  
   void add_extradata(std::string fieldname);
 
   void calc_extents();  
-
-  void read_LAS_internal(std::string filename, unsigned int byte_offset=0);
+  void merge_extents(const PointCloud & cloud);
+  void drop_missing_fields(const PointCloud & cloud, const char * op);
+  void append_points(const PointCloud & cloud);
+  PointCloud empty_like(std::size_t n) const;
+  void gather_into(PointCloud & dst, const std::size_t * idx, std::size_t m, std::size_t o) const;
+  void materialize_xyz() const;
+  void get_coords(int d, std::size_t begin, std::size_t end, double * out) const;
+  void transform_xyz(unsigned int nthreads, std::function<void(std::size_t n, double * x, double * y, double * z)> fn);
+
+  void read_LAS_internal(std::string filename, unsigned int byte_offset=0, unsigned int nthreads=0);
+  void read_LAS_internal(const LASFile & las, const LASReadOptions & opts);
+  void decode_LAS(const LASFile & las, std::size_t begin, std::size_t end, const LASReadOptions & opts);
 
 };
 
@@ -0,0 +1,577 @@
+#ifndef _PREDICATES_H
+#define _PREDICATES_H
+
+#include <cmath>
+#include <cstddef>
+
+#include "Point.hpp"
+
+// Robust geometric predicates after J.R. Shewchuk,
+// "Adaptive Precision Floating-Point Arithmetic and Fast Robust
+// Geometric Predicates" (1997).
+//
+// Each predicate first evaluates the determinant in plain floating
+// point together with a forward error bound. Only if the result is
+// too close to zero to trust is it recomputed with floating-point
+// expansions: first exactly from the rounded coordinate differences,
+// which is enough unless those differences were themselves rounded,
+// and only then from the exact differences. All expansions live in
+// fixed-size arrays on the stack. The sign of the result is always
+// correct; the magnitude is an approximation of the determinant.
+//
+// NOTE: this relies on IEEE round-to-nearest double arithmetic;
+//       do not compile it with -ffast-math or x87 extended precision
+//
+//  orient2d(a,b,c)       > 0 if a,b,c are counterclockwise
+//  orient3d(a,b,c,d)     > 0 if d lies below the plane through a,b,c
+//                          (a,b,c appear counterclockwise from above)
+//  incircle(a,b,c,d)     > 0 if d lies inside the circle through the
+//                          counterclockwise points a,b,c
+//  insphere(a,b,c,d,e)   > 0 if e lies inside the sphere through a,b,c,d
+//                          (with orient3d(a,b,c,d) > 0)
+
+namespace csg{
+
+namespace predicates{
+
+	// half an ulp of 1.0, and the error bounds derived from it
+	constexpr double epsilon = 1.1102230246251565e-16;
+	constexpr double ccwerrboundA = (3.0 + 16.0*epsilon)*epsilon;
+	constexpr double o3derrboundA = (7.0 + 56.0*epsilon)*epsilon;
+	constexpr double iccerrboundA = (10.0 + 96.0*epsilon)*epsilon;
+	constexpr double isperrboundA = (16.0 + 224.0*epsilon)*epsilon;
+	constexpr double ccwerrboundB = (2.0 + 12.0*epsilon)*epsilon;
+	constexpr double o3derrboundB = (3.0 + 28.0*epsilon)*epsilon;
+	constexpr double iccerrboundB = (4.0 + 48.0*epsilon)*epsilon;
+	constexpr double isperrboundB = (5.0 + 72.0*epsilon)*epsilon;
+
+
+
+	// ***** error-free transformations *****
+
+	// x + y == a + b exactly, requires |a| >= |b|
+	inline void fast_two_sum(double a, double b, double & x, double & y){
+		x = a + b;
+		double bvirt = x - a;
+		y = b - bvirt;
+	}
+
+	// x + y == a + b exactly
+	inline void two_sum(double a, double b, double & x, double & y){
+		x = a + b;
+		double bvirt = x - a;
+		double avirt = x - bvirt;
+		double bround = b - bvirt;
+		double around = a - avirt;
+		y = around + bround;
+	}
+
+	// x + y == a * b exactly
+	inline void two_product(double a, double b, double & x, double & y){
+		x = a * b;
+		y = std::fma(a, b, -x);
+	}
+
+
+
+	// the rounding error of x = a - b, so that x + y == a - b exactly
+	inline double two_diff_tail(double a, double b, double x){
+		double bvirt = a - x;
+		double avirt = x + bvirt;
+		double bround = bvirt - b;
+		double around = a - avirt;
+		return around + bround;
+	}
+
+	// h = e + f (Shewchuk's fast_expansion_sum_zeroelim); returns the
+	// length of h, which has room for elen + flen components
+	inline std::size_t expansion_sum(std::size_t elen, const double * e, std::size_t flen, const double * f, double * h){
+		std::size_t ei = 0, fi = 0, hn = 0;
+		double Q, Qnew, hh;
+		double enow = e[0], fnow = f[0];
+		if ((fnow > enow) == (fnow > -enow)){
+			Q = enow;
+			if (++ei < elen) enow = e[ei];
+		}
+		else {
+			Q = fnow;
+			if (++fi < flen) fnow = f[fi];
+		}
+		if (ei < elen && fi < flen){
+			if ((fnow > enow) == (fnow > -enow)){
+				fast_two_sum(enow, Q, Qnew, hh);
+				if (++ei < elen) enow = e[ei];
+			}
+			else {
+				fast_two_sum(fnow, Q, Qnew, hh);
+				if (++fi < flen) fnow = f[fi];
+			}
+			Q = Qnew;
+			if (hh != 0.0) h[hn++] = hh;
+			while (ei < elen && fi < flen){
+				if ((fnow > enow) == (fnow > -enow)){
+					two_sum(Q, enow, Qnew, hh);
+					if (++ei < elen) enow = e[ei];
+				}
+				else {
+					two_sum(Q, fnow, Qnew, hh);
+					if (++fi < flen) fnow = f[fi];
+				}
+				Q = Qnew;
+				if (hh != 0.0) h[hn++] = hh;
+			}
+		}
+		while (ei < elen){
+			two_sum(Q, enow, Qnew, hh);
+			if (++ei < elen) enow = e[ei];
+			Q = Qnew;
+			if (hh != 0.0) h[hn++] = hh;
+		}
+		while (fi < flen){
+			two_sum(Q, fnow, Qnew, hh);
+			if (++fi < flen) fnow = f[fi];
+			Q = Qnew;
+			if (hh != 0.0) h[hn++] = hh;
+		}
+		if (Q != 0.0 || hn == 0) h[hn++] = Q;
+		return hn;
+	}
+
+	// h = e * b (Shewchuk's scale_expansion_zeroelim); returns the length
+	// of h, which has room for 2*elen components
+	inline std::size_t expansion_scale(std::size_t elen, const double * e, double b, double * h){
+		std::size_t hn = 0;
+		double Q, hh, product1, product0, sum;
+		two_product(e[0], b, Q, hh);
+		if (hh != 0.0) h[hn++] = hh;
+		for (std::size_t i=1; i<elen; i++){
+			two_product(e[i], b, product1, product0);
+			two_sum(Q, product0, sum, hh);
+			if (hh != 0.0) h[hn++] = hh;
+			fast_two_sum(product1, sum, Q, hh);
+			if (hh != 0.0) h[hn++] = hh;
+		}
+		if (Q != 0.0 || hn == 0) h[hn++] = Q;
+		return hn;
+	}
+
+	// a nonoverlapping expansion: the exact value is the sum of the
+	// components c[0, n), which are stored in increasing magnitude.
+	// The capacity N is fixed at compile time and every operation
+	// returns an expansion with room for its worst case (Shewchuk's
+	// bounds), so the exact arithmetic never touches the heap
+	template <std::size_t N>
+	struct Expansion{
+		std::size_t 	n;
+		double 			c[N];
+
+		Expansion() : n(1) {c[0] = 0.0;};
+		Expansion(double a) : n(1) {c[0] = a;};
+
+		// approximation of the value (has the correct sign)
+		double estimate() const {
+			double s = 0.0;
+			for (std::size_t i=0; i<n; i++) s += c[i];
+			return s;
+		}
+
+		Expansion operator-() const {
+			Expansion out;
+			out.n = n;
+			for (std::size_t i=0; i<n; i++) out.c[i] = -c[i];
+			return out;
+		}
+
+		template <std::size_t M>
+		Expansion<N+M> operator+(const Expansion<M> & f) const {
+			Expansion<N+M> out;
+			out.n = expansion_sum(n, c, f.n, f.c, out.c);
+			return out;
+		}
+
+		template <std::size_t M>
+		Expansion<N+M> operator-(const Expansion<M> & f) const {
+			return *this + (-f);
+		}
+
+		// exact product with a double
+		Expansion<2*N> operator*(double b) const {
+			Expansion<2*N> out;
+			out.n = expansion_scale(n, c, b, out.c);
+			return out;
+		}
+
+		// exact product of two expansions: f scaled by each component
+		// of this one, summed
+		template <std::size_t M>
+		Expansion<2*N*M> operator*(const Expansion<M> & f) const {
+			Expansion<2*N*M> out, acc;
+			double part[2*M];
+			out.n = expansion_scale(f.n, f.c, c[0], out.c);
+			for (std::size_t i=1; i<n; i++){
+				std::size_t pn = expansion_scale(f.n, f.c, c[i], part);
+				acc.n = expansion_sum(out.n, out.c, pn, part, acc.c);
+				out.n = acc.n;
+				for (std::size_t j=0; j<acc.n; j++) out.c[j] = acc.c[j];
+			}
+			return out;
+		}
+	};
+
+	// exact a - b
+	inline Expansion<2> diff(double a, double b){
+		Expansion<2> out;
+		double x, y;
+		two_sum(a, -b, x, y);
+		out.n = 0;
+		if (y != 0.0) out.c[out.n++] = y;
+		if (x != 0.0 || out.n == 0) out.c[out.n++] = x;
+		return out;
+	}
+
+	// exact a*b - c*d
+	inline Expansion<4> two_two_diff(double a, double b, double c, double d){
+		return Expansion<1>(a)*b - Expansion<1>(c)*d;
+	}
+
+	// exact e*(x^2 + y^2) and e*(x^2 + y^2 + z^2)
+	template <std::size_t N>
+	Expansion<8*N> lift(const Expansion<N> & e, double x, double y){
+		return e*x*x + e*y*y;
+	}
+
+	template <std::size_t N>
+	Expansion<12*N> lift(const Expansion<N> & e, double x, double y, double z){
+		return e*x*x + e*y*y + e*z*z;
+	}
+
+
+
+	// ***** exact fallbacks *****
+
+	inline double orient2d_exact(const double * pa, const double * pb, const double * pc){
+		Expansion<2> acx = diff(pa[0], pc[0]), acy = diff(pa[1], pc[1]);
+		Expansion<2> bcx = diff(pb[0], pc[0]), bcy = diff(pb[1], pc[1]);
+		return (acx*bcy - acy*bcx).estimate();
+	}
+
+	inline double orient3d_exact(const double * pa, const double * pb, const double * pc, const double * pd){
+		Expansion<2> adx = diff(pa[0], pd[0]), ady = diff(pa[1], pd[1]), adz = diff(pa[2], pd[2]);
+		Expansion<2> bdx = diff(pb[0], pd[0]), bdy = diff(pb[1], pd[1]), bdz = diff(pb[2], pd[2]);
+		Expansion<2> cdx = diff(pc[0], pd[0]), cdy = diff(pc[1], pd[1]), cdz = diff(pc[2], pd[2]);
+		Expansion<192> det = adz*(bdx*cdy - cdx*bdy)
+						   + bdz*(cdx*ady - adx*cdy)
+						   + cdz*(adx*bdy - bdx*ady);
+		return det.estimate();
+	}
+
+	inline double incircle_exact(const double * pa, const double * pb, const double * pc, const double * pd){
+		Expansion<2> adx = diff(pa[0], pd[0]), ady = diff(pa[1], pd[1]);
+		Expansion<2> bdx = diff(pb[0], pd[0]), bdy = diff(pb[1], pd[1]);
+		Expansion<2> cdx = diff(pc[0], pd[0]), cdy = diff(pc[1], pd[1]);
+		Expansion<16> alift = adx*adx + ady*ady;
+		Expansion<16> blift = bdx*bdx + bdy*bdy;
+		Expansion<16> clift = cdx*cdx + cdy*cdy;
+		Expansion<1536> det = alift*(bdx*cdy - cdx*bdy)
+							+ blift*(cdx*ady - adx*cdy)
+							+ clift*(adx*bdy - bdx*ady);
+		return det.estimate();
+	}
+
+	// on the differences, the exact insphere determinant would need
+	// expansions far longer than the 5x5 lifted determinant of the raw
+	// coordinates (Shewchuk's insphereexact), which is used instead
+	inline double insphere_exact(const double * pa, const double * pb, const double * pc, const double * pd, const double * pe){
+		// 2x2 minors in x and y
+		Expansion<4> ab = two_two_diff(pa[0], pb[1], pb[0], pa[1]);
+		Expansion<4> bc = two_two_diff(pb[0], pc[1], pc[0], pb[1]);
+		Expansion<4> cd = two_two_diff(pc[0], pd[1], pd[0], pc[1]);
+		Expansion<4> de = two_two_diff(pd[0], pe[1], pe[0], pd[1]);
+		Expansion<4> ea = two_two_diff(pe[0], pa[1], pa[0], pe[1]);
+		Expansion<4> ac = two_two_diff(pa[0], pc[1], pc[0], pa[1]);
+		Expansion<4> bd = two_two_diff(pb[0], pd[1], pd[0], pb[1]);
+		Expansion<4> ce = two_two_diff(pc[0], pe[1], pe[0], pc[1]);
+		Expansion<4> da = two_two_diff(pd[0], pa[1], pa[0], pd[1]);
+		Expansion<4> eb = two_two_diff(pe[0], pb[1], pb[0], pe[1]);
+
+		// 3x3 minors in x, y and z
+		Expansion<24> abc = bc*pa[2] - ac*pb[2] + ab*pc[2];
+		Expansion<24> bcd = cd*pb[2] - bd*pc[2] + bc*pd[2];
+		Expansion<24> cde = de*pc[2] - ce*pd[2] + cd*pe[2];
+		Expansion<24> dea = ea*pd[2] - da*pe[2] + de*pa[2];
+		Expansion<24> eab = ab*pe[2] - eb*pa[2] + ea*pb[2];
+		Expansion<24> abd = bd*pa[2] + da*pb[2] + ab*pd[2];
+		Expansion<24> bce = ce*pb[2] + eb*pc[2] + bc*pe[2];
+		Expansion<24> cda = da*pc[2] + ac*pd[2] + cd*pa[2];
+		Expansion<24> deb = eb*pd[2] + bd*pe[2] + de*pb[2];
+		Expansion<24> eac = ac*pe[2] + ce*pa[2] + ea*pc[2];
+
+		// 4x4 minors, with the column of ones
+		Expansion<96> bcde = (cde + bce) - (deb + bcd);
+		Expansion<96> cdea = (dea + cda) - (eac + cde);
+		Expansion<96> deab = (eab + deb) - (abd + dea);
+		Expansion<96> eabc = (abc + eac) - (bce + eab);
+		Expansion<96> abcd = (bcd + abd) - (cda + abc);
+
+		Expansion<1152> adet = lift(bcde, pa[0], pa[1], pa[2]);
+		Expansion<1152> bdet = lift(cdea, pb[0], pb[1], pb[2]);
+		Expansion<1152> cdet = lift(deab, pc[0], pc[1], pc[2]);
+		Expansion<1152> ddet = lift(eabc, pd[0], pd[1], pd[2]);
+		Expansion<1152> edet = lift(abcd, pe[0], pe[1], pe[2]);
+		Expansion<5760> det = (adet + bdet) + ((cdet + ddet) + edet);
+		return det.estimate();
+	}
+
+
+
+	// ***** second stage *****
+	// the determinant of the rounded differences, computed exactly.
+	// This settles the sign whenever it clears the smaller error bound
+	// B, and it is the exact determinant whenever the differences were
+	// not rounded at all, as with gridded or integer coordinates; only
+	// otherwise is the full exact determinant needed
+
+	inline double orient2d_adapt(const double * pa, const double * pb, const double * pc, double detsum){
+		double acx = pa[0] - pc[0], bcx = pb[0] - pc[0];
+		double acy = pa[1] - pc[1], bcy = pb[1] - pc[1];
+
+		double det = two_two_diff(acx, bcy, acy, bcx).estimate();
+		double errbound = ccwerrboundB * detsum;
+		if (det >= errbound || -det >= errbound) return det;
+
+		if (two_diff_tail(pa[0], pc[0], acx) == 0.0 && two_diff_tail(pb[0], pc[0], bcx) == 0.0
+		 && two_diff_tail(pa[1], pc[1], acy) == 0.0 && two_diff_tail(pb[1], pc[1], bcy) == 0.0) return det;
+		return orient2d_exact(pa, pb, pc);
+	}
+
+	inline double orient3d_adapt(const double * pa, const double * pb, const double * pc, const double * pd, double permanent){
+		double adx = pa[0] - pd[0], bdx = pb[0] - pd[0], cdx = pc[0] - pd[0];
+		double ady = pa[1] - pd[1], bdy = pb[1] - pd[1], cdy = pc[1] - pd[1];
+		double adz = pa[2] - pd[2], bdz = pb[2] - pd[2], cdz = pc[2] - pd[2];
+
+		Expansion<4> bc = two_two_diff(bdx, cdy, cdx, bdy);
+		Expansion<4> ca = two_two_diff(cdx, ady, adx, cdy);
+		Expansion<4> ab = two_two_diff(adx, bdy, bdx, ady);
+		double det = (bc*adz + ca*bdz + ab*cdz).estimate();
+		double errbound = o3derrboundB * permanent;
+		if (det >= errbound || -det >= errbound) return det;
+
+		if (two_diff_tail(pa[0], pd[0], adx) == 0.0 && two_diff_tail(pb[0], pd[0], bdx) == 0.0
+		 && two_diff_tail(pc[0], pd[0], cdx) == 0.0 && two_diff_tail(pa[1], pd[1], ady) == 0.0
+		 && two_diff_tail(pb[1], pd[1], bdy) == 0.0 && two_diff_tail(pc[1], pd[1], cdy) == 0.0
+		 && two_diff_tail(pa[2], pd[2], adz) == 0.0 && two_diff_tail(pb[2], pd[2], bdz) == 0.0
+		 && two_diff_tail(pc[2], pd[2], cdz) == 0.0) return det;
+		return orient3d_exact(pa, pb, pc, pd);
+	}
+
+	inline double incircle_adapt(const double * pa, const double * pb, const double * pc, const double * pd, double permanent){
+		double adx = pa[0] - pd[0], bdx = pb[0] - pd[0], cdx = pc[0] - pd[0];
+		double ady = pa[1] - pd[1], bdy = pb[1] - pd[1], cdy = pc[1] - pd[1];
+
+		Expansion<4> bc = two_two_diff(bdx, cdy, cdx, bdy);
+		Expansion<4> ca = two_two_diff(cdx, ady, adx, cdy);
+		Expansion<4> ab = two_two_diff(adx, bdy, bdx, ady);
+		double det = (lift(bc, adx, ady) + lift(ca, bdx, bdy) + lift(ab, cdx, cdy)).estimate();
+		double errbound = iccerrboundB * permanent;
+		if (det >= errbound || -det >= errbound) return det;
+
+		if (two_diff_tail(pa[0], pd[0], adx) == 0.0 && two_diff_tail(pb[0], pd[0], bdx) == 0.0
+		 && two_diff_tail(pc[0], pd[0], cdx) == 0.0 && two_diff_tail(pa[1], pd[1], ady) == 0.0
+		 && two_diff_tail(pb[1], pd[1], bdy) == 0.0 && two_diff_tail(pc[1], pd[1], cdy) == 0.0) return det;
+		return incircle_exact(pa, pb, pc, pd);
+	}
+
+	inline double insphere_adapt(const double * pa, const double * pb, const double * pc, const double * pd, const double * pe, double permanent){
+		double aex = pa[0] - pe[0], bex = pb[0] - pe[0], cex = pc[0] - pe[0], dex = pd[0] - pe[0];
+		double aey = pa[1] - pe[1], bey = pb[1] - pe[1], cey = pc[1] - pe[1], dey = pd[1] - pe[1];
+		double aez = pa[2] - pe[2], bez = pb[2] - pe[2], cez = pc[2] - pe[2], dez = pd[2] - pe[2];
+
+		Expansion<4> ab = two_two_diff(aex, bey, bex, aey);
+		Expansion<4> bc = two_two_diff(bex, cey, cex, bey);
+		Expansion<4> cd = two_two_diff(cex, dey, dex, cey);
+		Expansion<4> da = two_two_diff(dex, aey, aex, dey);
+		Expansion<4> ac = two_two_diff(aex, cey, cex, aey);
+		Expansion<4> bd = two_two_diff(bex, dey, dex, bey);
+
+		Expansion<24> abc = bc*aez - ac*bez + ab*cez;
+		Expansion<24> bcd = cd*bez - bd*cez + bc*dez;
+		Expansion<24> cda = da*cez + ac*dez + cd*aez;
+		Expansion<24> dab = ab*dez + bd*aez + da*bez;
+
+		Expansion<1152> fin = (lift(abc, dex, dey, dez) - lift(dab, cex, cey, cez))
+							+ (lift(cda, bex, bey, bez) - lift(bcd, aex, aey, aez));
+		double det = fin.estimate();
+		double errbound = isperrboundB * permanent;
+		if (det >= errbound || -det >= errbound) return det;
+
+		if (two_diff_tail(pa[0], pe[0], aex) == 0.0 && two_diff_tail(pb[0], pe[0], bex) == 0.0
+		 && two_diff_tail(pc[0], pe[0], cex) == 0.0 && two_diff_tail(pd[0], pe[0], dex) == 0.0
+		 && two_diff_tail(pa[1], pe[1], aey) == 0.0 && two_diff_tail(pb[1], pe[1], bey) == 0.0
+		 && two_diff_tail(pc[1], pe[1], cey) == 0.0 && two_diff_tail(pd[1], pe[1], dey) == 0.0
+		 && two_diff_tail(pa[2], pe[2], aez) == 0.0 && two_diff_tail(pb[2], pe[2], bez) == 0.0
+		 && two_diff_tail(pc[2], pe[2], cez) == 0.0 && two_diff_tail(pd[2], pe[2], dez) == 0.0) return det;
+		return insphere_exact(pa, pb, pc, pd, pe);
+	}
+
+
+
+	// ***** filtered predicates on raw coordinates *****
+
+	inline double orient2d(const double * pa, const double * pb, const double * pc){
+		double detleft = (pa[0] - pc[0]) * (pb[1] - pc[1]);
+		double detright = (pa[1] - pc[1]) * (pb[0] - pc[0]);
+		double det = detleft - detright;
+		double detsum;
+
+		if (detleft > 0.0){
+			if (detright <= 0.0) return det;
+			detsum = detleft + detright;
+		}
+		else if (detleft < 0.0){
+			if (detright >= 0.0) return det;
+			detsum = -detleft - detright;
+		}
+		else return det;
+
+		double errbound = ccwerrboundA * detsum;
+		if (det >= errbound || -det >= errbound) return det;
+		return orient2d_adapt(pa, pb, pc, detsum);
+	}
+
+	inline double orient3d(const double * pa, const double * pb, const double * pc, const double * pd){
+		double adx = pa[0] - pd[0], bdx = pb[0] - pd[0], cdx = pc[0] - pd[0];
+		double ady = pa[1] - pd[1], bdy = pb[1] - pd[1], cdy = pc[1] - pd[1];
+		double adz = pa[2] - pd[2], bdz = pb[2] - pd[2], cdz = pc[2] - pd[2];
+
+		double bdxcdy = bdx * cdy, cdxbdy = cdx * bdy;
+		double cdxady = cdx * ady, adxcdy = adx * cdy;
+		double adxbdy = adx * bdy, bdxady = bdx * ady;
+
+		double det = adz * (bdxcdy - cdxbdy)
+				   + bdz * (cdxady - adxcdy)
+				   + cdz * (adxbdy - bdxady);
+
+		double permanent = (std::fabs(bdxcdy) + std::fabs(cdxbdy)) * std::fabs(adz)
+						 + (std::fabs(cdxady) + std::fabs(adxcdy)) * std::fabs(bdz)
+						 + (std::fabs(adxbdy) + std::fabs(bdxady)) * std::fabs(cdz);
+		double errbound = o3derrboundA * permanent;
+		if (det > errbound || -det > errbound) return det;
+		return orient3d_adapt(pa, pb, pc, pd, permanent);
+	}
+
+	inline double incircle(const double * pa, const double * pb, const double * pc, const double * pd){
+		double adx = pa[0] - pd[0], bdx = pb[0] - pd[0], cdx = pc[0] - pd[0];
+		double ady = pa[1] - pd[1], bdy = pb[1] - pd[1], cdy = pc[1] - pd[1];
+
+		double bdxcdy = bdx * cdy, cdxbdy = cdx * bdy;
+		double alift = adx * adx + ady * ady;
+
+		double cdxady = cdx * ady, adxcdy = adx * cdy;
+		double blift = bdx * bdx + bdy * bdy;
+
+		double adxbdy = adx * bdy, bdxady = bdx * ady;
+		double clift = cdx * cdx + cdy * cdy;
+
+		double det = alift * (bdxcdy - cdxbdy)
+				   + blift * (cdxady - adxcdy)
+				   + clift * (adxbdy - bdxady);
+
+		double permanent = (std::fabs(bdxcdy) + std::fabs(cdxbdy)) * alift
+						 + (std::fabs(cdxady) + std::fabs(adxcdy)) * blift
+						 + (std::fabs(adxbdy) + std::fabs(bdxady)) * clift;
+		double errbound = iccerrboundA * permanent;
+		if (det > errbound || -det > errbound) return det;
+		return incircle_adapt(pa, pb, pc, pd, permanent);
+	}
+
+	inline double insphere(const double * pa, const double * pb, const double * pc, const double * pd, const double * pe){
+		double aex = pa[0] - pe[0], bex = pb[0] - pe[0], cex = pc[0] - pe[0], dex = pd[0] - pe[0];
+		double aey = pa[1] - pe[1], bey = pb[1] - pe[1], cey = pc[1] - pe[1], dey = pd[1] - pe[1];
+		double aez = pa[2] - pe[2], bez = pb[2] - pe[2], cez = pc[2] - pe[2], dez = pd[2] - pe[2];
+
+		double aexbey = aex * bey, bexaey = bex * aey;
+		double bexcey = bex * cey, cexbey = cex * bey;
+		double cexdey = cex * dey, dexcey = dex * cey;
+		double dexaey = dex * aey, aexdey = aex * dey;
+		double aexcey = aex * cey, cexaey = cex * aey;
+		double bexdey = bex * dey, dexbey = dex * bey;
+
+		double ab = aexbey - bexaey;
+		double bc = bexcey - cexbey;
+		double cd = cexdey - dexcey;
+		double da = dexaey - aexdey;
+		double ac = aexcey - cexaey;
+		double bd = bexdey - dexbey;
+
+		double abc = aez * bc - bez * ac + cez * ab;
+		double bcd = bez * cd - cez * bd + dez * bc;
+		double cda = cez * da + dez * ac + aez * cd;
+		double dab = dez * ab + aez * bd + bez * da;
+
+		double alift = aex * aex + aey * aey + aez * aez;
+		double blift = bex * bex + bey * bey + bez * bez;
+		double clift = cex * cex + cey * cey + cez * cez;
+		double dlift = dex * dex + dey * dey + dez * dez;
+
+		double det = (dlift * abc - clift * dab) + (blift * cda - alift * bcd);
+
+		double aezplus = std::fabs(aez), bezplus = std::fabs(bez);
+		double cezplus = std::fabs(cez), dezplus = std::fabs(dez);
+		double aexbeyplus = std::fabs(aexbey), bexaeyplus = std::fabs(bexaey);
+		double bexceyplus = std::fabs(bexcey), cexbeyplus = std::fabs(cexbey);
+		double cexdeyplus = std::fabs(cexdey), dexceyplus = std::fabs(dexcey);
+		double dexaeyplus = std::fabs(dexaey), aexdeyplus = std::fabs(aexdey);
+		double aexceyplus = std::fabs(aexcey), cexaeyplus = std::fabs(cexaey);
+		double bexdeyplus = std::fabs(bexdey), dexbeyplus = std::fabs(dexbey);
+
+		double permanent = ((cexdeyplus + dexceyplus) * bezplus
+						  + (dexbeyplus + bexdeyplus) * cezplus
+						  + (bexceyplus + cexbeyplus) * dezplus) * alift
+						 + ((dexaeyplus + aexdeyplus) * cezplus
+						  + (aexceyplus + cexaeyplus) * dezplus
+						  + (cexdeyplus + dexceyplus) * aezplus) * blift
+						 + ((aexbeyplus + bexaeyplus) * dezplus
+						  + (bexdeyplus + dexbeyplus) * aezplus
+						  + (dexaeyplus + aexdeyplus) * bezplus) * clift
+						 + ((bexceyplus + cexbeyplus) * aezplus
+						  + (cexaeyplus + aexceyplus) * bezplus
+						  + (aexbeyplus + bexaeyplus) * cezplus) * dlift;
+		double errbound = isperrboundA * permanent;
+		if (det > errbound || -det > errbound) return det;
+		return insphere_adapt(pa, pb, pc, pd, pe, permanent);
+	}
+
+}
+
+
+
+// ***** point interface *****
+// points of any storage type are widened (exactly) to double
+
+template <class T>
+double orient2d(const GeneralPoint<2, T> & a, const GeneralPoint<2, T> & b, const GeneralPoint<2, T> & c){
+	const Point<2> pa(a), pb(b), pc(c);
+	return predicates::orient2d(pa.x, pb.x, pc.x);
+}
+
+template <class T>
+double orient3d(const GeneralPoint<3, T> & a, const GeneralPoint<3, T> & b, const GeneralPoint<3, T> & c, const GeneralPoint<3, T> & d){
+	const Point<3> pa(a), pb(b), pc(c), pd(d);
+	return predicates::orient3d(pa.x, pb.x, pc.x, pd.x);
+}
+
+template <class T>
+double incircle(const GeneralPoint<2, T> & a, const GeneralPoint<2, T> & b, const GeneralPoint<2, T> & c, const GeneralPoint<2, T> & d){
+	const Point<2> pa(a), pb(b), pc(c), pd(d);
+	return predicates::incircle(pa.x, pb.x, pc.x, pd.x);
+}
+
+template <class T>
+double insphere(const GeneralPoint<3, T> & a, const GeneralPoint<3, T> & b, const GeneralPoint<3, T> & c, const GeneralPoint<3, T> & d, const GeneralPoint<3, T> & e){
+	const Point<3> pa(a), pb(b), pc(c), pd(d), pe(e);
+	return predicates::insphere(pa.x, pb.x, pc.x, pd.x, pe.x);
+}
+
+}
+
+#endif
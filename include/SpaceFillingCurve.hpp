@@ -0,0 +1,394 @@
+#ifndef _SPACEFILLINGCURVE_H
+#define _SPACEFILLINGCURVE_H
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+#include "GeomUtils.hpp"
+
+// Morton (Z-order) and Hilbert space-filling-curve keys for
+// points in 2D and 3D, with 32- or 64-bit keys.
+//
+// A key type of KeyT holds (8*sizeof(KeyT))/dim bits per dimension:
+//      uint32_t:  2D -> 16 bits/dim,  3D -> 10 bits/dim
+//      uint64_t:  2D -> 32 bits/dim,  3D -> 21 bits/dim
+//
+// Points are first quantized onto the 2^bits grid covering a Box,
+// then interleaved. Bit interleaving uses BMI2 pdep/pext when the
+// compiler targets it, and the usual magic-number bit tricks otherwise.
+
+namespace csg{
+
+enum CurveType {MORTON, HILBERT};
+
+namespace sfc{
+
+	// number of bits per dimension that fit in the key
+	template <std::size_t dim, class KeyT>
+	struct CurveBits{
+		static_assert(dim == 2 || dim == 3, "ERROR: space-filling curves are only implemented for dim 2 and 3");
+		static_assert(std::is_same<KeyT, std::uint32_t>::value || std::is_same<KeyT, std::uint64_t>::value, "ERROR: space-filling curve keys must be uint32_t or uint64_t");
+		static constexpr unsigned int value = (8*sizeof(KeyT))/dim;
+	};
+
+
+
+	// ***** bit tricks *****
+
+	// insert a 0 bit between each of the low 16 bits
+	constexpr std::uint32_t part1by1(std::uint32_t x){
+		x &= 0x0000ffff;
+		x = (x | (x << 8)) & 0x00ff00ff;
+		x = (x | (x << 4)) & 0x0f0f0f0f;
+		x = (x | (x << 2)) & 0x33333333;
+		x = (x | (x << 1)) & 0x55555555;
+		return x;
+	}
+
+	// insert two 0 bits between each of the low 10 bits
+	constexpr std::uint32_t part1by2(std::uint32_t x){
+		x &= 0x000003ff;
+		x = (x | (x << 16)) & 0x030000ff;
+		x = (x | (x << 8)) & 0x0300f00f;
+		x = (x | (x << 4)) & 0x030c30c3;
+		x = (x | (x << 2)) & 0x09249249;
+		return x;
+	}
+
+	// insert a 0 bit between each of the low 32 bits
+	constexpr std::uint64_t part1by1(std::uint64_t x){
+		x &= 0x00000000ffffffffull;
+		x = (x | (x << 16)) & 0x0000ffff0000ffffull;
+		x = (x | (x << 8)) & 0x00ff00ff00ff00ffull;
+		x = (x | (x << 4)) & 0x0f0f0f0f0f0f0f0full;
+		x = (x | (x << 2)) & 0x3333333333333333ull;
+		x = (x | (x << 1)) & 0x5555555555555555ull;
+		return x;
+	}
+
+	// insert two 0 bits between each of the low 21 bits
+	constexpr std::uint64_t part1by2(std::uint64_t x){
+		x &= 0x00000000001fffffull;
+		x = (x | (x << 32)) & 0x001f00000000ffffull;
+		x = (x | (x << 16)) & 0x001f0000ff0000ffull;
+		x = (x | (x << 8)) & 0x100f00f00f00f00full;
+		x = (x | (x << 4)) & 0x10c30c30c30c30c3ull;
+		x = (x | (x << 2)) & 0x1249249249249249ull;
+		return x;
+	}
+
+	// inverses of the above
+	constexpr std::uint32_t compact1by1(std::uint32_t x){
+		x &= 0x55555555;
+		x = (x | (x >> 1)) & 0x33333333;
+		x = (x | (x >> 2)) & 0x0f0f0f0f;
+		x = (x | (x >> 4)) & 0x00ff00ff;
+		x = (x | (x >> 8)) & 0x0000ffff;
+		return x;
+	}
+
+	constexpr std::uint32_t compact1by2(std::uint32_t x){
+		x &= 0x09249249;
+		x = (x | (x >> 2)) & 0x030c30c3;
+		x = (x | (x >> 4)) & 0x0300f00f;
+		x = (x | (x >> 8)) & 0x030000ff;
+		x = (x | (x >> 16)) & 0x000003ff;
+		return x;
+	}
+
+	constexpr std::uint64_t compact1by1(std::uint64_t x){
+		x &= 0x5555555555555555ull;
+		x = (x | (x >> 1)) & 0x3333333333333333ull;
+		x = (x | (x >> 2)) & 0x0f0f0f0f0f0f0f0full;
+		x = (x | (x >> 4)) & 0x00ff00ff00ff00ffull;
+		x = (x | (x >> 8)) & 0x0000ffff0000ffffull;
+		x = (x | (x >> 16)) & 0x00000000ffffffffull;
+		return x;
+	}
+
+	constexpr std::uint64_t compact1by2(std::uint64_t x){
+		x &= 0x1249249249249249ull;
+		x = (x | (x >> 2)) & 0x10c30c30c30c30c3ull;
+		x = (x | (x >> 4)) & 0x100f00f00f00f00full;
+		x = (x | (x >> 8)) & 0x001f0000ff0000ffull;
+		x = (x | (x >> 16)) & 0x001f00000000ffffull;
+		x = (x | (x >> 32)) & 0x00000000001fffffull;
+		return x;
+	}
+
+
+
+	// ***** dispatch on dimension and key width *****
+
+	// spread the bits of x so that they occupy every dim-th bit
+	template <std::size_t dim, class KeyT>
+	inline KeyT spread(KeyT x);
+
+	// gather every dim-th bit of x
+	template <std::size_t dim, class KeyT>
+	inline KeyT gather(KeyT x);
+
+#if defined(__BMI2__)
+	template <> inline std::uint32_t spread<2, std::uint32_t>(std::uint32_t x) {return _pdep_u32(x, 0x55555555);};
+	template <> inline std::uint32_t spread<3, std::uint32_t>(std::uint32_t x) {return _pdep_u32(x, 0x09249249);};
+	template <> inline std::uint64_t spread<2, std::uint64_t>(std::uint64_t x) {return _pdep_u64(x, 0x5555555555555555ull);};
+	template <> inline std::uint64_t spread<3, std::uint64_t>(std::uint64_t x) {return _pdep_u64(x, 0x1249249249249249ull);};
+	template <> inline std::uint32_t gather<2, std::uint32_t>(std::uint32_t x) {return _pext_u32(x, 0x55555555);};
+	template <> inline std::uint32_t gather<3, std::uint32_t>(std::uint32_t x) {return _pext_u32(x, 0x09249249);};
+	template <> inline std::uint64_t gather<2, std::uint64_t>(std::uint64_t x) {return _pext_u64(x, 0x5555555555555555ull);};
+	template <> inline std::uint64_t gather<3, std::uint64_t>(std::uint64_t x) {return _pext_u64(x, 0x1249249249249249ull);};
+#else
+	template <> inline std::uint32_t spread<2, std::uint32_t>(std::uint32_t x) {return part1by1(x);};
+	template <> inline std::uint32_t spread<3, std::uint32_t>(std::uint32_t x) {return part1by2(x);};
+	template <> inline std::uint64_t spread<2, std::uint64_t>(std::uint64_t x) {return part1by1(x);};
+	template <> inline std::uint64_t spread<3, std::uint64_t>(std::uint64_t x) {return part1by2(x);};
+	template <> inline std::uint32_t gather<2, std::uint32_t>(std::uint32_t x) {return compact1by1(x);};
+	template <> inline std::uint32_t gather<3, std::uint32_t>(std::uint32_t x) {return compact1by2(x);};
+	template <> inline std::uint64_t gather<2, std::uint64_t>(std::uint64_t x) {return compact1by1(x);};
+	template <> inline std::uint64_t gather<3, std::uint64_t>(std::uint64_t x) {return compact1by2(x);};
+#endif
+
+
+
+	// ***** Hilbert transform *****
+	// (J. Skilling, "Programming the Hilbert curve", 2004)
+	// converts grid coordinates in place to the "transposed"
+	// Hilbert index, whose bits interleave into the key
+
+	template <std::size_t dim, class KeyT>
+	inline void axes_to_transpose(KeyT * X, unsigned int bits){
+		KeyT M = KeyT(1) << (bits-1), P, Q, t;
+
+		// inverse undo
+		for (Q = M; Q > 1; Q >>= 1){
+			P = Q - 1;
+			for (std::size_t i=0; i<dim; i++){
+				if (X[i] & Q) X[0] ^= P;
+				else {
+					t = (X[0] ^ X[i]) & P;
+					X[0] ^= t;
+					X[i] ^= t;
+				}
+			}
+		}
+
+		// Gray encode
+		for (std::size_t i=1; i<dim; i++) X[i] ^= X[i-1];
+		t = 0;
+		for (Q = M; Q > 1; Q >>= 1) if (X[dim-1] & Q) t ^= Q - 1;
+		for (std::size_t i=0; i<dim; i++) X[i] ^= t;
+	}
+
+	template <std::size_t dim, class KeyT>
+	inline void transpose_to_axes(KeyT * X, unsigned int bits){
+		KeyT N = KeyT(2) << (bits-1), P, Q, t;
+
+		// Gray decode by H ^ (H/2)
+		t = X[dim-1] >> 1;
+		for (std::size_t i=dim-1; i>0; i--) X[i] ^= X[i-1];
+		X[0] ^= t;
+
+		// undo excess work
+		for (Q = 2; Q != N; Q <<= 1){
+			P = Q - 1;
+			for (std::size_t i=dim; i-- > 0;){
+				if (X[i] & Q) X[0] ^= P;
+				else {
+					t = (X[0] ^ X[i]) & P;
+					X[0] ^= t;
+					X[i] ^= t;
+				}
+			}
+		}
+	}
+
+}
+
+
+
+// ***** integer grid coordinates <-> keys *****
+
+// interleave grid coordinates: bit b of coordinate d goes to bit dim*b+d
+template <std::size_t dim, class KeyT>
+inline KeyT morton_encode(const GeneralPoint<dim, KeyT> & c){
+	KeyT key = 0;
+	for (std::size_t d=0; d<dim; d++) key |= sfc::spread<dim, KeyT>(c.x[d]) << d;
+	return key;
+}
+
+template <std::size_t dim, class KeyT>
+inline GeneralPoint<dim, KeyT> morton_decode(KeyT key){
+	GeneralPoint<dim, KeyT> c;
+	for (std::size_t d=0; d<dim; d++) c.x[d] = sfc::gather<dim, KeyT>(key >> d);
+	return c;
+}
+
+template <std::size_t dim, class KeyT>
+inline KeyT hilbert_encode(const GeneralPoint<dim, KeyT> & c){
+	KeyT X[dim], R[dim];
+	for (std::size_t d=0; d<dim; d++) X[d] = c.x[d];
+	sfc::axes_to_transpose<dim, KeyT>(X, sfc::CurveBits<dim, KeyT>::value);
+
+	// the first transposed coordinate holds the most significant bit
+	KeyT key = 0;
+	for (std::size_t d=0; d<dim; d++) R[d] = X[dim-1-d];
+	for (std::size_t d=0; d<dim; d++) key |= sfc::spread<dim, KeyT>(R[d]) << d;
+	return key;
+}
+
+template <std::size_t dim, class KeyT>
+inline GeneralPoint<dim, KeyT> hilbert_decode(KeyT key){
+	KeyT X[dim];
+	for (std::size_t d=0; d<dim; d++) X[dim-1-d] = sfc::gather<dim, KeyT>(key >> d);
+	sfc::transpose_to_axes<dim, KeyT>(X, sfc::CurveBits<dim, KeyT>::value);
+	GeneralPoint<dim, KeyT> c;
+	for (std::size_t d=0; d<dim; d++) c.x[d] = X[d];
+	return c;
+}
+
+
+
+// ***** points in a box <-> grid coordinates *****
+
+// map a point in the box onto the 2^bits grid (points outside are clamped)
+template <class KeyT, std::size_t dim, class T>
+inline GeneralPoint<dim, KeyT> curve_quantize(const GeneralPoint<dim, T> & pt, const Box<dim, T> & bx){
+	static const unsigned int bits = sfc::CurveBits<dim, KeyT>::value;
+	static const double cells = double(KeyT(1) << bits);
+	GeneralPoint<dim, KeyT> c;
+	for (std::size_t d=0; d<dim; d++){
+		double w = double(bx.hi.x[d]) - bx.lo.x[d];
+		double t = (w > 0)? (double(pt.x[d]) - bx.lo.x[d])/w : 0.0;
+		t = std::min(std::max(t*cells, 0.0), cells - 1.0);
+		c.x[d] = KeyT(t);
+	}
+	return c;
+}
+
+// center of the grid cell c within the box
+template <class T, std::size_t dim, class KeyT>
+inline GeneralPoint<dim, T> curve_dequantize(const GeneralPoint<dim, KeyT> & c, const Box<dim, T> & bx){
+	static const unsigned int bits = sfc::CurveBits<dim, KeyT>::value;
+	static const double cells = double(KeyT(1) << bits);
+	GeneralPoint<dim, T> pt;
+	for (std::size_t d=0; d<dim; d++){
+		pt.x[d] = bx.lo.x[d] + (double(bx.hi.x[d]) - bx.lo.x[d])*(double(c.x[d]) + 0.5)/cells;
+	}
+	return pt;
+}
+
+template <class KeyT, std::size_t dim, class T>
+inline KeyT curve_encode(CurveType curve, const GeneralPoint<dim, T> & pt, const Box<dim, T> & bx){
+	GeneralPoint<dim, KeyT> c = curve_quantize<KeyT>(pt, bx);
+	return (curve == HILBERT)? hilbert_encode(c) : morton_encode(c);
+}
+
+template <class T, std::size_t dim, class KeyT>
+inline GeneralPoint<dim, T> curve_decode(CurveType curve, KeyT key, const Box<dim, T> & bx){
+	GeneralPoint<dim, KeyT> c = (curve == HILBERT)? hilbert_decode<dim>(key) : morton_decode<dim>(key);
+	return curve_dequantize<T>(c, bx);
+}
+
+
+
+// ***** batch encoding *****
+
+template <class KeyT, std::size_t dim, class T>
+void curve_encode(CurveType curve, const std::vector<GeneralPoint<dim, T>> & pts, const Box<dim, T> & bx, KeyT * out){
+	if (curve == HILBERT){
+		for (std::size_t i=0; i<pts.size(); i++) out[i] = hilbert_encode(curve_quantize<KeyT>(pts[i], bx));
+	}
+	else {
+		for (std::size_t i=0; i<pts.size(); i++) out[i] = morton_encode(curve_quantize<KeyT>(pts[i], bx));
+	}
+}
+
+// encode from separate coordinate columns (e.g. PointArray or PointCloud x/y/z)
+template <class KeyT, std::size_t dim, class T>
+void curve_encode(CurveType curve, const T * const * coords, std::size_t n, const Box<dim, T> & bx, KeyT * out){
+	static const unsigned int bits = sfc::CurveBits<dim, KeyT>::value;
+	static const double cells = double(KeyT(1) << bits);
+	double lo[dim], scale[dim];
+	for (std::size_t d=0; d<dim; d++){
+		double w = double(bx.hi.x[d]) - bx.lo.x[d];
+		lo[d] = bx.lo.x[d];
+		scale[d] = (w > 0)? cells/w : 0.0;
+	}
+
+	// quantize in blocks, one column at a time, so the inner loops vectorize
+	static const std::size_t block = 256;
+	KeyT q[dim][block];
+	for (std::size_t s=0; s<n; s+=block){
+		std::size_t m = std::min(block, n-s);
+		for (std::size_t d=0; d<dim; d++){
+			const T * col = coords[d] + s;
+			for (std::size_t i=0; i<m; i++){
+				double t = (double(col[i]) - lo[d])*scale[d];
+				t = std::min(std::max(t, 0.0), cells - 1.0);
+				q[d][i] = KeyT(t);
+			}
+		}
+		GeneralPoint<dim, KeyT> c;
+		for (std::size_t i=0; i<m; i++){
+			for (std::size_t d=0; d<dim; d++) c.x[d] = q[d][i];
+			out[s+i] = (curve == HILBERT)? hilbert_encode(c) : morton_encode(c);
+		}
+	}
+}
+
+template <class KeyT, std::size_t dim, class T>
+void curve_encode(CurveType curve, const PointArray<dim, T> & pts, const Box<dim, T> & bx, KeyT * out){
+	const T * coords[dim];
+	for (std::size_t d=0; d<dim; d++) coords[d] = pts.coord(d);
+	curve_encode<KeyT, dim, T>(curve, coords, pts.size(), bx, out);
+}
+
+
+
+// ***** reordering *****
+
+// the permutation that sorts the keys (ties keep their input order)
+template <class KeyT>
+std::vector<std::size_t> curve_order(const std::vector<KeyT> & keys){
+	std::vector<std::pair<KeyT, std::size_t>> kv(keys.size());
+	for (std::size_t i=0; i<keys.size(); i++) kv[i] = std::make_pair(keys[i], i);
+	std::sort(kv.begin(), kv.end());
+	std::vector<std::size_t> order(keys.size());
+	for (std::size_t i=0; i<kv.size(); i++) order[i] = kv[i].second;
+	return order;
+}
+
+// the permutation that puts the points in curve order within their bounding box
+template <std::size_t dim, class T>
+std::vector<std::size_t> curve_order(CurveType curve, const std::vector<GeneralPoint<dim, T>> & pts){
+	if (pts.size() == 0) return {};
+	Box<dim, T> bx(pts[0], pts[0]);
+	for (std::size_t i=1; i<pts.size(); i++){
+		for (std::size_t d=0; d<dim; d++){
+			bx.lo.x[d] = std::min(bx.lo.x[d], pts[i].x[d]);
+			bx.hi.x[d] = std::max(bx.hi.x[d], pts[i].x[d]);
+		}
+	}
+	std::vector<std::uint64_t> keys(pts.size());
+	curve_encode(curve, pts, bx, &keys.front());
+	return curve_order(keys);
+}
+
+// sort the points into curve order (in place)
+template <std::size_t dim, class T>
+void curve_sort(std::vector<GeneralPoint<dim, T>> & pts, CurveType curve = HILBERT){
+	std::vector<std::size_t> order = curve_order(curve, pts);
+	std::vector<GeneralPoint<dim, T>> sorted(pts.size());
+	for (std::size_t i=0; i<order.size(); i++) sorted[i] = pts[order[i]];
+	pts.swap(sorted);
+}
+
+}
+
+#endif
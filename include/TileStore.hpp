@@ -0,0 +1,82 @@
+#ifndef _TILESTORE_H
+#define _TILESTORE_H
+
+#include <string>
+#include <vector>
+
+#include "PointCloud.hpp"
+
+// out-of-core spatial tiling of LAS point clouds
+//
+// a TileStore is a directory of LAS tiles plus a small binary index
+// (tiles.idx) holding the bounds and point count of every tile, so
+// that a box query only ever opens the tiles it intersects:
+//
+//    TileStore store = TileStore::build({"a.las", "b.las"}, "tiles");
+//    PointCloud pc = store.query(box);
+//
+// the tiles are the leaves of a quadtree over the xy bounds of the
+// inputs, down to a grid of 2^levels x 2^levels cells. Building
+// streams the inputs in chunks, sorts the buffered points by cell and
+// spills them to fragment files, then assembles each tile from the
+// fragments, so memory stays bounded by the buffer and the largest tile
+
+
+// options for building a TileStore
+struct TilerOptions{
+  unsigned int levels = 6;              // finest grid is 2^levels x 2^levels cells (at most 15)
+  std::size_t max_points = 0;           // 0: every non-empty cell is a tile (plain grid)
+                                        // else: quadtree nodes with at most max_points become tiles
+  std::size_t chunk_size = 1<<20;       // records read from an input at a time
+  std::size_t buffer_points = 1<<23;    // points held in memory before spilling to disk
+  LASReadOptions read;                  // columns, threads and filters used to read the inputs
+
+  // inputs are read quantized, so tiles keep their integer grid
+  TilerOptions() {read.quantized = true;};
+};
+
+
+// one tile of the store: quadtree node (level, ix, iy) and what's in it
+struct TileInfo{
+  unsigned int level, ix, iy;
+  std::size_t count;
+  csg::Box<3> bounds;       // extents of the tile's points
+};
+
+
+class TileStore{
+public:
+
+  TileStore(std::string directory);     // open an existing store (reads the index only)
+
+  // tile the LAS files into directory (created if needed) and open the result
+  static TileStore build(const std::vector<std::string> & inputs, std::string directory,
+                         const TilerOptions & opts=TilerOptions());
+
+  // metadata inspectors
+  const std::string & directory() const {return _directory;};
+  const std::vector<TileInfo> & tiles() const {return _tiles;};
+  std::size_t pointcount() const;
+  csg::Box<3> bounds() const;
+  std::string tile_filename(std::size_t k) const;
+
+  // indices of the tiles whose bounds intersect box
+  std::vector<std::size_t> intersecting(const csg::Box<3> & box) const;
+
+  // load one tile, or the points inside box from the tiles it touches
+  // (opts selects columns and threads; its box is replaced by this one)
+  PointCloud load_tile(std::size_t k, const LASReadOptions & opts=LASReadOptions()) const;
+  PointCloud query(const csg::Box<3> & box, const LASReadOptions & opts=LASReadOptions()) const;
+
+private:
+  std::string _directory;
+  unsigned int _levels;
+  double _lo[2], _side;       // square xy region covered by the finest grid
+  std::vector<TileInfo> _tiles;
+
+  TileStore() {};
+  void read_index();
+  void write_index() const;
+};
+
+#endif
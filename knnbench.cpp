@@ -0,0 +1,96 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+
+#include "include/KDTree.hpp"
+
+using namespace std;
+using namespace csg;
+
+
+// exact against approximate k-nearest-neighbor search in KDTree
+//
+// 2M points on a noisy rolling surface (like surveyed terrain) and
+// 500k Morton-sorted queries near it, one thread, best of 2 runs. For
+// each ApproxSearch setting: the time, the speedup over the exact
+// search, the recall (share of the exact neighbors returned), the
+// mean and worst ratio of reported to exact distance, and how often a
+// distance broke its (1+eps) bound, which must be never
+//
+// compile this with command:
+// 			g++ -std=c++14 -O2 -pthread -I./ knnbench.cpp -o knnbench
+// and run it as
+//			./knnbench [k]
+
+typedef chrono::steady_clock bench_clock;
+
+template <class F>
+double best_s(F && f, int runs=2){
+	double best = numeric_limits<double>::infinity();
+	for (int r=0; r<runs; r++){
+		auto t0 = bench_clock::now();
+		f();
+		best = min(best, chrono::duration<double>(bench_clock::now() - t0).count());
+	}
+	return best;
+}
+
+int main(int argc, char * argv[])
+{
+	const size_t k = (argc > 1)? atoi(argv[1]) : 8;
+	const size_t n = 2000000, nq = 500000;
+
+	mt19937 gen(11);
+	uniform_real_distribution<double> u(0.0, 1000.0);
+	normal_distribution<double> g(0.0, 0.05);
+	vector<Point<3>> pts(n);
+	for (auto & p : pts){
+		double x = u(gen), y = u(gen);
+		p = Point<3>(x, y, 10*sin(x/50)*cos(y/70) + g(gen));
+	}
+	KDTree<3> tree(pts);
+
+	vector<Point<3>> q(nq);
+	for (auto & p : q){
+		const Point<3> & b = pts[size_t(u(gen)*n/1000) % n];
+		p = Point<3>(b.x[0] + 5*g(gen), b.x[1] + 5*g(gen), b.x[2] + g(gen));
+	}
+	curve_sort(q, MORTON);
+
+	vector<size_t> ie(k*nq), ia(k*nq);
+	vector<double> de(k*nq), da(k*nq);
+	double te = best_s([&](){for (size_t i=0; i<nq; i++) tree.knn(q[i], k, &ie[k*i], &de[k*i]);});
+	cout << "k=" << k << ", exact: " << te << " s" << endl;
+
+	auto run = [&](const ApproxSearch & a){
+		double ta = best_s([&](){for (size_t i=0; i<nq; i++) tree.knn(q[i], k, &ia[k*i], &da[k*i], a);});
+		size_t hits = 0, violations = 0;
+		double worst = 1, sum = 0;
+		for (size_t i=0; i<nq; i++){
+			for (size_t j=0; j<k; j++){
+				hits += (find(&ie[k*i], &ie[k*i] + k, ia[k*i+j]) != &ie[k*i] + k);
+				double r = (de[k*i+j] > 0)? da[k*i+j]/de[k*i+j] : 1;
+				worst = max(worst, r);
+				sum += r;
+				violations += (a.max_leaves == 0 && r > 1 + a.eps + 1e-12);
+			}
+		}
+		cout << "eps " << setw(4) << a.eps << "  leaves " << setw(2) << a.max_leaves << ":  " << fixed << setprecision(3);
+		cout << ta << " s  x" << setprecision(2) << te/ta << "  recall " << setprecision(4) << double(hits)/(k*nq);
+		cout << "  mean ratio " << setprecision(5) << sum/(k*nq) << "  worst " << setprecision(4) << worst;
+		cout << "  bound violations " << violations << defaultfloat << endl;
+		return violations;
+	};
+
+	size_t violations = 0;
+	for (double e : {0.0, 0.1, 0.25, 0.5, 1.0, 2.0}) violations += run(ApproxSearch(e));
+	for (size_t l : {2, 4, 8, 16}) run(ApproxSearch(0.0, l));
+	run(ApproxSearch(0.5, 4));
+
+	return (violations == 0)? 0 : 1;
+}
@@ -0,0 +1,73 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+#include "include/Point.hpp"
+#include "include/GeomUtils.hpp"
+
+using namespace std;
+using namespace csg;
+
+
+// microbenchmark of GeneralPoint copies and arithmetic: read_STL,
+// the per-cell point arithmetic of Orthtree::interpolateTo, and a
+// plain copy of a vector of points. Each is the best of 20 runs
+//
+// compile this with command:
+// 			g++ -std=c++14 -O2 -I./ pointbench.cpp -o pointbench
+// and run it as
+//			./pointbench [file.stl]
+
+typedef chrono::steady_clock bench_clock;
+
+template <class F>
+double best_ms(F && f, int runs=20){
+	double best = numeric_limits<double>::infinity();
+	for (int r=0; r<runs; r++){
+		auto t0 = bench_clock::now();
+		f();
+		best = min(best, chrono::duration<double, milli>(bench_clock::now() - t0).count());
+	}
+	return best;
+}
+
+int main(int argc, char * argv[])
+{
+	string stlfile = (argc > 1)? argv[1] : "data/brain-gear.stl";
+
+	// read_STL
+	size_t ntris = 0;
+	double t = best_ms([&](){ntris = read_STL(stlfile)->triangles.size();});
+	cout << "read_STL(" << stlfile << ", " << ntris << " tris): " << t << " ms" << endl;
+
+	// interpolateTo's arithmetic on each neighbor cell, over 1M cells:
+	// ctr = 0.5*(hi+lo); pt = ctr + offset/level; out = pt - p
+	mt19937 gen(1);
+	uniform_real_distribution<double> u(0.0, 1.0);
+	vector<Box<3>> boxes(1 << 20);
+	for (auto & b : boxes){
+		b.lo = Point<3>(u(gen), u(gen), u(gen));
+		b.hi = Point<3>(u(gen), u(gen), u(gen));
+	}
+	vector<Point<3>> out(boxes.size());
+	Point<3> offset(0.1, 0.2, 0.3), p(0.5, 0.5, 0.5);
+	t = best_ms([&](){
+		for (size_t i=0; i<boxes.size(); i++){
+			Point<3> ctr = 0.5*(boxes[i].hi+boxes[i].lo);
+			Point<3> pt = ctr + offset/static_cast<double>(1 + (i & 7));
+			out[i] = pt-p;
+		}
+	});
+	double check = 0.0;
+	for (auto & o : out) check += o.x[0];
+	cout << "interpolateTo arithmetic (" << boxes.size() << " cells): " << t << " ms (checksum " << check << ")" << endl;
+
+	// copying a vector of points
+	vector<Point<3>> cp;
+	t = best_ms([&](){cp = out;});
+	cout << "vector<Point<3>> copy (" << out.size() << " points): " << t << " ms" << endl;
+
+	return 0;
+}
@@ -0,0 +1,112 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+#include "include/Predicates.hpp"
+#include "include/Delaunay.hpp"
+
+using namespace std;
+using namespace csg;
+
+
+// timing and exact-degeneracy check of the robust predicates
+//
+// the Delaunay timings (best of 5 runs) cover the two cases that
+// matter: a regular grid, as in gridded LiDAR, where most orient2d and
+// incircle calls are exactly zero and go past the floating-point
+// filter, and random points, where almost none do. The checks compare
+// random and exactly degenerate configurations against signs computed
+// in integer arithmetic
+//
+// compile this with command:
+// 			g++ -std=c++14 -O2 -I./ predbench.cpp -o predbench
+
+typedef chrono::steady_clock bench_clock;
+
+template <class F>
+double best_s(F && f, int runs=5){
+	double best = numeric_limits<double>::infinity();
+	for (int r=0; r<runs; r++){
+		auto t0 = bench_clock::now();
+		f();
+		best = min(best, chrono::duration<double>(bench_clock::now() - t0).count());
+	}
+	return best;
+}
+
+template <class I>
+int sign(I v) {return (v > 0) - (v < 0);}
+
+int main(int argc, char * argv[])
+{
+	// ***** timing *****
+	vector<Point<2>> grid;
+	for (int i=0; i<100; i++) for (int j=0; j<100; j++) grid.push_back(Point<2>(i*0.5, j*0.5));
+	int ntri = 0;
+	double t = best_s([&](){vector<Point<2>> p(grid); Delaunay d(p, 0); ntri = d.ntri;});
+	cout << "Delaunay of a 100x100 grid: " << t << " s (" << ntri << " triangles, expected " << 2*99*99 << ")" << endl;
+
+	mt19937 gen(1);
+	uniform_real_distribution<double> u(0.0, 1.0);
+	vector<Point<2>> rnd(40000);
+	for (auto & p : rnd) p = Point<2>(u(gen), u(gen));
+	t = best_s([&](){vector<Point<2>> p(rnd); Delaunay d(p, 0); ntri = d.ntri;});
+	cout << "Delaunay of 40k random points: " << t << " s (" << ntri << " triangles)" << endl;
+
+	// ***** exact degeneracies *****
+	// small integer configurations, many of them exactly collinear,
+	// coplanar, cocircular or cospherical, against their signs in
+	// integer arithmetic. Both the filtered predicates and the exact
+	// fallbacks are checked on every configuration
+	uniform_int_distribution<int> ui(-8, 8);
+	long wrong = 0, zeros = 0, tests = 0;
+	for (int it=0; it<200000; it++){
+		long long q[5][3];
+		for (auto & r : q) for (auto & x : r) x = ui(gen);
+		// force collinear / coplanar / cocircular / cospherical cases
+		if (it % 2 == 0) for (int k=0; k<3; k++) q[2][k] = 2*q[1][k] - q[0][k];
+		if (it % 3 == 0){
+			// a, b, c, d on the circle and sphere x^2 + y^2 (+ z^2) = 25
+			static const long long s[8][3] = {{5,0,0}, {0,5,0}, {-5,0,0}, {0,-5,0}, {3,4,0}, {4,-3,0}, {0,3,4}, {0,0,5}};
+			for (int i=0; i<5; i++) for (int k=0; k<3; k++) q[i][k] = s[(it/3 + 3*i) % 8][k];
+		}
+
+		// exact integer signs of the differences
+		long long ax = q[0][0]-q[3][0], ay = q[0][1]-q[3][1], az = q[0][2]-q[3][2];
+		long long bx = q[1][0]-q[3][0], by = q[1][1]-q[3][1], bz = q[1][2]-q[3][2];
+		long long cx = q[2][0]-q[3][0], cy = q[2][1]-q[3][1], cz = q[2][2]-q[3][2];
+		int o2 = sign((q[0][0]-q[2][0])*(q[1][1]-q[2][1]) - (q[0][1]-q[2][1])*(q[1][0]-q[2][0]));
+		int o3 = sign(az*(bx*cy - cx*by) + bz*(cx*ay - ax*cy) + cz*(ax*by - bx*ay));
+		int ic = sign((ax*ax + ay*ay)*(bx*cy - cx*by) + (bx*bx + by*by)*(cx*ay - ax*cy) + (cx*cx + cy*cy)*(ax*by - bx*ay));
+		long long e[4][3];
+		for (int i=0; i<4; i++) for (int k=0; k<3; k++) e[i][k] = q[i][k] - q[4][k];
+		long long l[4];
+		for (int i=0; i<4; i++) l[i] = e[i][0]*e[i][0] + e[i][1]*e[i][1] + e[i][2]*e[i][2];
+		auto m = [&](int i, int j){return e[i][0]*e[j][1] - e[j][0]*e[i][1];};
+		long long abc = e[0][2]*m(1,2) - e[1][2]*m(0,2) + e[2][2]*m(0,1);
+		long long bcd = e[1][2]*m(2,3) - e[2][2]*m(1,3) + e[3][2]*m(1,2);
+		long long cda = e[2][2]*m(3,0) + e[3][2]*m(0,2) + e[0][2]*m(2,3);
+		long long dab = e[3][2]*m(0,1) + e[0][2]*m(1,3) + e[1][2]*m(3,0);
+		int is = sign((l[3]*abc - l[2]*dab) + (l[1]*cda - l[0]*bcd));
+
+		// the same configurations, scaled by 2^-30 and shifted by 2^20
+		// (exact in doubles, far from the origin)
+		double p[5][3];
+		for (int i=0; i<5; i++) for (int k=0; k<3; k++) p[i][k] = 1048576.0 + std::ldexp(double(q[i][k]), -30);
+		wrong += sign(predicates::orient2d(p[0], p[1], p[2])) != o2;
+		wrong += sign(predicates::orient3d(p[0], p[1], p[2], p[3])) != o3;
+		wrong += sign(predicates::incircle(p[0], p[1], p[2], p[3])) != ic;
+		wrong += sign(predicates::insphere(p[0], p[1], p[2], p[3], p[4])) != is;
+		wrong += sign(predicates::orient2d_exact(p[0], p[1], p[2])) != o2;
+		wrong += sign(predicates::orient3d_exact(p[0], p[1], p[2], p[3])) != o3;
+		wrong += sign(predicates::incircle_exact(p[0], p[1], p[2], p[3])) != ic;
+		wrong += sign(predicates::insphere_exact(p[0], p[1], p[2], p[3], p[4])) != is;
+		zeros += (o2 == 0) + (o3 == 0) + (ic == 0) + (is == 0);
+		tests += 8;
+	}
+	cout << "predicate signs: " << wrong << " wrong of " << tests << " (" << zeros << " exactly degenerate)" << endl;
+
+	return (wrong == 0)? 0 : 1;
+}
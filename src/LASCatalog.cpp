@@ -0,0 +1,195 @@
+// header-only catalog of a directory of LAS files
+//
+// the index holds, for every file, its name, mtime, size and the raw
+// bytes of its public header block, which are parsed again on load
+#include "LASCatalog.hpp"
+#include "Parallel.hpp"
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static const char catalog_index_magic[8] = {'C', 'S', 'G', 'L', 'A', 'S', 'C', '1'};
+static const std::size_t max_header_bytes = 375;    // LAS 1.4 public header block
+
+static bool is_las_name(const std::string & name){
+  if (name.size() < 5) return false;
+  std::string ext = name.substr(name.size()-4);
+  for (auto & c : ext) c = tolower(c);
+  return ext == ".las";
+}
+
+// parse a cached header block, clamping the point count to what fits in the
+// file; false for anything LASFile can't read
+static bool parse_entry(const std::vector<char> & raw, LASCatalogEntry & entry){
+  if (raw.size() < 227 || strncmp(&raw.front(), "LASF", 4) != 0) return false;
+  entry.header = LASHeader::parse(&raw.front(), raw.size());
+  const LASHeader & h = entry.header;
+  if (!h.records_readable() || h.point_offset > entry.size) return false;    // as LASFile would refuse it
+  std::size_t realsize = (entry.size - h.point_offset)/h.point_record_bytes;
+  if (entry.header.pt_count > realsize) entry.header.pt_count = realsize;
+  return true;
+}
+
+csg::Box<3> LASCatalogEntry::bounds() const{
+  return csg::Box<3>(csg::GeneralPoint<3, double>(header.x_min, header.y_min, header.z_min),
+                     csg::GeneralPoint<3, double>(header.x_max, header.y_max, header.z_max));
+}
+
+
+
+LASCatalog::LASCatalog(string directory, string index_file, unsigned int nthreads)
+: _directory(directory), _index_file(index_file){
+  if (_index_file.empty()) _index_file = _directory + "/lascatalog.idx";
+  refresh(nthreads);
+}
+
+std::size_t LASCatalog::refresh(unsigned int nthreads){
+  // what is in the directory now
+  DIR * dir = opendir(_directory.c_str());
+  if (dir == nullptr){
+    cout << "LASCatalog: could not open directory " << _directory << endl;
+    throw -1;
+  }
+  std::vector<LASCatalogEntry> found;
+  struct dirent * de;
+  while ((de = readdir(dir)) != nullptr){
+    std::string name = de->d_name;
+    if (!is_las_name(name)) continue;
+    struct stat st;
+    if (stat((_directory + "/" + name).c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+    LASCatalogEntry e;
+    e.name = name;
+    e.mtime = std::int64_t(st.st_mtim.tv_sec)*1000000000 + st.st_mtim.tv_nsec;
+    e.size = st.st_size;
+    found.push_back(e);
+  }
+  closedir(dir);
+  std::sort(found.begin(), found.end(), [](const LASCatalogEntry & a, const LASCatalogEntry & b){return a.name < b.name;});
+
+  // previous state: what we hold, or else the index file
+  std::vector<LASCatalogEntry> old = _entries;
+  std::vector<std::vector<char>> old_raw = _raw;
+  if (old.empty() && !read_index(old, old_raw)) {old.clear(); old_raw.clear();}
+
+  // reuse every entry whose name, mtime and size are unchanged
+  std::vector<std::vector<char>> raw(found.size());
+  std::vector<std::size_t> stale;
+  std::size_t j = 0;
+  for (std::size_t k=0; k<found.size(); k++){
+    while (j < old.size() && old[j].name < found[k].name) j++;
+    if (j < old.size() && old[j].name == found[k].name && old[j].mtime == found[k].mtime && old[j].size == found[k].size){
+      found[k].header = old[j].header;
+      raw[k] = old_raw[j];
+    }
+    else stale.push_back(k);
+  }
+
+  // read the headers of new and changed files in parallel
+  std::vector<char> ok(found.size(), 1);
+  csg::parallel_for(stale.size(), nthreads, [&](std::size_t b, std::size_t e, unsigned int t){
+    for (std::size_t s=b; s<e; s++){
+      std::size_t k = stale[s];
+      std::vector<char> buf(max_header_bytes);
+      int fd = open((_directory + "/" + found[k].name).c_str(), O_RDONLY);
+      ssize_t n = (fd < 0)? -1 : pread(fd, &buf.front(), buf.size(), 0);
+      if (fd >= 0) close(fd);
+      buf.resize((n > 0)? n : 0);
+      if (parse_entry(buf, found[k])) raw[k].swap(buf);
+      else ok[k] = 0;
+    }
+  });
+
+  // files that aren't LAS are left out (and looked at again next time)
+  std::size_t reread = 0;
+  for (auto k : stale) reread += ok[k];
+  _entries.clear();
+  _raw.clear();
+  for (std::size_t k=0; k<found.size(); k++){
+    if (!ok[k]){
+      cout << "WARNING: LASCatalog: skipping " << found[k].name << ", which is not a readable LAS file" << endl;
+      continue;
+    }
+    _entries.push_back(found[k]);
+    _raw.push_back(std::move(raw[k]));
+  }
+
+  if (reread > 0 || _entries.size() != old.size()) write_index();
+  return reread;
+}
+
+std::size_t LASCatalog::pointcount() const{
+  std::size_t n = 0;
+  for (auto & e : _entries) n += e.header.pt_count;
+  return n;
+}
+
+csg::Box<3> LASCatalog::bounds() const{
+  if (_entries.size() == 0) return csg::Box<3>();
+  csg::Box<3> bx = _entries.front().bounds();
+  for (auto & e : _entries) bx = csg::bounding_box(bx, e.bounds());
+  return bx;
+}
+
+std::vector<std::size_t> LASCatalog::intersecting(const csg::Box<3> & box) const{
+  std::vector<std::size_t> found;
+  for (std::size_t k=0; k<_entries.size(); k++){
+    const LASHeader & h = _entries[k].header;
+    if (h.x_max < box.lo.x[0] || h.x_min > box.hi.x[0]) continue;
+    if (h.y_max < box.lo.x[1] || h.y_min > box.hi.x[1]) continue;
+    if (h.z_max < box.lo.x[2] || h.z_min > box.hi.x[2]) continue;
+    found.push_back(k);
+  }
+  return found;
+}
+
+bool LASCatalog::read_index(std::vector<LASCatalogEntry> & entries, std::vector<std::vector<char>> & raw) const{
+  ifstream in(_index_file, ios::binary);
+  char magic[8];
+  if (!in || !in.read(magic, 8) || memcmp(magic, catalog_index_magic, 8) != 0) return false;
+
+  std::uint64_t n;
+  in.read((char *)&n, sizeof(n));
+  for (std::uint64_t k=0; k<n && in; k++){
+    LASCatalogEntry e;
+    std::uint32_t namelen;
+    std::uint16_t hdrlen;
+    in.read((char *)&namelen, sizeof(namelen));
+    if (!in || namelen > 4096) return false;
+    e.name.resize(namelen);
+    in.read(&e.name[0], namelen);
+    in.read((char *)&e.mtime, sizeof(e.mtime));
+    in.read((char *)&e.size, sizeof(e.size));
+    in.read((char *)&hdrlen, sizeof(hdrlen));
+    if (!in || hdrlen < 227 || hdrlen > max_header_bytes) return false;
+    std::vector<char> buf(hdrlen);
+    in.read(&buf.front(), hdrlen);
+    if (!in || !parse_entry(buf, e)) return false;
+    entries.push_back(e);
+    raw.push_back(std::move(buf));
+  }
+  return bool(in);
+}
+
+void LASCatalog::write_index() const{
+  ofstream out(_index_file, ios::binary | ios::trunc);
+  if (!out){
+    cout << "WARNING: LASCatalog: could not write the index " << _index_file << endl;
+    return;
+  }
+  std::uint64_t n = _entries.size();
+  out.write(catalog_index_magic, 8);
+  out.write((const char *)&n, sizeof(n));
+  for (std::size_t k=0; k<_entries.size(); k++){
+    const LASCatalogEntry & e = _entries[k];
+    std::uint32_t namelen = e.name.size();
+    std::uint16_t hdrlen = _raw[k].size();
+    out.write((const char *)&namelen, sizeof(namelen));
+    out.write(e.name.data(), namelen);
+    out.write((const char *)&e.mtime, sizeof(e.mtime));
+    out.write((const char *)&e.size, sizeof(e.size));
+    out.write((const char *)&hdrlen, sizeof(hdrlen));
+    out.write(&_raw[k].front(), hdrlen);
+  }
+}
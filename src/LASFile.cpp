@@ -0,0 +1,431 @@
+// memory-mapped LAS reader
+//
+// the header is parsed straight out of the map using the fixed
+// byte offsets of the LAS 1.0-1.4 public header block, so opening
+// a file never touches the point records
+#include "LASFile.hpp"
+
+#include <time.h>
+
+using namespace std;
+
+// read a little-endian field of type T at byte offset off
+template <class T>
+static T las_field(const char * buf, std::size_t off){
+  T val;
+  memcpy(&val, &buf[off], sizeof(T));
+  return val;
+}
+
+LASHeader LASHeader::parse(const char * buf, std::size_t len){
+  LASHeader h;
+
+  if (len < 227 || strncmp(buf, "LASF", 4) != 0){
+    cout << "LASHeader: not a LAS file (missing LASF signature or short header)" << endl;
+    throw -1;
+  }
+
+  h.ver_major = las_field<unsigned char>(buf, 24);             // Version Major
+  h.ver_minor = las_field<unsigned char>(buf, 25);             // Version Minor
+  h.header_size = las_field<unsigned short>(buf, 94);          // Header Size
+  h.point_offset = las_field<unsigned int>(buf, 96);           // Offset to Point Data
+  h.num_vlrs = las_field<unsigned int>(buf, 100);              // Number of Variable Length Records
+  h.point_format_id = las_field<unsigned char>(buf, 104);      // Point Data Format ID
+  h.point_record_bytes = las_field<unsigned short>(buf, 105);  // Point Data Record Length
+  h.pt_count = las_field<unsigned int>(buf, 107);              // Number of point records
+  for (int i=0; i<15; i++) h.pts_by_return[i] = 0;
+  for (int i=0; i<5; i++) h.pts_by_return[i] = las_field<unsigned int>(buf, 111+4*i);  // Number of points by return
+  h.x_scale = las_field<double>(buf, 131);                     // X Scale Factor
+  h.y_scale = las_field<double>(buf, 139);                     // Y Scale Factor
+  h.z_scale = las_field<double>(buf, 147);                     // Z Scale Factor
+  h.x_offset = las_field<double>(buf, 155);                    // X Offset
+  h.y_offset = las_field<double>(buf, 163);                    // Y Offset
+  h.z_offset = las_field<double>(buf, 171);                    // Z Offset
+  h.x_max = las_field<double>(buf, 179);                       // X Max
+  h.x_min = las_field<double>(buf, 187);                       // X Min
+  h.y_max = las_field<double>(buf, 195);                       // Y Max
+  h.y_min = las_field<double>(buf, 203);                       // Y Min
+  h.z_max = las_field<double>(buf, 211);                       // Z Max
+  h.z_min = las_field<double>(buf, 219);                       // Z Min
+
+  // LAS 1.4 moves the point counts to 64 bit fields
+  if (h.ver_minor > 3 && h.header_size >= 375 && len >= 375){
+    std::size_t count14 = las_field<unsigned long long>(buf, 247);
+    if (h.pt_count == 0) h.pt_count = count14;
+    for (int i=0; i<15; i++) h.pts_by_return[i] = las_field<unsigned long long>(buf, 255+8*i);
+  }
+
+  return h;
+}
+
+bool LASHeader::records_readable() const{
+  return point_format_id <= 5 && point_record_bytes >= las_record_size(point_format_id) && header_size <= point_offset;
+}
+
+// write a little-endian field of type T at byte offset off
+template <class T>
+static void las_put(char * buf, std::size_t off, T val){
+  memcpy(&buf[off], &val, sizeof(T));
+}
+
+void LASHeader::write(char * buf) const{
+  memset(buf, 0, header_size);
+  memcpy(buf, "LASF", 4);                                   // signature
+  las_put<unsigned char>(buf, 24, ver_major);               // Version Major
+  las_put<unsigned char>(buf, 25, ver_minor);               // Version Minor
+  strncpy(&buf[26], "CompGeometry", 32);                    // System Identifier
+  strncpy(&buf[58], "CompGeometry PointCloud", 32);         // Generating Software
+  time_t now = time(NULL);
+  struct tm * t = gmtime(&now);
+  las_put<unsigned short>(buf, 90, t->tm_yday + 1);         // File Creation Day of Year
+  las_put<unsigned short>(buf, 92, t->tm_year + 1900);      // File Creation Year
+  las_put<unsigned short>(buf, 94, header_size);            // Header Size
+  las_put<unsigned int>(buf, 96, point_offset);             // Offset to Point Data
+  las_put<unsigned int>(buf, 100, num_vlrs);                // Number of Variable Length Records
+  las_put<unsigned char>(buf, 104, point_format_id);        // Point Data Format ID
+  las_put<unsigned short>(buf, 105, point_record_bytes);    // Point Data Record Length
+
+  // legacy 32 bit counts are zero when they can't hold the count (1.4 only)
+  bool legacy = pt_count <= 0xffffffffull;
+  las_put<unsigned int>(buf, 107, legacy? pt_count : 0);    // Number of point records
+  for (int i=0; i<5; i++) las_put<unsigned int>(buf, 111+4*i, legacy? pts_by_return[i] : 0);
+
+  las_put<double>(buf, 131, x_scale);                       // X Scale Factor
+  las_put<double>(buf, 139, y_scale);                       // Y Scale Factor
+  las_put<double>(buf, 147, z_scale);                       // Z Scale Factor
+  las_put<double>(buf, 155, x_offset);                      // X Offset
+  las_put<double>(buf, 163, y_offset);                      // Y Offset
+  las_put<double>(buf, 171, z_offset);                      // Z Offset
+  las_put<double>(buf, 179, x_max);                         // X Max
+  las_put<double>(buf, 187, x_min);                         // X Min
+  las_put<double>(buf, 195, y_max);                         // Y Max
+  las_put<double>(buf, 203, y_min);                         // Y Min
+  las_put<double>(buf, 211, z_max);                         // Z Max
+  las_put<double>(buf, 219, z_min);                         // Z Min
+
+  // 1.3 adds the waveform data offset (left at 0), 1.4 the
+  // extended VLR offset/count and 64 bit point counts
+  if (ver_minor > 3 && header_size >= 375){
+    las_put<unsigned long long>(buf, 247, pt_count);
+    for (int i=0; i<15; i++) las_put<unsigned long long>(buf, 255+8*i, pts_by_return[i]);
+  }
+}
+
+
+
+LASFile::LASFile(string filename, std::size_t byte_offset)
+: _filename(filename), _fd(-1), _map(nullptr), _mapsize(0), _points(nullptr){
+
+  // the destructor doesn't run if the constructor throws, so until the
+  // file checks out the map and descriptor are released here
+  struct OpenGuard{
+    LASFile & las;
+    bool armed;
+    ~OpenGuard(){
+      if (!armed) return;
+      if (las._map != nullptr) munmap(las._map, las._mapsize);
+      if (las._fd >= 0) close(las._fd);
+      las._map = nullptr;
+      las._fd = -1;
+    }
+  } guard{*this, true};
+
+  // map the whole file
+  _fd = open(filename.c_str(), O_RDONLY);
+  if (_fd < 0){
+    cout << "Error opening file in LASFile" << endl;
+    throw -1;
+  }
+  off_t sz = lseek(_fd, 0, SEEK_END);
+  if (sz <= 0 || std::size_t(sz) <= byte_offset){
+    cout << "LASFile: " << filename << " is empty" << endl;
+    throw -1;
+  }
+  _mapsize = sz;
+  _map = (char *)mmap(NULL, _mapsize, PROT_READ, MAP_PRIVATE, _fd, 0);
+  if (_map == MAP_FAILED){
+    _map = nullptr;
+    cout << "Failed to map las file" << endl;
+    throw -1;
+  }
+
+  // the header is the only thing read up front
+  const char * base = _map + byte_offset;
+  _header = LASHeader::parse(base, _mapsize - byte_offset);
+
+  // check the record format, where the records start and their length
+  // before anything is read through them
+  if (_header.point_format_id > 5){
+    cout << "Point format " << int(_header.point_format_id) << " is not supported" << endl;
+    throw -1;
+  }
+  if (byte_offset + _header.point_offset > _mapsize || _header.header_size > _header.point_offset){
+    cout << "LASFile: " << filename << " has its point data at byte " << _header.point_offset;
+    cout << ", inside the header or past the end of the file" << endl;
+    throw -1;
+  }
+  if (!_header.records_readable()){
+    cout << "LASFile: " << filename << " has " << _header.point_record_bytes << " byte point records, too short for point format ";
+    cout << int(_header.point_format_id) << " (" << las_record_size(_header.point_format_id) << " bytes)" << endl;
+    throw -1;
+  }
+  if (_header.point_format_id > 3){
+    cout << "Some features of point format " << int(_header.point_format_id);
+    cout << " may not be supported" << endl;
+  }
+  _points = base + _header.point_offset;
+
+  // verify that the number of points match up
+  std::size_t realsize = 0;
+  if (byte_offset + _header.point_offset < _mapsize) realsize = (_mapsize - _header.point_offset - byte_offset)/_header.point_record_bytes;
+  if (_header.pt_count > realsize){
+    cout << "WARNING: byte count doesn't match up with reported point count" << endl;
+    cout << "WARNING: proceeding with calculated byte count" << endl;
+    _header.pt_count = realsize;
+  }
+
+  // check the version number and alert the user if it is not fully supported
+  if (_header.ver_minor > 4 || _header.ver_major > 1){
+    cout << "Some features of LAS version " << int(_header.ver_major) << "." << int(_header.ver_minor);
+    cout << " may not be supported" << endl;
+  }
+
+  read_vlrs(base);
+
+  // records are read once, front to back
+  madvise(_map, _mapsize, MADV_SEQUENTIAL);
+  guard.armed = false;
+}
+
+std::size_t LASExtraBytes::type_size(unsigned char data_type){
+  // types 11-20 and 21-30 are (deprecated) 2- and 3-arrays of types 1-10
+  static const std::size_t sizes[11] = {0, 1, 1, 2, 2, 4, 4, 8, 8, 4, 8};
+  if (data_type == 0 || data_type > 30) return 0;
+  return sizes[(data_type-1)%10 + 1]*((data_type-1)/10 + 1);
+}
+
+void LASFile::read_vlrs(const char * base){
+  // VLRs follow the public header block; each has a 54 byte header,
+  // and none may run into the point data or past the map
+  const char * end = std::min<const char *>(_points, _map + _mapsize);
+  const char * v = base + _header.header_size;
+  for (unsigned int i=0; i<_header.num_vlrs && v <= end && end - v >= 54; i++){
+    char user_id[17] = {0};
+    memcpy(user_id, v+2, 16);
+    unsigned short record_id = las_field<unsigned short>(v, 18);
+    unsigned short length = las_field<unsigned short>(v, 20);
+    const char * body = v + 54;
+    if (length > end - body) break;
+
+    // extra bytes descriptors are 192 bytes each, laid out in record order
+    if (strcmp(user_id, "LASF_Spec") == 0 && record_id == 4){
+      std::size_t offset = las_record_size(_header.point_format_id);
+      for (std::size_t k=0; k+192<=length; k+=192){
+        LASExtraBytes eb;
+        eb.data_type = las_field<unsigned char>(body+k, 2);
+        unsigned char options = las_field<unsigned char>(body+k, 3);
+        char name[33] = {0};
+        memcpy(name, body+k+4, 32);
+        eb.name = name;
+        eb.size = (eb.data_type == 0)? options : LASExtraBytes::type_size(eb.data_type);
+        eb.offset = offset;
+        offset += eb.size;
+        if (offset > _header.point_record_bytes) break;
+        _extra_bytes.push_back(eb);
+      }
+    }
+    v = body + length;
+  }
+}
+
+LASFile::~LASFile(){
+  if (_map != nullptr && _map != MAP_FAILED){
+    if (munmap(_map, _mapsize) < 0){
+      cout << "ruh roh! problem unmapping LAS file" << endl;
+    }
+  }
+  if (_fd >= 0) close(_fd);
+}
+
+bool LASFile::gpstime_present() const{
+  bool present = false;
+  dispatch([&](auto view){
+    present = las_format<typename decltype(view)::record_type>::has_gpstime;
+  });
+  return present;
+}
+
+bool LASFile::RGB_present() const{
+  bool present = false;
+  dispatch([&](auto view){
+    present = las_format<typename decltype(view)::record_type>::has_RGB;
+  });
+  return present;
+}
+
+
+
+void LASFile::decode_xyz(std::size_t begin, std::size_t end, double * x, double * y, double * z) const{
+  const double xs = _header.x_scale, ys = _header.y_scale, zs = _header.z_scale;
+  const double xo = _header.x_offset, yo = _header.y_offset, zo = _header.z_offset;
+
+  // read the raw integers through the base record type, which all
+  // formats share, so that the loop is the same for every format
+  LASRecordView<las_pt_0> view(_points, pointcount(), _header.point_record_bytes);
+  for (std::size_t i=begin; i<end; i++){
+    const las_pt_0 & p = view[i];
+    x[i-begin] = double(p.X)*xs + xo;
+    y[i-begin] = double(p.Y)*ys + yo;
+    z[i-begin] = double(p.Z)*zs + zo;
+  }
+}
+
+void LASFile::decode_raw_xyz(std::size_t begin, std::size_t end, int * X, int * Y, int * Z) const{
+  LASRecordView<las_pt_0> view(_points, pointcount(), _header.point_record_bytes);
+  for (std::size_t i=begin; i<end; i++){
+    const las_pt_0 & p = view[i];
+    X[i-begin] = p.X;
+    Y[i-begin] = p.Y;
+    Z[i-begin] = p.Z;
+  }
+}
+
+void LASFile::decode_intensity(std::size_t begin, std::size_t end, unsigned short * intensity) const{
+  LASRecordView<las_pt_0> view(_points, pointcount(), _header.point_record_bytes);
+  for (std::size_t i=begin; i<end; i++) intensity[i-begin] = view[i].Intensity;
+}
+
+void LASFile::decode_classification(std::size_t begin, std::size_t end, unsigned char * classification) const{
+  LASRecordView<las_pt_0> view(_points, pointcount(), _header.point_record_bytes);
+  for (std::size_t i=begin; i<end; i++) classification[i-begin] = view[i].Classification;
+}
+
+void LASFile::decode_return_info(std::size_t begin, std::size_t end, unsigned char * return_info) const{
+  LASRecordView<las_pt_0> view(_points, pointcount(), _header.point_record_bytes);
+  for (std::size_t i=begin; i<end; i++) return_info[i-begin] = view[i].Return_Info;
+}
+
+void LASFile::decode_gpstime(std::size_t begin, std::size_t end, double * gpstime) const{
+  dispatch([&](auto view){
+    typedef las_format<typename decltype(view)::record_type> format;
+    for (std::size_t i=begin; i<end; i++) gpstime[i-begin] = format::gpstime(view[i]);
+  });
+}
+
+void LASFile::decode_RGB(std::size_t begin, std::size_t end, rgb48 * RGB) const{
+  dispatch([&](auto view){
+    typedef las_format<typename decltype(view)::record_type> format;
+    for (std::size_t i=begin; i<end; i++) RGB[i-begin] = format::RGB(view[i]);
+  });
+}
+
+
+
+void LASFile::decode_extra_bytes(std::size_t k, std::size_t begin, std::size_t end, char * out) const{
+  const LASExtraBytes & eb = _extra_bytes.at(k);
+  const std::size_t stride = _header.point_record_bytes;
+  const char * src = _points + eb.offset;
+  switch (eb.size)
+  {
+    case 1: for (std::size_t i=begin; i<end; i++) out[i-begin] = src[i*stride]; break;
+    case 2: for (std::size_t i=begin; i<end; i++) memcpy(out + 2*(i-begin), src + i*stride, 2); break;
+    case 4: for (std::size_t i=begin; i<end; i++) memcpy(out + 4*(i-begin), src + i*stride, 4); break;
+    case 8: for (std::size_t i=begin; i<end; i++) memcpy(out + 8*(i-begin), src + i*stride, 8); break;
+    default: for (std::size_t i=begin; i<end; i++) memcpy(out + eb.size*(i-begin), src + i*stride, eb.size);
+  }
+}
+
+void LASFile::load_xyz() const{
+  if (_x.size() == pointcount() || pointcount() == 0) return;
+  _x.resize(pointcount());
+  _y.resize(pointcount());
+  _z.resize(pointcount());
+  decode_xyz(0, pointcount(), &_x.front(), &_y.front(), &_z.front());
+}
+
+const double & LASFile::x() const{
+  load_xyz();
+  return _x.front();
+}
+
+const double & LASFile::y() const{
+  load_xyz();
+  return _y.front();
+}
+
+const double & LASFile::z() const{
+  load_xyz();
+  return _z.front();
+}
+
+const unsigned short & LASFile::intensity() const{
+  if (_intensity.size() != pointcount()){
+    _intensity.resize(pointcount());
+    decode_intensity(0, pointcount(), &_intensity.front());
+  }
+  return _intensity.front();
+}
+
+const unsigned char & LASFile::classification() const{
+  if (_classification.size() != pointcount()){
+    _classification.resize(pointcount());
+    decode_classification(0, pointcount(), &_classification.front());
+  }
+  return _classification.front();
+}
+
+const double & LASFile::gpstime() const{
+  if (_gpstime.size() != pointcount()){
+    _gpstime.resize(pointcount());
+    decode_gpstime(0, pointcount(), &_gpstime.front());
+  }
+  return _gpstime.front();
+}
+
+const rgb48 & LASFile::RGB() const{
+  if (_RGB.size() != pointcount()){
+    _RGB.resize(pointcount());
+    decode_RGB(0, pointcount(), &_RGB.front());
+  }
+  return _RGB.front();
+}
+
+void LASFile::release_columns(){
+  vector<double>().swap(_x);
+  vector<double>().swap(_y);
+  vector<double>().swap(_z);
+  vector<double>().swap(_gpstime);
+  vector<unsigned short>().swap(_intensity);
+  vector<unsigned char>().swap(_classification);
+  vector<rgb48>().swap(_RGB);
+}
+
+void LASFile::release_records(std::size_t begin, std::size_t end) const{
+  // only whole pages inside the range can go
+  std::size_t page = sysconf(_SC_PAGESIZE);
+  std::size_t first = std::size_t(record(begin) - _map);
+  std::size_t last = std::size_t(record(end) - _map);
+  first = (first + page - 1)/page*page;
+  last = last/page*page;
+  if (last > first) madvise(_map + first, last - first, MADV_DONTNEED);
+}
+
+
+
+LASChunkReader::LASChunkReader(string filename, std::size_t chunk_size, const LASReadOptions & opts)
+: _las(filename), _chunk_size(chunk_size), _pos(0), _opts(opts){
+  if (_chunk_size == 0){
+    cout << "LASChunkReader: chunk size must be positive" << endl;
+    throw -1;
+  }
+}
+
+bool LASChunkReader::next(PointCloud & chunk){
+  if (_pos >= _las.pointcount()) return false;
+
+  std::size_t end = std::min(_pos + _chunk_size, _las.pointcount());
+  chunk.load_LAS(_las, _pos, end, _opts);
+  _las.release_records(_pos, end);
+  _pos = end;
+  return true;
+}
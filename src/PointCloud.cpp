@@ -10,20 +10,38 @@
 
 // and it should have the following functions (at least):
 //  - read LAS file (DONE)
-//  - write LAS file
-//  - read ascii delimited x,y,z,i,c
-//  - write ascii delimited x,y,z,i,c
+//  - write LAS file (DONE)
+//  - read ascii delimited x,y,z,i,c (DONE)
+//  - write ascii delimited x,y,z,i,c (DONE)
 //  - print a summary of data (DONE)
 //  - recalculate the x,y,z extents (DONE)
-//  - conversion to/from ECEF/latlon/UTM
+//  - conversion to/from ECEF/latlon/UTM (DONE)
 //  - create/destroy data vectors (DONE)
 #include "PointCloud.hpp"
+#include "LASFile.hpp"
+#include "SpaceFillingCurve.hpp"
+#include "Parallel.hpp"
+
+#include <atomic>
+#include <cmath>
+#if __cplusplus >= 201703L
+#include <charconv>
+#endif
 
 using namespace std;
 
+// free the storage of a column, keeping its allocator (and so
+// whether it is file-backed)
+template <class V>
+static void release_column(V & v){
+  V(v.get_allocator()).swap(v);
+}
+
 PointCloud::PointCloud(){
   _xmin = 0; _xmax = 0; _ymin = 0; _ymax = 0; _zmin = 0; _zmax = 0;
   _gpst_min = 0; _gpst_max = 0;
+  _quantized = false;
+  for (int d=0; d<3; d++) {_qscale[d] = 1.0; _qoffset[d] = 0.0;}
 }
 
 PointCloud::PointCloud(unsigned int numpts){
@@ -33,6 +51,8 @@ PointCloud::PointCloud(unsigned int numpts){
 
   _xmin = 0; _xmax = 0; _ymin = 0; _ymax = 0; _zmin = 0; _zmax = 0;
   _gpst_min = 0; _gpst_max = 0;
+  _quantized = false;
+  for (int d=0; d<3; d++) {_qscale[d] = 1.0; _qoffset[d] = 0.0;}
 }
 
 PointCloud::~PointCloud(){
@@ -49,9 +69,16 @@ PointCloud & PointCloud::operator=(const PointCloud & cloud){
   _gpstime = cloud._gpstime;
   _intensity = cloud._intensity;
   _classification = cloud._classification;
+  _return_info = cloud._return_info;
   _RGB = cloud._RGB;
-  _extradata_names = cloud._extradata_names;
-  _extradata = cloud._extradata;
+  _attributes = cloud._attributes;
+  _quantized = cloud._quantized;
+  _qx = cloud._qx;
+  _qy = cloud._qy;
+  _qz = cloud._qz;
+  for (int d=0; d<3; d++) {_qscale[d] = cloud._qscale[d]; _qoffset[d] = cloud._qoffset[d];}
+  _stats = cloud._stats;
+  _stats_valid = cloud._stats_valid;
 
   _xmin = cloud._xmin; _xmax = cloud._xmax;
    _ymin = cloud._ymin; _ymax = cloud._ymax;
@@ -62,29 +89,132 @@ PointCloud & PointCloud::operator=(const PointCloud & cloud){
 }
 
 PointCloud & PointCloud::operator+=(const PointCloud & cloud){
+  if (cloud.pointcount() == 0) return *this;
+  if (pointcount() == 0) return *this = cloud;
+
   // copy all the matching data and increment the pointcount
-  _x.insert(_x.end(), cloud._x.begin(), cloud._x.end());
-  _y.insert(_y.end(), cloud._y.begin(), cloud._y.end());
-  _z.insert(_z.end(), cloud._z.begin(), cloud._z.end());
-  if (cloud.gpstime_present() && gpstime_present()) _gpstime.insert(_gpstime.end(), cloud._gpstime.begin(), cloud._gpstime.end());
-  else cout << "WARNING: gpstime data is being lost through operator+=" << endl;
-  if (cloud.intensity_present() && intensity_present()) _intensity.insert(_intensity.end(), cloud._intensity.begin(), cloud._intensity.end());
-  else cout << "WARNING: intensity data is being lost through operator+=" << endl;
-  if (cloud.classification_present() && classification_present()) _classification.insert(_classification.end(), cloud._classification.begin(), cloud._classification.end());
-  else cout << "WARNING: classification data is being lost through operator+=" << endl;
-  if (cloud.RGB_present() && RGB_present()) _RGB.insert(_RGB.end(), cloud._RGB.begin(), cloud._RGB.end());
-  else cout << "WARNING: RGB data is being lost through operator+=" << endl;
-  for (auto i=0; i<cloud._extradata_names.size(); i++){
-    if (extradata_present(cloud._extradata_names.at(i))) _extradata.at(_extradata_names.at(i)).insert(_extradata.at(_extradata_names.at(i)).begin(), 
-                        cloud._extradata.at(_extradata_names.at(i)).begin(), cloud._extradata.at(_extradata_names.at(i)).end());
-    else cout << "WARNING: extradata " << cloud._extradata_names.at(i) << " data is being lost through operator+=" << endl;
+  drop_missing_fields(cloud, "operator+=");
+  append_points(cloud);
+  merge_extents(cloud);
+  return *this;
+}
+
+void PointCloud::merge(std::vector<PointCloud> && clouds){
+  // an empty cloud takes over the buffers of the first non-empty one
+  std::size_t first = 0;
+  if (pointcount() == 0){
+    while (first < clouds.size() && clouds[first].pointcount() == 0) first++;
+    if (first == clouds.size()) {clouds.clear(); return;}
+    *this = std::move(clouds[first++]);
   }
 
-  calc_extents();
-  return *this;
+  // only fields that every cloud has are kept, and the quantized grid
+  // only if every cloud is on it
+  std::size_t total = pointcount();
+  for (std::size_t i=first; i<clouds.size(); i++){
+    if (clouds[i].pointcount() == 0) continue;
+    total += clouds[i].pointcount();
+    drop_missing_fields(clouds[i], "merge");
+    bool same_grid = _quantized && clouds[i]._quantized;
+    for (int d=0; d<3; d++) same_grid = same_grid && _qscale[d] == clouds[i]._qscale[d] && _qoffset[d] == clouds[i]._qoffset[d];
+    if (_quantized && !same_grid) dequantize();
+  }
+
+  if (_quantized){
+    _qx.reserve(total); _qy.reserve(total); _qz.reserve(total);
+  }
+  else {
+    _x.reserve(total); _y.reserve(total); _z.reserve(total);
+  }
+  if (gpstime_present()) _gpstime.reserve(total);
+  if (intensity_present()) _intensity.reserve(total);
+  if (classification_present()) _classification.reserve(total);
+  if (return_info_present()) _return_info.reserve(total);
+  if (RGB_present()) _RGB.reserve(total);
+  _attributes.reserve(total);
+
+  for (std::size_t i=first; i<clouds.size(); i++){
+    if (clouds[i].pointcount() == 0) continue;
+    append_points(clouds[i]);
+    merge_extents(clouds[i]);
+    clouds[i] = PointCloud();
+  }
+  clouds.clear();
+}
+
+// drop the optional fields that cloud doesn't have, so that every
+// column still has one entry per point after appending it
+void PointCloud::drop_missing_fields(const PointCloud & cloud, const char * op){
+  if (gpstime_present() != cloud.gpstime_present()){
+    cout << "WARNING: gpstime data is being lost through " << op << endl;
+    _gpstime.clear();
+  }
+  if (intensity_present() != cloud.intensity_present()){
+    cout << "WARNING: intensity data is being lost through " << op << endl;
+    _intensity.clear();
+  }
+  if (classification_present() != cloud.classification_present()){
+    cout << "WARNING: classification data is being lost through " << op << endl;
+    _classification.clear();
+  }
+  if (return_info_present() != cloud.return_info_present()){
+    cout << "WARNING: return info is being lost through " << op << endl;
+    _return_info.clear();
+  }
+  if (RGB_present() != cloud.RGB_present()){
+    cout << "WARNING: RGB data is being lost through " << op << endl;
+    _RGB.clear();
+  }
+}
+
+// append the points of cloud to every column this cloud has
+void PointCloud::append_points(const PointCloud & cloud){
+  std::size_t n = pointcount(), m = cloud.pointcount();
+  bool same_grid = _quantized && cloud._quantized;
+  for (int d=0; d<3; d++) same_grid = same_grid && _qscale[d] == cloud._qscale[d] && _qoffset[d] == cloud._qoffset[d];
+  if (same_grid){
+    _qx.insert(_qx.end(), cloud._qx.begin(), cloud._qx.end());
+    _qy.insert(_qy.end(), cloud._qy.begin(), cloud._qy.end());
+    _qz.insert(_qz.end(), cloud._qz.begin(), cloud._qz.end());
+    _x.clear(); _y.clear(); _z.clear();
+  }
+  else {
+    // different grids: fall back to doubles
+    if (_quantized) dequantize();
+    _x.resize(n+m);
+    _y.resize(n+m);
+    _z.resize(n+m);
+    cloud.x(0, m, &_x[n]);
+    cloud.y(0, m, &_y[n]);
+    cloud.z(0, m, &_z[n]);
+  }
+  if (gpstime_present()) _gpstime.insert(_gpstime.end(), cloud._gpstime.begin(), cloud._gpstime.end());
+  if (intensity_present()) _intensity.insert(_intensity.end(), cloud._intensity.begin(), cloud._intensity.end());
+  if (classification_present()) _classification.insert(_classification.end(), cloud._classification.begin(), cloud._classification.end());
+  if (return_info_present()) _return_info.insert(_return_info.end(), cloud._return_info.begin(), cloud._return_info.end());
+  if (RGB_present()) _RGB.insert(_RGB.end(), cloud._RGB.begin(), cloud._RGB.end());
+  _attributes.resize(n);
+  _attributes.append(cloud._attributes);
+  _stats_valid = false;
+}
+
+// grow the cached extents by those of cloud
+void PointCloud::merge_extents(const PointCloud & cloud){
+  _xmin = std::min(_xmin, cloud._xmin); _xmax = std::max(_xmax, cloud._xmax);
+  _ymin = std::min(_ymin, cloud._ymin); _ymax = std::max(_ymax, cloud._ymax);
+  _zmin = std::min(_zmin, cloud._zmin); _zmax = std::max(_zmax, cloud._zmax);
+  if (gpstime_present()){
+    _gpst_min = std::min(_gpst_min, cloud._gpst_min);
+    _gpst_max = std::max(_gpst_max, cloud._gpst_max);
+  }
+}
+
+static void print_field_stats(const char * name, const FieldStats & f){
+  cout << "       " << name << ":[" << f.min << ", \t" << f.max << "] \tMean: " << f.mean << " \tStd dev: " << std::sqrt(f.variance) << endl;
 }
 
 void PointCloud::print_summary() const{
+  const PointCloudStats & st = stats();
   cout << " " << endl;
   cout << "********** Point Cloud Summary **********" << endl;
   cout << "  pointcount: " << pointcount() << endl;
@@ -94,17 +224,17 @@ void PointCloud::print_summary() const{
   if (gpstime_present()) cout << "                   gpstime" << endl;
   if (intensity_present()) cout << "                   intensity" << endl;
   if (classification_present()) cout << "                   classification" << endl;
+  if (return_info_present()) cout << "                   return info" << endl;
   if (RGB_present()) cout << "                   RGB" << endl;
-  if (_extradata.size() > 0){
-    for (unsigned int i=0; i<_extradata.size(); i++){
-      cout << "                   " << _extradata_names.at(i) << endl;
-    }
+  for (std::size_t k=0; k<_attributes.count(); k++){
+    cout << "                   " << _attributes.name(k) << endl;
   }
   cout << "  data extents:" << endl;
-  cout << "       x:[" << _xmin << ", \t" << _xmax << "]" << endl;
-  cout << "       y:[" << _ymin << ", \t" << _ymax << "]" << endl;
-  cout << "       z:[" << _zmin << ", \t" << _zmax << "]" << endl;
-  if (gpstime_present()) cout << "       gpstime:[" << _gpst_min << ", \t" << _gpst_max << "]" << endl;
+  print_field_stats("x", st.x);
+  print_field_stats("y", st.y);
+  print_field_stats("z", st.z);
+  if (gpstime_present()) print_field_stats("gpstime", st.gpstime);
+  if (intensity_present()) print_field_stats("intensity", st.intensity);
   cout << "******************************************" << endl;
   cout << " " << endl;
 
@@ -112,6 +242,7 @@ void PointCloud::print_summary() const{
 }
 
 void PointCloud::print_detailed() const{
+  const PointCloudStats & st = stats();
   cout << " " << endl;
   cout << "********** Point Cloud Details **********" << endl;
   cout << "  pointcount: " << pointcount() << endl;
@@ -121,46 +252,403 @@ void PointCloud::print_detailed() const{
   if (gpstime_present()) cout << "                   gpstime" << endl;
   if (intensity_present()) cout << "                   intensity" << endl;
   if (classification_present()) cout << "                   classification" << endl;
+  if (return_info_present()) cout << "                   return info" << endl;
   if (RGB_present()) cout << "                   RGB" << endl;
-  if (_extradata.size() > 0){
-    for (unsigned int i=0; i<_extradata.size(); i++){
-      cout << "                   " << _extradata_names.at(i) << endl;
-    }
+  for (std::size_t k=0; k<_attributes.count(); k++){
+    cout << "                   " << _attributes.name(k) << endl;
   }
   cout << "  data extents:" << endl;
-  cout << "       x:[" << _xmin << ", \t" << _xmax << "] \tRange: " << _xmax-_xmin << endl;
-  cout << "       y:[" << _ymin << ", \t" << _ymax << "] \tRange: " << _ymax-_ymin << endl;
-  cout << "       z:[" << _zmin << ", \t" << _zmax << "] \tRange: " << _zmax-_zmin << endl;
-  if (gpstime_present()) cout << "       gpstime:[" << _gpst_min << ", \t" << _gpst_max << "]   \t\t\tRange: " << _gpst_max-_gpst_min << endl;
+  cout << "       x:[" << st.x.min << ", \t" << st.x.max << "] \tRange: " << st.x.max-st.x.min << endl;
+  cout << "       y:[" << st.y.min << ", \t" << st.y.max << "] \tRange: " << st.y.max-st.y.min << endl;
+  cout << "       z:[" << st.z.min << ", \t" << st.z.max << "] \tRange: " << st.z.max-st.z.min << endl;
+  if (gpstime_present()) cout << "       gpstime:[" << st.gpstime.min << ", \t" << st.gpstime.max << "]   \t\t\tRange: " << st.gpstime.max-st.gpstime.min << endl;
+  cout << "  statistics:" << endl;
+  print_field_stats("x", st.x);
+  print_field_stats("y", st.y);
+  print_field_stats("z", st.z);
+  if (gpstime_present()) print_field_stats("gpstime", st.gpstime);
+  if (intensity_present()) print_field_stats("intensity", st.intensity);
+  if (classification_present()){
+    cout << "  points by classification:" << endl;
+    for (int c=0; c<256; c++){
+      if (st.classification_histogram[c] > 0) cout << "       " << c << ": \t" << st.classification_histogram[c] << endl;
+    }
+  }
+  if (return_info_present()){
+    cout << "  points by return number:" << endl;
+    for (int r=0; r<8; r++){
+      if (st.returns[r] > 0) cout << "       " << r << ": \t" << st.returns[r] << endl;
+    }
+  }
   cout << "******************************************" << endl;
   cout << " " << endl;
 
   return;
 }
 
+// min, max and the sums of v[i]-k and (v[i]-k)^2 over [b, e), added
+// to lo, hi, s1 and s2 (the shift keeps the sums of squares accurate
+// for coordinates far from the origin). Four independent lanes keep
+// the adds from waiting on each other
+template <class T>
+static void accumulate_moments(const T * v, std::size_t b, std::size_t e, double k,
+                               double & lo, double & hi, double & s1, double & s2){
+  double l[4] = {lo, lo, lo, lo}, h[4] = {hi, hi, hi, hi}, a[4] = {0, 0, 0, 0}, a2[4] = {0, 0, 0, 0};
+  std::size_t i = b;
+  for (; i+4<=e; i+=4){
+    for (int j=0; j<4; j++){
+      double d = double(v[i+j]);
+      l[j] = (d < l[j])? d : l[j];
+      h[j] = (d > h[j])? d : h[j];
+      a[j] += d - k;
+      a2[j] += (d - k)*(d - k);
+    }
+  }
+  for (; i<e; i++){
+    double d = double(v[i]);
+    l[0] = (d < l[0])? d : l[0];
+    h[0] = (d > h[0])? d : h[0];
+    a[0] += d - k;
+    a2[0] += (d - k)*(d - k);
+  }
+  lo = std::min(std::min(l[0], l[1]), std::min(l[2], l[3]));
+  hi = std::max(std::max(h[0], h[1]), std::max(h[2], h[3]));
+  s1 += (a[0] + a[1]) + (a[2] + a[3]);
+  s2 += (a2[0] + a2[1]) + (a2[2] + a2[3]);
+}
+
+// counts of the values of v over [b, e), added to hist. Runs of equal
+// values (classes, return numbers) are spread over four sub-histograms
+// so that consecutive increments don't hit the same counter
+template <class T>
+static void accumulate_histogram(const T * v, std::size_t b, std::size_t e, std::size_t * hist, std::uint32_t * sub){
+  const std::size_t bins = std::size_t(1) << (8*sizeof(T));
+  std::fill(sub, sub + 4*bins, 0);
+  std::size_t i = b;
+  for (; i+4<=e; i+=4){
+    sub[v[i]]++;
+    sub[bins + v[i+1]]++;
+    sub[2*bins + v[i+2]]++;
+    sub[3*bins + v[i+3]]++;
+  }
+  for (; i<e; i++) sub[v[i]]++;
+  for (std::size_t c=0; c<bins; c++) hist[c] += sub[c] + sub[bins+c] + sub[2*bins+c] + sub[3*bins+c];
+}
+
+template <class T>
+static void accumulate_range(const T * v, std::size_t b, std::size_t e, double & lo, double & hi){
+  double l = lo, h = hi;
+  for (std::size_t i=b; i<e; i++){
+    l = std::min(l, double(v[i]));
+    h = std::max(h, double(v[i]));
+  }
+  lo = l; hi = h;
+}
+
+const PointCloudStats & PointCloud::stats(unsigned int nthreads) const{
+  if (_stats_valid) return _stats;
+  std::size_t n = pointcount();
+  _stats = PointCloudStats();
+  _stats.count = n;
+  if (intensity_present()) _stats.intensity_histogram.assign(65536, 0);
+  if (classification_present()) _stats.classification_histogram.assign(256, 0);
+  if (n == 0) {_stats_valid = true; return _stats;}
+  if (nthreads == 0) nthreads = csg::default_threads();
+
+  // each thread sweeps its slice of every column block by block, so the
+  // whole reduction is one pass over memory. Fields 0-3 are x,y,z and
+  // gpstime; quantized coordinates are reduced as integers and scaled
+  // afterwards
+  const double * col[4] = {nullptr, nullptr, nullptr, gpstime_present()? &_gpstime.front() : nullptr};
+  const int * qcol[3] = {nullptr, nullptr, nullptr};
+  if (_quantized) {qcol[0] = &_qx.front(); qcol[1] = &_qy.front(); qcol[2] = &_qz.front();}
+  else {col[0] = &_x.front(); col[1] = &_y.front(); col[2] = &_z.front();}
+  double shift[4];
+  for (int f=0; f<4; f++) shift[f] = (f < 3 && _quantized)? qcol[f][0] : (col[f] != nullptr)? col[f][0] : 0.0;
+
+  struct partial{
+    double lo[4], hi[4], s1[4], s2[4];
+    std::vector<std::size_t> intensity, classification, return_info;
+  };
+  std::vector<partial> part(nthreads);
+  csg::parallel_for(n, nthreads, [&](std::size_t b, std::size_t e, unsigned int t){
+    partial & p = part[t];
+    for (int f=0; f<4; f++){
+      p.lo[f] = std::numeric_limits<double>::infinity();
+      p.hi[f] = -std::numeric_limits<double>::infinity();
+      p.s1[f] = p.s2[f] = 0.0;
+    }
+    if (intensity_present()) p.intensity.assign(65536, 0);
+    if (classification_present()) p.classification.assign(256, 0);
+    if (return_info_present()) p.return_info.assign(256, 0);
+
+    const std::size_t block = 4096;
+    std::vector<std::uint32_t> sub(4*256);
+    for (std::size_t s=b; s<e; s+=block){
+      std::size_t m = std::min(block, e-s);
+      for (int f=0; f<4; f++){
+        if (f < 3 && _quantized) accumulate_moments(qcol[f], s, s+m, shift[f], p.lo[f], p.hi[f], p.s1[f], p.s2[f]);
+        else if (col[f] != nullptr) accumulate_moments(col[f], s, s+m, shift[f], p.lo[f], p.hi[f], p.s1[f], p.s2[f]);
+      }
+      if (classification_present()) accumulate_histogram(&_classification.front(), s, s+m, &p.classification.front(), &sub.front());
+      if (return_info_present()) accumulate_histogram(&_return_info.front(), s, s+m, &p.return_info.front(), &sub.front());
+      if (intensity_present()) for (std::size_t i=s; i<s+m; i++) p.intensity[_intensity[i]]++;
+    }
+  });
+
+  // combine the threads (each has at least one point)
+  FieldStats * field[4] = {&_stats.x, &_stats.y, &_stats.z, &_stats.gpstime};
+  for (int f=0; f<4; f++){
+    double lo = part[0].lo[f], hi = part[0].hi[f], s1 = 0, s2 = 0;
+    for (unsigned int t=0; t<part.size() && t<n; t++){
+      lo = std::min(lo, part[t].lo[f]);
+      hi = std::max(hi, part[t].hi[f]);
+      s1 += part[t].s1[f];
+      s2 += part[t].s2[f];
+    }
+    double mean = s1/n;
+    FieldStats & fs = *field[f];
+    fs.min = lo; fs.max = hi;
+    fs.mean = shift[f] + mean;
+    fs.variance = std::max(0.0, s2/n - mean*mean);
+    if (f < 3 && _quantized){
+      fs.min = fs.min*_qscale[f] + _qoffset[f];
+      fs.max = fs.max*_qscale[f] + _qoffset[f];
+      fs.mean = fs.mean*_qscale[f] + _qoffset[f];
+      fs.variance *= _qscale[f]*_qscale[f];
+    }
+  }
+  if (!gpstime_present()) _stats.gpstime = FieldStats();
+
+  for (unsigned int t=0; t<part.size() && t<n; t++){
+    for (std::size_t c=0; c<part[t].intensity.size(); c++) _stats.intensity_histogram[c] += part[t].intensity[c];
+    for (std::size_t c=0; c<part[t].classification.size(); c++) _stats.classification_histogram[c] += part[t].classification[c];
+    for (std::size_t c=0; c<part[t].return_info.size(); c++) _stats.returns[c & 0x07] += part[t].return_info[c];
+  }
+
+  // intensity moments come exactly from its histogram
+  if (intensity_present()){
+    const std::vector<std::size_t> & h = _stats.intensity_histogram;
+    double s1 = 0, s2 = 0;
+    std::size_t lo = 65535, hi = 0;
+    for (std::size_t c=0; c<h.size(); c++){
+      if (h[c] == 0) continue;
+      lo = std::min(lo, c);
+      hi = std::max(hi, c);
+      s1 += double(h[c])*c;
+    }
+    double mean = s1/n;
+    for (std::size_t c=lo; c<=hi; c++) s2 += double(h[c])*(c - mean)*(c - mean);
+    _stats.intensity.min = lo;
+    _stats.intensity.max = hi;
+    _stats.intensity.mean = mean;
+    _stats.intensity.variance = s2/n;
+  }
+
+  _stats_valid = true;
+  return _stats;
+}
+
 void PointCloud::calc_extents(){
   if (pointcount()==0) return;
 
-  _xmin = *min_element(_x.begin(), _x.end());
-  _xmax = *max_element(_x.begin(), _x.end());
-  _ymin = *min_element(_y.begin(), _y.end());
-  _ymax = *max_element(_y.begin(), _y.end());
-  _zmin = *min_element(_z.begin(), _z.end());
-  _zmax = *max_element(_z.begin(), _z.end());
-  if (gpstime_present()) {
-    _gpst_min = *min_element(_gpstime.begin(), _gpstime.end());
-    _gpst_max = *max_element(_gpstime.begin(), _gpstime.end());
+  // the statistics already know the extents
+  if (_stats_valid){
+    _xmin = _stats.x.min; _xmax = _stats.x.max;
+    _ymin = _stats.y.min; _ymax = _stats.y.max;
+    _zmin = _stats.z.min; _zmax = _stats.z.max;
+    _gpst_min = _stats.gpstime.min; _gpst_max = _stats.gpstime.max;
+    return;
   }
 
+  // otherwise one parallel sweep of x,y,z and gpstime, finding the
+  // extremes of the integers for a quantized cloud (scales are
+  // positive, so the extremes of q are the extremes of x)
+  unsigned int nthreads = csg::default_threads();
+  std::size_t n = pointcount();
+  std::vector<double> lo(4*nthreads, std::numeric_limits<double>::infinity());
+  std::vector<double> hi(4*nthreads, -std::numeric_limits<double>::infinity());
+  csg::parallel_for(n, nthreads, [&](std::size_t b, std::size_t e, unsigned int t){
+    double * l = &lo[4*t], * h = &hi[4*t];
+    if (_quantized){
+      accumulate_range(&_qx.front(), b, e, l[0], h[0]);
+      accumulate_range(&_qy.front(), b, e, l[1], h[1]);
+      accumulate_range(&_qz.front(), b, e, l[2], h[2]);
+    }
+    else {
+      accumulate_range(&_x.front(), b, e, l[0], h[0]);
+      accumulate_range(&_y.front(), b, e, l[1], h[1]);
+      accumulate_range(&_z.front(), b, e, l[2], h[2]);
+    }
+    if (gpstime_present()) accumulate_range(&_gpstime.front(), b, e, l[3], h[3]);
+  });
+  for (unsigned int t=1; t<nthreads; t++){
+    for (int f=0; f<4; f++){
+      lo[f] = std::min(lo[f], lo[4*t+f]);
+      hi[f] = std::max(hi[f], hi[4*t+f]);
+    }
+  }
+
+  if (_quantized){
+    for (int d=0; d<3; d++){
+      lo[d] = lo[d]*_qscale[d] + _qoffset[d];
+      hi[d] = hi[d]*_qscale[d] + _qoffset[d];
+    }
+  }
+  _xmin = lo[0]; _xmax = hi[0];
+  _ymin = lo[1]; _ymax = hi[1];
+  _zmin = lo[2]; _zmax = hi[2];
+  if (gpstime_present()) {_gpst_min = lo[3]; _gpst_max = hi[3];}
+
   return;
 }
 
+// pick the finest decimal scale (down to 1e-9) that keeps the
+// quantized coordinate range inside int32, so that degrees keep
+// sub-millimetre precision and metres get as fine as their extent allows
+static void LAS_scale_offset(double lo, double hi, double & scale, double & offset){
+  static const double pow10[10] = {1e-9, 1e-8, 1e-7, 1e-6, 1e-5, 1e-4, 1e-3, 1e-2, 1e-1, 1e0};
+  offset = floor(lo);
+  int k = 0;
+  while (k < 9 && (hi - offset)/pow10[k] > 2.0e9) k++;
+  scale = pow10[k];
+  while ((hi - offset)/scale > 2.0e9) scale *= 10.0;
+}
+
+// LAS extra bytes data types that map onto attribute columns, and back
+static bool las_attribute_type(unsigned char data_type, AttributeType & type){
+  switch (data_type)
+  {
+    case 1: type = ATTR_UINT8; return true;
+    case 3: type = ATTR_UINT16; return true;
+    case 6: type = ATTR_INT32; return true;
+    case 9: type = ATTR_FLOAT; return true;
+    case 10: type = ATTR_DOUBLE; return true;
+  }
+  return false;
+}
+
+static unsigned char las_data_type(AttributeType type){
+  switch (type)
+  {
+    case ATTR_UINT8: return 1;
+    case ATTR_UINT16: return 3;
+    case ATTR_INT32: return 6;
+    case ATTR_FLOAT: return 9;
+    case ATTR_DOUBLE: return 10;
+  }
+  return 0;
+}
+
+void PointCloud::get_coords(int d, std::size_t begin, std::size_t end, double * out) const{
+  if (!_quantized){
+    const column<double> & v = (d == 0)? _x : (d == 1)? _y : _z;
+    std::copy(v.begin() + begin, v.begin() + end, out);
+    return;
+  }
+
+  // int -> double convert and multiply-add, which the compiler vectorizes
+  const int * q = (d == 0)? _qx.data() : (d == 1)? _qy.data() : _qz.data();
+  const double s = _qscale[d], o = _qoffset[d];
+  for (std::size_t i=begin; i<end; i++) out[i-begin] = q[i]*s + o;
+}
+
+void PointCloud::materialize_xyz() const{
+  if (_x.size() == _qx.size()) return;
+  _x.resize(_qx.size());
+  _y.resize(_qy.size());
+  _z.resize(_qz.size());
+  if (_qx.size() == 0) return;
+  get_coords(0, 0, _qx.size(), &_x.front());
+  get_coords(1, 0, _qy.size(), &_y.front());
+  get_coords(2, 0, _qz.size(), &_z.front());
+}
+
+void PointCloud::quantize(double scale){
+  if (_quantized) return;
+  calc_extents();
+
+  double lo[3] = {_xmin, _ymin, _zmin}, hi[3] = {_xmax, _ymax, _zmax};
+  for (int d=0; d<3; d++){
+    LAS_scale_offset(lo[d], hi[d], _qscale[d], _qoffset[d]);
+    if (scale > 0) _qscale[d] = scale;
+    if ((hi[d] - _qoffset[d])/_qscale[d] > 2147483647.0){
+      cout << "PointCloud: scale " << _qscale[d] << " overflows int32 for this extent" << endl;
+      throw -1;
+    }
+  }
+
+  std::size_t n = _x.size();
+  _qx.resize(n);
+  _qy.resize(n);
+  _qz.resize(n);
+  for (std::size_t i=0; i<n; i++){
+    _qx[i] = int(std::lround((_x[i] - _qoffset[0])/_qscale[0]));
+    _qy[i] = int(std::lround((_y[i] - _qoffset[1])/_qscale[1]));
+    _qz[i] = int(std::lround((_z[i] - _qoffset[2])/_qscale[2]));
+  }
+  release_column(_x);
+  release_column(_y);
+  release_column(_z);
+  _quantized = true;
+  _stats_valid = false;
+  calc_extents();
+}
+
+void PointCloud::dequantize(){
+  if (!_quantized) return;
+  materialize_xyz();
+  release_column(_qx);
+  release_column(_qy);
+  release_column(_qz);
+  _quantized = false;
+}
+
+// copy a column into storage of the other kind
+template <class V>
+static void remap_column(V & v, bool mapped){
+  if (v.get_allocator().file_backed == mapped) return;
+  V w(v.begin(), v.end(), typename V::allocator_type(mapped));
+  v.swap(w);
+}
+
+void PointCloud::set_mapped(bool mapped){
+  remap_column(_x, mapped);
+  remap_column(_y, mapped);
+  remap_column(_z, mapped);
+  remap_column(_qx, mapped);
+  remap_column(_qy, mapped);
+  remap_column(_qz, mapped);
+  remap_column(_gpstime, mapped);
+  remap_column(_intensity, mapped);
+  remap_column(_classification, mapped);
+  remap_column(_return_info, mapped);
+  remap_column(_RGB, mapped);
+  _attributes.set_mapped(mapped);
+}
+
+void PointCloud::advise(csg::MappedAdvice advice) const{
+  csg::mapped::advise(_x.data(), advice);
+  csg::mapped::advise(_y.data(), advice);
+  csg::mapped::advise(_z.data(), advice);
+  csg::mapped::advise(_qx.data(), advice);
+  csg::mapped::advise(_qy.data(), advice);
+  csg::mapped::advise(_qz.data(), advice);
+  csg::mapped::advise(_gpstime.data(), advice);
+  csg::mapped::advise(_intensity.data(), advice);
+  csg::mapped::advise(_classification.data(), advice);
+  csg::mapped::advise(_return_info.data(), advice);
+  csg::mapped::advise(_RGB.data(), advice);
+  _attributes.advise(advice);
+}
+
 void PointCloud::add_intensity(){
   /*if (intensity != NULL) cout << "intensity already exists!" << endl;
   else intensity = new unsigned short[_pointcount];
   */
   if (intensity_present()) return;
   _intensity.resize(pointcount(), 0);
+  _stats_valid = false;
 }
 
 void PointCloud::add_classification(){
@@ -169,6 +657,13 @@ void PointCloud::add_classification(){
   */
   if (classification_present()) return;
   _classification.resize(pointcount(), 0);
+  _stats_valid = false;
+}
+
+void PointCloud::add_return_info(){
+  if (return_info_present()) return;
+  _return_info.resize(pointcount(), 0x09);    // return 1 of 1
+  _stats_valid = false;
 }
 
 void PointCloud::add_gpstime(){
@@ -178,6 +673,7 @@ void PointCloud::add_gpstime(){
   */
   if (gpstime_present()) return;
   _gpstime.resize(pointcount(), 0.0);
+  _stats_valid = false;
 }
 
 void PointCloud::add_RGB(){
@@ -198,464 +694,1084 @@ void PointCloud::add_extradata(std::string fieldname){
     cout << fieldname << " is already present in the extra data!" << endl;
     return;
   }
-  _extradata[fieldname] = {};
-  _extradata[fieldname].resize(pointcount(), 0.0);
+  _attributes.resize(pointcount());
+  _attributes.add<double>(fieldname);
 }
 
 
 
-PointCloud PointCloud::read_LAS(string filename, unsigned int byte_offset){
+PointCloud PointCloud::read_LAS(string filename, unsigned int byte_offset, unsigned int nthreads){
   PointCloud cloud = PointCloud();
-  cloud.read_LAS_internal(filename, byte_offset);
+  cloud.read_LAS_internal(filename, byte_offset, nthreads);
   return cloud;
 }
 
-void PointCloud::read_LAS_internal(string filename, unsigned int byte_offset){
+void PointCloud::read_LAS_internal(string filename, unsigned int byte_offset, unsigned int nthreads){
+  LASFile las(filename, byte_offset);
+  LASReadOptions opts;
+  opts.nthreads = nthreads;
+  read_LAS_internal(las, opts);
+}
+
+PointCloud PointCloud::read_LAS(const LASFile & las, unsigned int nthreads){
+  LASReadOptions opts;
+  opts.nthreads = nthreads;
+  return read_LAS(las, opts);
+}
+
+PointCloud PointCloud::read_LAS(string filename, const LASReadOptions & opts, unsigned int byte_offset){
+  LASFile las(filename, byte_offset);
+  return read_LAS(las, opts);
+}
+
+PointCloud PointCloud::read_LAS(const LASFile & las, const LASReadOptions & opts){
+  PointCloud cloud = PointCloud();
+  cloud.read_LAS_internal(las, opts);
+  return cloud;
+}
+
+void PointCloud::read_LAS_internal(const LASFile & las, const LASReadOptions & opts){
   // define vars
   bool fieldexist=false;
-  char signature[4];
-  unsigned char ver_major, ver_minor, point_format_id, dummy_1;
-  unsigned short header_size, point_record_bytes, dummy_2;
-  unsigned int point_offset, dummy_4;
-  unsigned int pt_count;
-  double x_scale, y_scale, z_scale, x_offset, y_offset, z_offset;
-  double x_min, y_min, z_min, x_max, y_max, z_max, dummy_8;
-  int fd;
-  char * lasmap;
-  size_t res;
-
-  // open the file
-  FILE * fid;
-  fid = fopen(filename.c_str(), "rb");
-
-  // do a size check
-  fseek(fid, 0L, SEEK_END);
-  size_t sz = ftell(fid);
-  fseek(fid, 0L, SEEK_SET);
-  //cout << "the file is " << sz << " bytes long" << endl;
-  
-  // move to byte_offset
-  fseek(fid, byte_offset, SEEK_SET);
-
-  // check LASF signature
-  res = fread(&signature, 4, 1, fid); // "LASF" signature
-
-  //cout << "signature: " << signature[0] << signature[1] << signature[2] << signature[3] << endl;
-
-  // collect header info
-  res = fread(&dummy_2, 2, 1, fid);     // File Source ID
-  res = fread(&dummy_2, 2, 1, fid);     // Global Encoding
-  res = fread(&dummy_4, 4, 1, fid);     // Project ID - GUID data 1
-  res = fread(&dummy_2, 2, 1, fid);     // Project ID - GUID data 2
-  res = fread(&dummy_2, 2, 1, fid);     // Project ID - GUID data 3
-  res = fread(&dummy_8, 8, 1, fid);     // Project ID - GUID data 4
-  res = fread(&ver_major, 1, 1, fid);   // Version Major
-  res = fread(&ver_minor, 1, 1, fid);   // Version Minor
-  for (int i=0; i<32; i++) res = fread(&dummy_1, 1, 1, fid); // System Identifier
-  for (int i=0; i<32; i++) res = fread(&dummy_1, 1, 1, fid); // Generating Software
-  res = fread(&dummy_2, 2, 1, fid);     // File Creation Day of Year
-  res = fread(&dummy_2, 2, 1, fid);     // File Creation Year
-  res = fread(&header_size, 2, 1, fid); // Header Size
-  res = fread(&point_offset, 4, 1, fid);// Offset to Point Data
-  res = fread(&dummy_4, 4, 1, fid);     // Number of Variable Length Records
-  res = fread(&point_format_id, 1, 1, fid); // Point Data Format ID
-  res = fread(&point_record_bytes, 2, 1, fid);  // Point Data Record Length
-  res = fread(&pt_count, 4, 1, fid);    // Number of point records
-  for (int i=0; i<5; i++) res = fread(&dummy_4, 4, 1, fid); // Number of points by return
-  if (ver_minor > 2) res = fread(&dummy_8, 8, 1, fid); // extra points by return 
-  res = fread(&x_scale, 8, 1, fid);     // X Scale Factor
-  res = fread(&y_scale, 8, 1, fid);     // Y Scale Factor
-  res = fread(&z_scale, 8, 1, fid);     // Z Scale Factor
-  res = fread(&x_offset, 8, 1, fid);    // X Offset
-  res = fread(&y_offset, 8, 1, fid);    // Y Offset
-  res = fread(&z_offset, 8, 1, fid);    // Z Offset
-  res = fread(&x_max, 8, 1, fid);       // X Max
-  res = fread(&x_min, 8, 1, fid);       // X Min
-  res = fread(&y_max, 8, 1, fid);       // Y Max
-  res = fread(&y_min, 8, 1, fid);       // Y Min
-  res = fread(&z_max, 8, 1, fid);       // Z Max
-  res = fread(&z_min, 8, 1, fid);       // Z Min
-
-  // verify that the number of points match up
-  //cout << "we have mapped" << point_offset + point_record_bytes*pt_count << " bytes" << endl;
-  //cout << "the file should have " << (sz-point_offset)/point_record_bytes << " points" << endl;
-  unsigned int realsize = (sz-point_offset - byte_offset)/point_record_bytes;
-  if (pt_count > realsize){
-    cout << "WARNING: byte count doesn't match up with reported point count" << endl;
-    cout << "WARNING: proceeding with calculated byte count" << endl;
-    pt_count = realsize;
-  }
-
-  // read projection info from Variable Length Records (VLRs)
-
-  // close the file
-  fclose(fid);
-
-  // check the version number and alert the user if it is not fully supported
-  if (ver_minor > 2 || ver_major > 1){
-    cout << "Some features of LAS version " << ver_major << "." << ver_minor ;
-    cout << " may not be supported" << endl;
-  }
-
-  // check the record format number and alert the user if it is not supported
-  if (point_format_id > 3){
-    cout << "Some features of point format " << point_format_id ;
-    cout << " may not be supported" << endl;
-  }
-  if (point_format_id > 5){
-    cout << "Point format " << point_format_id << " is not supported" << endl;
-    throw -1;
-  }
 
-  /*
-  cout << "LAS version " << int(ver_major) << "." << int(ver_minor) << endl;
-  cout << "point format id: " << int(point_format_id) << endl;
-  cout << "bytes in point record: " << point_record_bytes << endl;
-  cout << "pointcount: " << pt_count << endl;
-  cout << "point offset: " << point_offset << endl;
-  cout << "xoffset: " << x_offset << " yoffset:" << y_offset << " zoffset:" << z_offset << endl;
-  cout << "xscale: " << x_scale << " yscale:" << y_scale << " zscale:" << z_scale << endl;
-  cout << "xmax: " << x_max << " xmin: " << x_min << endl;
-  cout << "ymax: " << y_max << " ymin: " << y_min << endl;
-  cout << "zmax: " << z_max << " zmin: " << z_min << endl;
-  */
+  // decode straight out of the memory map into the columns
+  decode_LAS(las, 0, las.pointcount(), opts);
+  std::size_t pt_count = pointcount();
+  if (pt_count == 0) return;
 
-  // memory map the point data
-  fd = open(filename.c_str(), O_RDONLY);
-  if (fd < 0){
-    cout << "Error opening file in readLas" << endl;
-    throw -1;
+  // check to see intensity and classification contain actual info
+  for (unsigned int i=0; i<_intensity.size(); i++){
+    if (_intensity[i] != 0) {
+      fieldexist = true;
+      break;
+    }
   }
-  lseek(fd, byte_offset, SEEK_SET);
-  lasmap = (char *)mmap(NULL, point_offset + point_record_bytes*pt_count, PROT_READ, MAP_PRIVATE, fd, 0);
-  if (lasmap == MAP_FAILED){
-    cout << "Failed to map las file" << endl;
-    throw -1;
-  }  
-
-  // initialize some stuff
-  _x.resize(pt_count, 0.0);
-  _y.resize(pt_count, 0.0);
-  _z.resize(pt_count, 0.0);
-  add_intensity();
-  add_classification();
-  _xmin = x_min;
-  _xmax = x_max;
-  _ymin = y_min;
-  _ymax = y_max;
-  _zmin = z_min;
-  _zmax = z_max;
-
-
-  // do a switch for point record format and memcpy the points
-  switch (point_format_id)
-  {
-    case 0:
-      // initialize array of structs
-      las_pt_0 *laspts0;
-      laspts0 = new las_pt_0[pt_count];
-
-      //cout << "about to memcpy " << sizeof(las_pt_0)*pt_count << " " << " " << point_record_bytes*pt_count << endl;
-
-      // copy from memory map into array of structs
-      memcpy(laspts0, &lasmap[point_offset], point_record_bytes*pt_count);
-
-      //cout << "about to extract points" << endl;
-      // loop over structs to extract the points
-      for (unsigned int i=0; i<pt_count; i++){
-        _x[i] = double(laspts0[i].X)*x_scale + x_offset;    // X
-        _y[i] = double(laspts0[i].Y)*y_scale + y_offset;    // Y
-        _z[i] = double(laspts0[i].Z)*z_scale + z_offset;    // Z
-        _intensity[i] = laspts0[i].Intensity;     // Intensity
-        _classification[i] = laspts0[i].Classification;   // Classification
-      }
-
-      delete[] laspts0;
-      //cout << "successfully deleted" << endl;
+  if (!fieldexist && intensity_present()){
+    cout << "clearing intensity" << endl;
+    _intensity.clear();
+  }
+  fieldexist = false;
+  for (unsigned int i=0; i<_classification.size(); i++){
+    if (_classification[i] != 0) {
+      fieldexist = true;
       break;
+    }
+  }
+  if (!fieldexist && classification_present()){
+    cout << "clearing classification" << endl;
+    _classification.clear();
+  }
 
-    case 1:
-      // initialize array of structs
-      las_pt_1 *laspts1;
-      laspts1 = new las_pt_1[pt_count];
-
-      // copy from memory map into array of structs
-      memcpy(laspts1, &lasmap[point_offset-1], point_record_bytes*pt_count);
-
-      add_gpstime();
-      // loop over structs to extract the points
-      for (unsigned int i=0; i<pt_count; i++){
-        _x[i] = double(laspts1[i].X)*x_scale + x_offset;    // X
-        _y[i] = double(laspts1[i].Y)*y_scale + y_offset;    // Y
-        _z[i] = double(laspts1[i].Z)*z_scale + z_offset;    // Z
-        _intensity[i] = laspts1[i].Intensity;                // Intensity
-        _classification[i] = laspts1[i].Classification;      // Classification
-        _gpstime[i] = laspts1[i].GPSTime;
-      }
-      _gpst_min = _gpstime[0];
-      _gpst_max = _gpstime[pt_count-1];
+  return;
+}
 
-      delete[] laspts1;
-      break;
 
-    case 2:
-      // initialize array of structs
-      las_pt_2 *laspts2;
-      laspts2 = new las_pt_2[pt_count];
-
-      //cout << "about to memcpy" << sizeof(las_pt_2)*pt_count << " " << " " << point_record_bytes*pt_count << endl;
-      // copy from memory map into array of structs
-      memcpy(laspts2, &lasmap[point_offset], point_record_bytes*pt_count);
-
-      //cout << "about to copy stuff" << endl;
-      add_RGB();
-      // loop over structs to extract the points
-      for (unsigned int i=0; i<pt_count; i++){
-        _x[i] = double(laspts2[i].X)*x_scale + x_offset;    // X
-        _y[i] = double(laspts2[i].Y)*y_scale + y_offset;    // Y
-        _z[i] = double(laspts2[i].Z)*z_scale + z_offset;    // Z
-        _intensity[i] = laspts2[i].Intensity;                // Intensity
-        _classification[i] = laspts2[i].Classification;      // Classification
-        _RGB[i].R = laspts2[i].Red;
-        _RGB[i].G = laspts2[i].Green;
-        _RGB[i].B = laspts2[i].Blue;
-      }
+void PointCloud::load_LAS(const LASFile & las, std::size_t begin, std::size_t end, unsigned int nthreads){
+  LASReadOptions opts;
+  opts.nthreads = nthreads;
+  opts.quantized = _quantized;
+  opts.mapped = mapped();
+  decode_LAS(las, begin, end, opts);
+}
 
-      delete[] laspts2;
-      break;
+void PointCloud::load_LAS(const LASFile & las, std::size_t begin, std::size_t end, const LASReadOptions & opts){
+  decode_LAS(las, begin, end, opts);
+}
 
-    case 3:
-      // initialize array of structs
-      las_pt_3 *laspts3;
-      laspts3 = new las_pt_3[pt_count];
-
-      // copy from memory map into array of structs
-      memcpy(laspts3, &lasmap[point_offset-1], point_record_bytes*pt_count);
-
-      add_gpstime();
-      add_RGB();
-      // loop over structs to extract the points
-      for (unsigned int i=0; i<pt_count; i++){
-        _x[i] = double(laspts3[i].X)*x_scale + x_offset;    // X
-        _y[i] = double(laspts3[i].Y)*y_scale + y_offset;    // Y
-        _z[i] = double(laspts3[i].Z)*z_scale + z_offset;    // Z
-        _intensity[i] = laspts3[i].Intensity;                // Intensity
-        _classification[i] = laspts3[i].Classification;      // Classification
-        _gpstime[i] = laspts3[i].GPSTime;
-        _RGB[i].R = laspts3[i].Red;
-        _RGB[i].G = laspts3[i].Green;
-        _RGB[i].B = laspts3[i].Blue;
-      }
-      _gpst_min = _gpstime[0];
-      _gpst_max = _gpstime[pt_count-1];
+void PointCloud::decode_LAS(const LASFile & las, std::size_t begin, std::size_t end, const LASReadOptions & opts){
+  std::size_t n = end - begin;
+  if (end > las.pointcount() || begin > end){
+    cout << "PointCloud: record range [" << begin << ", " << end << ") is outside of " << las.filename() << endl;
+    throw -1;
+  }
+  if (opts.use_time && !las.gpstime_present()){
+    cout << "PointCloud: time range filter on " << las.filename() << ", which has no gpstime" << endl;
+    throw -1;
+  }
 
-      delete[] laspts3;
-      break;
+  bool filtered = opts.use_box || opts.use_time;
+  bool has_intensity = opts.intensity;
+  bool has_classification = opts.classification;
+  bool has_return_info = opts.return_info;
+  bool has_gpstime = opts.gpstime && las.gpstime_present();
+  bool has_RGB = opts.RGB && las.RGB_present();
+  unsigned int nthreads = (opts.nthreads == 0)? csg::default_threads() : opts.nthreads;
+  _quantized = opts.quantized;
+  _stats_valid = false;
+  set_mapped(opts.mapped);
+
+  // with a predicate, a first pass flags and counts the survivors of
+  // each thread's slice, so that the columns are sized exactly and
+  // every thread knows where its survivors go
+  std::vector<unsigned char> keep;
+  std::vector<std::size_t> offsets(nthreads+1, 0);
+  if (filtered){
+    keep.resize(n);
+    const csg::Box<3> & bx = opts.box;
+    csg::parallel_for(n, nthreads, [&](std::size_t b, std::size_t e, unsigned int t){
+      const std::size_t block = 1024;
+      double x[block], y[block], z[block], gpst[block];
+      std::size_t count = 0;
+      for (std::size_t s=b; s<e; s+=block){
+        std::size_t m = std::min(block, e-s);
+        las.decode_xyz(begin+s, begin+s+m, x, y, z);
+        if (opts.use_time) las.decode_gpstime(begin+s, begin+s+m, gpst);
+        for (std::size_t i=0; i<m; i++){
+          bool in = true;
+          if (opts.use_box) in = x[i] >= bx.lo.x[0] && x[i] <= bx.hi.x[0]
+                              && y[i] >= bx.lo.x[1] && y[i] <= bx.hi.x[1]
+                              && z[i] >= bx.lo.x[2] && z[i] <= bx.hi.x[2];
+          if (opts.use_time) in = in && gpst[i] >= opts.time_min && gpst[i] <= opts.time_max;
+          keep[s+i] = in;
+          count += in;
+        }
+      }
+      offsets[t+1] = count;
+    });
+  }
+  else {
+    csg::parallel_for(n, nthreads, [&](std::size_t b, std::size_t e, unsigned int t){
+      offsets[t+1] = e-b;
+    });
+  }
+  for (unsigned int t=0; t<nthreads; t++) offsets[t+1] += offsets[t];
+  std::size_t n_out = offsets[nthreads];
+
+  // resizing keeps the capacity, so a cloud reused for
+  // successive ranges of a file stops allocating after the first.
+  // A quantized cloud keeps the file's integers and scale/offset
+  if (_quantized){
+    _qx.resize(n_out);
+    _qy.resize(n_out);
+    _qz.resize(n_out);
+    _x.clear(); _y.clear(); _z.clear();
+    const LASHeader & hdr = las.header();
+    _qscale[0] = hdr.x_scale; _qscale[1] = hdr.y_scale; _qscale[2] = hdr.z_scale;
+    _qoffset[0] = hdr.x_offset; _qoffset[1] = hdr.y_offset; _qoffset[2] = hdr.z_offset;
+  }
+  else {
+    _x.resize(n_out);
+    _y.resize(n_out);
+    _z.resize(n_out);
+    _qx.clear(); _qy.clear(); _qz.clear();
+  }
+  if (has_intensity) _intensity.resize(n_out);
+  else _intensity.clear();
+  if (has_classification) _classification.resize(n_out);
+  else _classification.clear();
+  if (has_return_info) _return_info.resize(n_out);
+  else _return_info.clear();
+  if (has_gpstime) _gpstime.resize(n_out);
+  else _gpstime.clear();
+  if (has_RGB) _RGB.resize(n_out);
+  else _RGB.clear();
+  // extra bytes of a supported type become attribute columns
+  std::vector<std::size_t> extra;   // extra bytes index of each column
+  _attributes.clear();
+  if (opts.extra_bytes){
+    for (std::size_t k=0; k<las.extra_bytes().size(); k++){
+      AttributeType type;
+      if (!las_attribute_type(las.extra_bytes()[k].data_type, type)) continue;
+      if (_attributes.present(las.extra_bytes()[k].name)) continue;
+      _attributes.add(las.extra_bytes()[k].name, type);
+      extra.push_back(k);
+    }
+  }
+  _attributes.resize(n_out);
+  _xmin = 0; _xmax = 0; _ymin = 0; _ymax = 0; _zmin = 0; _zmax = 0;
+  _gpst_min = 0; _gpst_max = 0;
+  if (n_out == 0) return;
+
+  // records are fixed size, so each thread decodes its own slice of
+  // the range directly into the columns and finds that slice's extents
+  struct extents {double xmin, xmax, ymin, ymax, zmin, zmax, tmin, tmax;};
+  std::vector<extents> ext(nthreads);
+
+  // decode the records [rb, re) of the range into the columns at o
+  auto decode_run = [&](std::size_t rb, std::size_t re, std::size_t o){
+    if (_quantized) las.decode_raw_xyz(begin+rb, begin+re, &_qx[o], &_qy[o], &_qz[o]);
+    else las.decode_xyz(begin+rb, begin+re, &_x[o], &_y[o], &_z[o]);
+    if (has_intensity) las.decode_intensity(begin+rb, begin+re, &_intensity[o]);
+    if (has_classification) las.decode_classification(begin+rb, begin+re, &_classification[o]);
+    if (has_return_info) las.decode_return_info(begin+rb, begin+re, &_return_info[o]);
+    if (has_gpstime) las.decode_gpstime(begin+rb, begin+re, &_gpstime[o]);
+    if (has_RGB) las.decode_RGB(begin+rb, begin+re, &_RGB[o]);
+    for (std::size_t k=0; k<extra.size(); k++){
+      las.decode_extra_bytes(extra[k], begin+rb, begin+re, _attributes.bytes(k) + o*attribute_size(_attributes.type(k)));
+    }
+  };
+
+  csg::parallel_for(n, nthreads, [&](std::size_t b, std::size_t e, unsigned int t){
+    std::size_t o = offsets[t];
+    if (!filtered) decode_run(b, e, o);
+    else {
+      // survivors are decoded in runs of consecutive records
+      std::size_t i = b;
+      while (i < e){
+        while (i < e && !keep[i]) i++;
+        std::size_t rb = i;
+        while (i < e && keep[i]) i++;
+        if (i > rb) decode_run(rb, i, o);
+        o += i - rb;
+      }
+    }
 
-    case 4:
-      // initialize array of structs
-      las_pt_4 *laspts4;
-      laspts4 = new las_pt_4[pt_count];
-
-      // copy from memory map into array of structs
-      memcpy(laspts4, &lasmap[point_offset-1], point_record_bytes*pt_count);
-
-      add_gpstime();
-      // loop over structs to extract the points
-      for (unsigned int i=0; i<pt_count; i++){
-        _x[i] = double(laspts4[i].X)*x_scale + x_offset;    // X
-        _y[i] = double(laspts4[i].Y)*y_scale + y_offset;    // Y
-        _z[i] = double(laspts4[i].Z)*z_scale + z_offset;    // Z
-        _intensity[i] = laspts4[i].Intensity;                // Intensity
-        _classification[i] = laspts4[i].Classification;      // Classification
-        _gpstime[i] = laspts4[i].GPSTime;
+    extents & ex = ext[t];
+    ex.xmin = ex.ymin = ex.zmin = ex.tmin = std::numeric_limits<double>::max();
+    ex.xmax = ex.ymax = ex.zmax = ex.tmax = std::numeric_limits<double>::lowest();
+    std::size_t ob = offsets[t], oe = offsets[t+1];
+    if (_quantized){
+      for (std::size_t i=ob; i<oe; i++){
+        ex.xmin = std::min(ex.xmin, double(_qx[i])); ex.xmax = std::max(ex.xmax, double(_qx[i]));
+        ex.ymin = std::min(ex.ymin, double(_qy[i])); ex.ymax = std::max(ex.ymax, double(_qy[i]));
+        ex.zmin = std::min(ex.zmin, double(_qz[i])); ex.zmax = std::max(ex.zmax, double(_qz[i]));
       }
-      _gpst_min = _gpstime[0];
-      _gpst_max = _gpstime[pt_count-1];
+    }
+    else {
+      for (std::size_t i=ob; i<oe; i++){
+        ex.xmin = std::min(ex.xmin, _x[i]); ex.xmax = std::max(ex.xmax, _x[i]);
+        ex.ymin = std::min(ex.ymin, _y[i]); ex.ymax = std::max(ex.ymax, _y[i]);
+        ex.zmin = std::min(ex.zmin, _z[i]); ex.zmax = std::max(ex.zmax, _z[i]);
+      }
+    }
+    if (has_gpstime){
+      for (std::size_t i=ob; i<oe; i++){
+        ex.tmin = std::min(ex.tmin, _gpstime[i]); ex.tmax = std::max(ex.tmax, _gpstime[i]);
+      }
+    }
+  });
+
+  // merge the extents (threads without survivors contribute nothing)
+  _xmin = _ymin = _zmin = _gpst_min = std::numeric_limits<double>::max();
+  _xmax = _ymax = _zmax = _gpst_max = std::numeric_limits<double>::lowest();
+  for (unsigned int t=0; t<nthreads; t++){
+    if (offsets[t+1] == offsets[t]) continue;
+    _xmin = std::min(_xmin, ext[t].xmin); _xmax = std::max(_xmax, ext[t].xmax);
+    _ymin = std::min(_ymin, ext[t].ymin); _ymax = std::max(_ymax, ext[t].ymax);
+    _zmin = std::min(_zmin, ext[t].zmin); _zmax = std::max(_zmax, ext[t].zmax);
+    _gpst_min = std::min(_gpst_min, ext[t].tmin); _gpst_max = std::max(_gpst_max, ext[t].tmax);
+  }
+  if (!has_gpstime){_gpst_min = 0; _gpst_max = 0;}
+  if (_quantized){
+    _xmin = _xmin*_qscale[0] + _qoffset[0]; _xmax = _xmax*_qscale[0] + _qoffset[0];
+    _ymin = _ymin*_qscale[1] + _qoffset[1]; _ymax = _ymax*_qscale[1] + _qoffset[1];
+    _zmin = _zmin*_qscale[2] + _qoffset[2]; _zmax = _zmax*_qscale[2] + _qoffset[2];
+  }
+}
 
-      delete[] laspts4;
-      break;
+void PointCloud::stream_LAS(string filename, std::function<void(PointCloud & chunk, std::size_t first)> fn, std::size_t chunk_size, const LASReadOptions & opts){
+  LASChunkReader reader(filename, chunk_size, opts);
+  PointCloud chunk;
+  std::size_t first = reader.position();
+  while (reader.next(chunk)){
+    fn(chunk, first);
+    first = reader.position();
+  }
+}
 
-    case 5:
-      // initialize array of structs
-      las_pt_5 *laspts5;
-      laspts5 = new las_pt_5[pt_count];
-
-      // copy from memory map into array of structs
-      memcpy(laspts5, &lasmap[point_offset-1], point_record_bytes*pt_count);
-
-      add_gpstime();
-      add_RGB();
-      // loop over structs to extract the points
-      for (unsigned int i=0; i<pt_count; i++){
-        _x[i] = double(laspts5[i].X)*x_scale + x_offset;    // X
-        _y[i] = double(laspts5[i].Y)*y_scale + y_offset;    // Y
-        _z[i] = double(laspts5[i].Z)*z_scale + z_offset;    // Z
-        _intensity[i] = laspts5[i].Intensity;                // Intensity
-        _classification[i] = laspts5[i].Classification;      // Classification
-        _gpstime[i] = laspts5[i].GPSTime;
-        _RGB[i].R = laspts5[i].Red;
-        _RGB[i].G = laspts5[i].Green;
-        _RGB[i].B = laspts5[i].Blue;
-      }
-      _gpst_min = _gpstime[0];
-      _gpst_max = _gpstime[pt_count-1];
 
-      delete[] laspts5;
-      break;
+// encode the points [b, e) of the columns as records of format RecordT
+// (coordinates come either as doubles, or already quantized to the header's grid)
+template <class RecordT>
+static void encode_LAS_records(char * buf, std::size_t b, std::size_t e, std::size_t stride,
+                               const LASHeader & hdr,
+                               const double * x, const double * y, const double * z,
+                               const int * qx, const int * qy, const int * qz,
+                               const unsigned short * intensity, const unsigned char * classification,
+                               const unsigned char * return_info, const double * gpstime, const rgb48 * RGB){
+  typedef las_format<RecordT> format;
+  const double xs = 1.0/hdr.x_scale, ys = 1.0/hdr.y_scale, zs = 1.0/hdr.z_scale;
+  for (std::size_t i=b; i<e; i++){
+    RecordT & p = *reinterpret_cast<RecordT *>(buf + (i-b)*stride);
+    memset(&p, 0, stride);
+    if (qx != nullptr){
+      p.X = qx[i];
+      p.Y = qy[i];
+      p.Z = qz[i];
+    }
+    else {
+      p.X = int(std::lround((x[i] - hdr.x_offset)*xs));
+      p.Y = int(std::lround((y[i] - hdr.y_offset)*ys));
+      p.Z = int(std::lround((z[i] - hdr.z_offset)*zs));
+    }
+    p.Return_Info = (return_info != nullptr)? return_info[i] : 0x09;     // default return 1 of 1
+    if (intensity != nullptr) p.Intensity = intensity[i];
+    if (classification != nullptr) p.Classification = classification[i];
+    if (gpstime != nullptr) format::set_gpstime(p, gpstime[i]);
+    if (RGB != nullptr) format::set_RGB(p, RGB[i]);
+  }
+}
 
-    default:
-      cout << "this should not be possible" << endl;
+// copy the attributes of the points [b, e) into the extra bytes of
+// their records, which start at offset within each record
+static void encode_LAS_attributes(char * buf, std::size_t b, std::size_t e, std::size_t stride,
+                                  std::size_t offset, const AttributeStore & attrs){
+  for (std::size_t k=0; k<attrs.count(); k++){
+    std::size_t es = attribute_size(attrs.type(k));
+    const char * src = attrs.bytes(k) + b*es;
+    char * dst = buf + offset;
+    for (std::size_t i=0; i<e-b; i++) memcpy(dst + i*stride, src + i*es, es);
+    offset += es;
   }
+}
 
-  // unmap the data
-    //cout << "trying to unmap" << endl;
+void PointCloud::write_LAS(string filename, int point_format, unsigned char ver_minor, unsigned int nthreads){
+  // pick the smallest format that holds everything we have
+  if (point_format < 0) point_format = (gpstime_present()? 1 : 0) + (RGB_present()? 2 : 0);
+  if (point_format > 3){
+    cout << "PointCloud: can only write LAS point formats 0-3" << endl;
+    throw -1;
+  }
+  if (ver_minor < 2 || ver_minor > 4){
+    cout << "PointCloud: can only write LAS versions 1.2-1.4" << endl;
+    throw -1;
+  }
+  if (ver_minor < 4 && pointcount() > 0xffffffffull){
+    cout << "PointCloud: more than 2^32 points needs LAS 1.4" << endl;
+    throw -1;
+  }
 
-  if (munmap(lasmap, point_offset + point_record_bytes*pt_count) < 0){
-    cout << "ruh roh! problem unmapping LAS file" << endl;
+  // build the header
+  calc_extents();
+  LASHeader hdr;
+  hdr.ver_major = 1;
+  hdr.ver_minor = ver_minor;
+  hdr.header_size = (ver_minor == 2)? 227 : (ver_minor == 3)? 235 : 375;
+  hdr.point_format_id = point_format;
+
+  // attributes go in the extra bytes of each record, described by one
+  // extra bytes VLR (a 54 byte VLR header + 192 bytes per attribute)
+  std::size_t base_bytes = las_record_size(point_format);
+  std::size_t extra_bytes = 0;
+  for (std::size_t k=0; k<_attributes.count(); k++) extra_bytes += attribute_size(_attributes.type(k));
+  if (base_bytes + extra_bytes > 0xffff || 192*_attributes.count() > 0xffff){
+    cout << "PointCloud: too many attributes to write to LAS" << endl;
     throw -1;
   }
-  close(fd);
-  //cout << "finished unmapping" << endl;
-  
+  std::size_t vlr_bytes = (_attributes.count() > 0)? 54 + 192*_attributes.count() : 0;
+  hdr.point_offset = hdr.header_size + vlr_bytes;
+  hdr.num_vlrs = (_attributes.count() > 0)? 1 : 0;
+  hdr.point_record_bytes = base_bytes + extra_bytes;
+  hdr.pt_count = pointcount();
+  for (int i=0; i<15; i++) hdr.pts_by_return[i] = 0;
+  if (return_info_present()){
+    for (int i=1; i<=5; i++) hdr.pts_by_return[i-1] = stats(nthreads).returns[i];
+  }
+  else hdr.pts_by_return[0] = pointcount();
+  if (_quantized){
+    // the integers are written as they are
+    hdr.x_scale = _qscale[0]; hdr.y_scale = _qscale[1]; hdr.z_scale = _qscale[2];
+    hdr.x_offset = _qoffset[0]; hdr.y_offset = _qoffset[1]; hdr.z_offset = _qoffset[2];
+  }
+  else {
+    LAS_scale_offset(_xmin, _xmax, hdr.x_scale, hdr.x_offset);
+    LAS_scale_offset(_ymin, _ymax, hdr.y_scale, hdr.y_offset);
+    LAS_scale_offset(_zmin, _zmax, hdr.z_scale, hdr.z_offset);
+  }
+  hdr.x_min = _xmin; hdr.x_max = _xmax;
+  hdr.y_min = _ymin; hdr.y_max = _ymax;
+  hdr.z_min = _zmin; hdr.z_max = _zmax;
 
-  // check to see intensity and classification contain actual info
-  for (unsigned int i=0; i<pt_count; i++){
-    if (_intensity[i] != 0) {
-      fieldexist = true;
-      break;
-    }
+  // size the file up front so that every thread can pwrite its
+  // records at their final offsets
+  int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0){
+    cout << "Error opening file in write_LAS" << endl;
+    throw -1;
   }
-  if (!fieldexist){
-    cout << "clearing intensity" << endl;
-    _intensity.clear();
-    //delete[] intensity;
-    //intensity = NULL;
+  std::size_t stride = hdr.point_record_bytes;
+  std::size_t filesize = hdr.point_offset + stride*pointcount();
+  if (ftruncate(fd, filesize) < 0){
+    cout << "write_LAS: could not size " << filename << endl;
+    close(fd);
+    throw -1;
   }
-  fieldexist = false;
-  for (unsigned int i=0; i<pt_count; i++){
-    if (_classification[i] != 0) {
-      fieldexist = true;
-      break;
+
+  std::atomic<bool> ok(true);
+  auto write_all = [&](const char * buf, std::size_t len, std::size_t off){
+    while (len > 0){
+      ssize_t w = pwrite(fd, buf, len, off);
+      if (w <= 0){ok = false; return;}
+      buf += w; len -= w; off += w;
+    }
+  };
+
+  std::vector<char> hbuf(hdr.point_offset, 0);
+  hdr.write(&hbuf.front());
+  if (vlr_bytes > 0){
+    char * vlr = &hbuf[hdr.header_size];
+    strncpy(vlr+2, "LASF_Spec", 16);                                // User ID
+    unsigned short record_id = 4, length = 192*_attributes.count();
+    memcpy(vlr+18, &record_id, 2);                                   // Record ID
+    memcpy(vlr+20, &length, 2);                                      // Record Length After Header
+    strncpy(vlr+22, "extra bytes", 32);                              // Description
+    for (std::size_t k=0; k<_attributes.count(); k++){
+      char * desc = vlr + 54 + 192*k;
+      desc[2] = las_data_type(_attributes.type(k));                  // data_type
+      strncpy(desc+4, _attributes.name(k).c_str(), 32);              // name
     }
   }
-  if (!fieldexist){
-    cout << "clearing classification" << endl;
-    _classification.clear();
-    //delete[] classification;
-    //classification = NULL;
-  }
-  fieldexist = false;
+  write_all(&hbuf.front(), hbuf.size(), 0);
+
+  // each thread encodes its slice into a large page-aligned buffer
+  // and flushes it with one pwrite per buffer
+  const std::size_t buffer_records = (8<<20)/stride;
+  bool raw = _quantized && pointcount();
+  const double * x = (!_quantized && pointcount())? &_x.front() : nullptr;
+  const double * y = (!_quantized && pointcount())? &_y.front() : nullptr;
+  const double * z = (!_quantized && pointcount())? &_z.front() : nullptr;
+  const int * qx = raw? &_qx.front() : nullptr;
+  const int * qy = raw? &_qy.front() : nullptr;
+  const int * qz = raw? &_qz.front() : nullptr;
+  const unsigned short * inten = intensity_present()? &_intensity.front() : nullptr;
+  const unsigned char * cls = classification_present()? &_classification.front() : nullptr;
+  const unsigned char * ret = return_info_present()? &_return_info.front() : nullptr;
+  const double * gpst = gpstime_present()? &_gpstime.front() : nullptr;
+  const rgb48 * rgb = RGB_present()? &_RGB.front() : nullptr;
+
+  csg::parallel_for(pointcount(), nthreads, [&](std::size_t b, std::size_t e, unsigned int t){
+    std::vector<char, csg::AlignedAllocator<char, 4096>> buf(std::min(buffer_records, e-b)*stride);
+    for (std::size_t s=b; s<e; s+=buffer_records){
+      std::size_t m = std::min(buffer_records, e-s);
+      switch (point_format)
+      {
+        case 0: encode_LAS_records<las_pt_0>(&buf.front(), s, s+m, stride, hdr, x, y, z, qx, qy, qz, inten, cls, ret, gpst, rgb); break;
+        case 1: encode_LAS_records<las_pt_1>(&buf.front(), s, s+m, stride, hdr, x, y, z, qx, qy, qz, inten, cls, ret, gpst, rgb); break;
+        case 2: encode_LAS_records<las_pt_2>(&buf.front(), s, s+m, stride, hdr, x, y, z, qx, qy, qz, inten, cls, ret, gpst, rgb); break;
+        case 3: encode_LAS_records<las_pt_3>(&buf.front(), s, s+m, stride, hdr, x, y, z, qx, qy, qz, inten, cls, ret, gpst, rgb); break;
+      }
+      if (extra_bytes > 0) encode_LAS_attributes(&buf.front(), s, s+m, stride, base_bytes, _attributes);
+      write_all(&buf.front(), m*stride, hdr.point_offset + s*stride);
+    }
+  });
 
-  return;
+  close(fd);
+  if (!ok){
+    cout << "write_LAS: failed writing " << filename << endl;
+    throw -1;
+  }
 }
 
+// ASCII text parsing helpers
+
+static inline bool is_blank(char c) {return c == ' ' || c == '\t' || c == '\r';};
+
+// parse a decimal number at p (not past end), advancing p past it.
+// With C++17 this is std::from_chars; otherwise short mantissas with
+// small exponents are computed exactly in double arithmetic, and the
+// rest go through strtod on a local copy
+static bool parse_number(const char * & p, const char * end, double & v){
+#if __cplusplus >= 201703L
+  if (p < end && *p == '+') p++;
+  std::from_chars_result r = std::from_chars(p, end, v);
+  if (r.ec != std::errc()) return false;
+  p = r.ptr;
+  return true;
+#else
+  static const double pow10[23] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  const char * q = p;
+  bool neg = false;
+  if (q < end && (*q == '-' || *q == '+')) {neg = (*q == '-'); q++;}
+  std::uint64_t mant = 0;
+  int digits = 0, scale = 0;
+  const char * start = q;
+  while (q < end && *q >= '0' && *q <= '9') {if (digits < 19) {mant = 10*mant + (*q - '0'); if (mant) digits++;} else scale++; q++;}
+  if (q < end && *q == '.'){
+    q++;
+    while (q < end && *q >= '0' && *q <= '9') {if (digits < 19) {mant = 10*mant + (*q - '0'); if (mant) digits++; scale--;} q++;}
+  }
+  if (q == start || (q == start+1 && *start == '.')) return false;
+  bool exact = (digits <= 15);
+  if (q < end && (*q == 'e' || *q == 'E')){
+    const char * e = q+1;
+    bool eneg = false;
+    if (e < end && (*e == '-' || *e == '+')) {eneg = (*e == '-'); e++;}
+    if (e < end && *e >= '0' && *e <= '9'){
+      int ex = 0;
+      while (e < end && *e >= '0' && *e <= '9') {if (ex < 100000) ex = 10*ex + (*e - '0'); e++;}
+      scale += eneg? -ex : ex;
+      q = e;
+    }
+  }
+  if (exact && scale >= -22 && scale <= 22){
+    v = (scale < 0)? double(mant)/pow10[-scale] : double(mant)*pow10[scale];
+    if (neg) v = -v;
+  }
+  else {
+    // (the fixed-point text of a huge value can run to hundreds of chars)
+    char buf[64];
+    std::size_t len = q - p;
+    if (len < sizeof(buf)){
+      memcpy(buf, p, len);
+      buf[len] = '\0';
+      v = strtod(buf, nullptr);
+    }
+    else v = strtod(std::string(p, q).c_str(), nullptr);
+  }
+  p = q;
+  return true;
+#endif
+}
 
-void PointCloud::write_LAS(string filename){
-  cout << "writing not quite supported yet" << endl;
+// longest text format_fixed can produce, with the terminator sprintf
+// adds: "-" and 309 integer digits of DBL_MAX, "." and 9 decimals
+static const std::size_t format_fixed_max = 330;
+
+// write v with a fixed number of decimals, returning the end of the text
+// (p must have room for format_fixed_max chars)
+static inline char * format_fixed(char * p, double v, int precision){
+  static const double pow10[10] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+  static const std::uint64_t ipow10[10] = {1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull,
+                                           1000000ull, 10000000ull, 100000000ull, 1000000000ull};
+  double a = std::fabs(v)*pow10[precision];
+  if (!(a < 9.0e18)) return p + sprintf(p, "%.*f", precision, v);
+  std::uint64_t scaled = std::uint64_t(a + 0.5);
+  if (v < 0 && scaled > 0) *p++ = '-';
+  std::uint64_t ip = scaled/ipow10[precision], fp = scaled%ipow10[precision];
+  char tmp[24];
+  int n = 0;
+  do {tmp[n++] = '0' + ip%10; ip /= 10;} while (ip > 0);
+  while (n > 0) *p++ = tmp[--n];
+  if (precision > 0){
+    *p++ = '.';
+    for (int k=precision-1; k>=0; k--) {p[k] = '0' + fp%10; fp /= 10;}
+    p += precision;
+  }
+  return p;
 }
 
-PointCloud PointCloud::subset(const bool & keepref){
-  // declare vars
-  unsigned int subset_count=0, ct;
-  PointCloud cloud_subset;
-  const bool * keep = &keepref;
+static inline char * format_uint(char * p, unsigned int v){
+  char tmp[12];
+  int n = 0;
+  do {tmp[n++] = '0' + v%10; v /= 10;} while (v > 0);
+  while (n > 0) *p++ = tmp[--n];
+  return p;
+}
 
-  for (unsigned int i=0; i<pointcount(); i++){
-    if (keep[i]) subset_count++;
+// close the gaps left by skipped lines: block t holds good[t] rows at offsets[t]
+template <class V>
+static void compact_column(V & v, const std::vector<std::size_t> & offsets, const std::vector<std::size_t> & good){
+  if (v.size() == 0) return;
+  std::size_t o = 0;
+  for (std::size_t t=0; t<good.size(); t++){
+    if (o != offsets[t]) std::copy(v.begin() + offsets[t], v.begin() + offsets[t] + good[t], v.begin() + o);
+    o += good[t];
   }
+  v.resize(o);
+}
 
-  cloud_subset = PointCloud(subset_count);
+PointCloud PointCloud::read_ASCII(string filename, const ASCIIOptions & opts){
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0){
+    cout << "Error opening file in read_ASCII" << endl;
+    throw -1;
+  }
+  off_t sz = lseek(fd, 0, SEEK_END);
+  PointCloud cloud;
+  if (sz <= 0) {close(fd); return cloud;}
+  const char * map = (const char *)mmap(NULL, sz, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED){
+    cout << "Failed to map " << filename << endl;
+    throw -1;
+  }
+  madvise((void *)map, sz, MADV_SEQUENTIAL);
+  const char * end = map + sz;
+
+  // header lines
+  const char * p = map;
+  for (std::size_t k=0; k<opts.skip_lines && p < end; k++){
+    const char * nl = (const char *)memchr(p, '\n', end - p);
+    p = (nl == nullptr)? end : nl+1;
+  }
 
-  // copy x, y, z data
-  ct=0;
-  for (unsigned int i=0; i<pointcount(); i++){
-    if (keep[i]){
-      cloud_subset._x[ct] = _x[i];
-      cloud_subset._y[ct] = _y[i];
-      cloud_subset._z[ct] = _z[i];
-      ct++;
+  const bool blank_delim = (opts.delimiter == ' ' || opts.delimiter == '\t');
+  auto next_field = [&](const char * & q, const char * eol){
+    while (q < eol && is_blank(*q)) q++;
+    if (!blank_delim && q < eol && *q == opts.delimiter){
+      q++;
+      while (q < eol && is_blank(*q)) q++;
+      return true;
     }
+    return blank_delim && q < eol;
+  };
+
+  // the column layout, from the width of the first numeric line if not given
+  std::string columns = opts.columns;
+  if (columns.empty()){
+    const char * q = p;
+    while (q < end && columns.empty()){
+      const char * eol = (const char *)memchr(q, '\n', end - q);
+      if (eol == nullptr) eol = end;
+      const char * f = q;
+      int width = 0;
+      double v;
+      while (f < eol && is_blank(*f)) f++;
+      while (f < eol && parse_number(f, eol, v)){
+        width++;
+        if (!next_field(f, eol)) break;
+      }
+      if (width >= 3) columns = (width == 3)? "xyz" : (width == 4)? "xyzi" : "xyzic";
+      q = eol+1;
+    }
+    if (columns.empty()) columns = "xyz";
+  }
+  if (columns.find_first_not_of("xyzictrgb-") != std::string::npos ||
+      columns.find('x') == std::string::npos || columns.find('y') == std::string::npos || columns.find('z') == std::string::npos){
+    cout << "PointCloud: bad ASCII column layout \"" << columns << "\"" << endl;
+    munmap((void *)map, sz);
+    throw -1;
   }
 
-  // copy intensity data
-  ct=0;
-  if (intensity_present()){
-    cloud_subset.add_intensity();
-    for (unsigned int i=0; i<pointcount(); i++){
-      if (keep[i]){
-        cloud_subset._intensity[ct] = _intensity[i];
-        ct++;
+  // split the text on line boundaries, one piece per thread
+  unsigned int nthreads = (opts.nthreads == 0)? csg::default_threads() : opts.nthreads;
+  if (std::size_t(end - p) < std::size_t(nthreads)*(1<<16)) nthreads = 1 + (end - p)/(1<<16);
+  std::vector<const char *> bounds(nthreads+1, end);
+  bounds[0] = p;
+  for (unsigned int t=1; t<nthreads; t++){
+    const char * q = std::max(bounds[t-1], p + (end - p)/nthreads*t);
+    const char * nl = (q > p)? (const char *)memchr(q-1, '\n', end - (q-1)) : q-1;
+    bounds[t] = (nl == nullptr)? end : nl+1;
+  }
+
+  // count the lines of each piece to place its rows
+  std::vector<std::size_t> offsets(nthreads+1, 0);
+  csg::parallel_for(nthreads, nthreads, [&](std::size_t b, std::size_t e, unsigned int t){
+    const char * q = bounds[t], * qe = bounds[t+1];
+    std::size_t lines = 0;
+    while (q < qe){
+      const char * nl = (const char *)memchr(q, '\n', qe - q);
+      lines++;
+      q = (nl == nullptr)? qe : nl+1;
+    }
+    offsets[t+1] = lines;
+  });
+  for (unsigned int t=0; t<nthreads; t++) offsets[t+1] += offsets[t];
+
+  std::size_t n = offsets[nthreads];
+  bool has_i = columns.find('i') != std::string::npos, has_c = columns.find('c') != std::string::npos;
+  bool has_t = columns.find('t') != std::string::npos;
+  bool has_rgb = columns.find_first_of("rgb") != std::string::npos;
+  cloud._x.resize(n); cloud._y.resize(n); cloud._z.resize(n);
+  if (has_i) cloud._intensity.resize(n);
+  if (has_c) cloud._classification.resize(n);
+  if (has_t) cloud._gpstime.resize(n);
+  if (has_rgb) cloud._RGB.resize(n, {0, 0, 0});
+
+  // parse each piece into its rows; lines that don't hold every column are skipped
+  std::vector<std::size_t> good(nthreads, 0);
+  csg::parallel_for(nthreads, nthreads, [&](std::size_t b, std::size_t e, unsigned int t){
+    const char * q = bounds[t], * qe = bounds[t+1];
+    std::size_t o = offsets[t];
+    while (q < qe){
+      const char * eol = (const char *)memchr(q, '\n', qe - q);
+      if (eol == nullptr) eol = qe;
+      const char * f = q;
+      bool ok = true;
+      while (f < eol && is_blank(*f)) f++;
+      for (std::size_t k=0; k<columns.size() && ok; k++){
+        double v = 0;
+        if (columns[k] == '-'){
+          while (f < eol && !is_blank(*f) && *f != opts.delimiter) f++;
+        }
+        else if (!parse_number(f, eol, v)) {ok = false; break;}
+        switch (columns[k]){
+          case 'x': cloud._x[o] = v; break;
+          case 'y': cloud._y[o] = v; break;
+          case 'z': cloud._z[o] = v; break;
+          case 'i': cloud._intensity[o] = (unsigned short)(v); break;
+          case 'c': cloud._classification[o] = (unsigned char)(v); break;
+          case 't': cloud._gpstime[o] = v; break;
+          case 'r': cloud._RGB[o].R = (unsigned short)(v); break;
+          case 'g': cloud._RGB[o].G = (unsigned short)(v); break;
+          case 'b': cloud._RGB[o].B = (unsigned short)(v); break;
+        }
+        if (k+1 < columns.size()) ok = next_field(f, eol);
       }
+      if (ok) {o++; good[t]++;}
+      q = eol+1;
     }
+  });
+  munmap((void *)map, sz);
+
+  std::size_t kept = 0;
+  for (auto g : good) kept += g;
+  if (kept < n){
+    compact_column(cloud._x, offsets, good);
+    compact_column(cloud._y, offsets, good);
+    compact_column(cloud._z, offsets, good);
+    compact_column(cloud._intensity, offsets, good);
+    compact_column(cloud._classification, offsets, good);
+    compact_column(cloud._gpstime, offsets, good);
+    compact_column(cloud._RGB, offsets, good);
   }
+  cloud.calc_extents();
+  return cloud;
+}
 
-  // copy classification data
-  ct=0;
-  if (classification_present()){
-    cloud_subset.add_classification();
-    for (unsigned int i=0; i<pointcount(); i++){
-      if (keep[i]){
-        cloud_subset._classification[ct] = _classification[i];
-        ct++;
-      }
+void PointCloud::write_ASCII(string filename, const ASCIIOptions & opts) const{
+  std::string columns = opts.columns;
+  if (columns.empty()) columns = string("xyz") + (intensity_present()? "i" : "") + (classification_present()? "c" : "");
+  for (char c : columns){
+    bool ok = (c == 'x' || c == 'y' || c == 'z' || c == '-') || (c == 'i' && intensity_present()) ||
+              (c == 'c' && classification_present()) || (c == 't' && gpstime_present()) ||
+              ((c == 'r' || c == 'g' || c == 'b') && RGB_present());
+    if (!ok){
+      cout << "PointCloud: can't write ASCII column '" << c << "'" << endl;
+      throw -1;
     }
   }
+  if (opts.precision < 0 || opts.precision > 9){
+    cout << "PointCloud: ASCII precision must be 0-9" << endl;
+    throw -1;
+  }
 
-  // copy gpstime data
-  ct=0;
-  if (gpstime_present()){
-    cloud_subset.add_gpstime();
-    for (unsigned int i=0; i<pointcount(); i++){
-      if (keep[i]){
-        cloud_subset._gpstime[ct] = _gpstime[i];
-        ct++;
+  int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0){
+    cout << "Error opening file in write_ASCII" << endl;
+    throw -1;
+  }
+
+  // rounds of: every thread formats its next batch of lines into its
+  // own buffer, then all of them pwrite at their offsets in the file
+  const std::size_t n = pointcount();
+  const std::size_t batch = 1<<16;
+  const std::size_t line_bytes = columns.size()*32 + 2;
+  const std::size_t longest_line = columns.size()*(format_fixed_max + 1) + 1;
+  unsigned int nthreads = (opts.nthreads == 0)? csg::default_threads() : opts.nthreads;
+  std::vector<std::vector<char>> buf(nthreads);
+  std::vector<std::size_t> len(nthreads+1, 0);
+  std::atomic<bool> ok(true);
+  const char delim = opts.delimiter;
+  off_t pos = 0;
+
+  for (std::size_t base=0; base<n; base+=batch*nthreads){
+    csg::parallel_for(nthreads, nthreads, [&](std::size_t b, std::size_t e, unsigned int t){
+      std::size_t s = std::min(n, base + t*batch), se = std::min(n, s + batch);
+      buf[t].resize((se - s)*line_bytes);
+      char * q = buf[t].data();
+      for (std::size_t i=s; i<se; i++){
+        // line_bytes fits ordinary lines; huge coordinates can take up
+        // to format_fixed_max chars per column, so grow when short
+        std::size_t used = q - buf[t].data();
+        if (buf[t].size() - used < longest_line){
+          buf[t].resize(2*buf[t].size() + longest_line);
+          q = buf[t].data() + used;
+        }
+        for (std::size_t k=0; k<columns.size(); k++){
+          if (k > 0) *q++ = delim;
+          switch (columns[k]){
+            case 'x': q = format_fixed(q, x(i), opts.precision); break;
+            case 'y': q = format_fixed(q, y(i), opts.precision); break;
+            case 'z': q = format_fixed(q, z(i), opts.precision); break;
+            case 'i': q = format_uint(q, _intensity[i]); break;
+            case 'c': q = format_uint(q, _classification[i]); break;
+            case 't': q = format_fixed(q, _gpstime[i], 6); break;
+            case 'r': q = format_uint(q, _RGB[i].R); break;
+            case 'g': q = format_uint(q, _RGB[i].G); break;
+            case 'b': q = format_uint(q, _RGB[i].B); break;
+            case '-': *q++ = '0'; break;
+          }
+        }
+        *q++ = '\n';
       }
+      len[t+1] = q - buf[t].data();
+    });
+    for (unsigned int t=0; t<nthreads; t++) len[t+1] += len[t];
+
+    csg::parallel_for(nthreads, nthreads, [&](std::size_t b, std::size_t e, unsigned int t){
+      const char * q = buf[t].data();
+      std::size_t left = len[t+1] - len[t];
+      off_t off = pos + len[t];
+      while (left > 0){
+        ssize_t w = pwrite(fd, q, left, off);
+        if (w <= 0) {ok = false; return;}
+        q += w; left -= w; off += w;
+      }
+    });
+    pos += len[nthreads];
+  }
+
+  close(fd);
+  if (!ok){
+    cout << "write_ASCII: failed writing " << filename << endl;
+    throw -1;
+  }
+}
+
+PointCloud PointCloud::subset(const bool & keepref){
+  const bool * keep = &keepref;
+  PointMask mask(pointcount());
+  csg::parallel_for(mask.words.size(), 0, [&](std::size_t b, std::size_t e, unsigned int t){
+    for (std::size_t w=b; w<e; w++){
+      std::uint64_t bits = 0;
+      std::size_t end = std::min(mask.size, 64*w + 64);
+      for (std::size_t i=64*w; i<end; i++) bits |= std::uint64_t(keep[i]) << (i - 64*w);
+      mask.words[w] = bits;
     }
+  });
+  return subset(mask);
+}
+
+PointCloud PointCloud::subset(const unsigned int & keep_inds_ref, const unsigned int keep_count){
+  // the indices select points; the subset keeps them in cloud order
+  const unsigned int * keep_inds = &keep_inds_ref;
+  PointMask mask(pointcount());
+  for (unsigned int j=0; j<keep_count; j++) mask.set(keep_inds[j]);
+  return subset(mask);
+}
+
+PointCloud PointCloud::subset(const PointMask & mask, unsigned int nthreads) const{
+  if (mask.size != pointcount()){
+    cout << "PointCloud: subset mask has " << mask.size << " bits for " << pointcount() << " points" << endl;
+    throw -1;
   }
 
-  // copy RGB data
-  ct=0;
-  if (RGB_present()){
-    cloud_subset.add_RGB();
-    for (unsigned int i=0; i<pointcount(); i++){
-      if (keep[i]){
-        cloud_subset._RGB[ct].R = _RGB[i].R;
-        cloud_subset._RGB[ct].G = _RGB[i].G;
-        cloud_subset._RGB[ct].B = _RGB[i].B;
-        ct++;
+  // survivors per thread, from a popcount of its words of the mask,
+  // then a prefix sum gives each thread its place in the output
+  if (nthreads == 0) nthreads = csg::default_threads();
+  std::size_t nwords = mask.words.size();
+  std::vector<std::size_t> offsets(nthreads+1, 0);
+  csg::parallel_for(nwords, nthreads, [&](std::size_t b, std::size_t e, unsigned int t){
+    std::size_t count = 0;
+    for (std::size_t w=b; w<e; w++) count += __builtin_popcountll(mask.words[w]);
+    offsets[t+1] = count;
+  });
+  for (unsigned int t=0; t<nthreads; t++) offsets[t+1] += offsets[t];
+
+  PointCloud cloud_subset = empty_like(offsets[nthreads]);
+
+  // each thread expands its set bits into a small index buffer and
+  // gathers every column for that buffer before moving on
+  csg::parallel_for(nwords, nthreads, [&](std::size_t b, std::size_t e, unsigned int t){
+    const std::size_t block = 4096;
+    std::size_t idx[block + 64], m = 0, o = offsets[t];
+    for (std::size_t w=b; w<e; w++){
+      std::uint64_t bits = mask.words[w];
+      while (bits){
+        idx[m++] = 64*w + __builtin_ctzll(bits);
+        bits &= bits - 1;
+      }
+      if (m >= block){
+        gather_into(cloud_subset, idx, m, o);
+        o += m;
+        m = 0;
       }
     }
-  }
+    if (m > 0) gather_into(cloud_subset, idx, m, o);
+  });
 
   cloud_subset.calc_extents();
+  return cloud_subset;
+}
 
+PointCloud PointCloud::subset(const std::vector<std::size_t> & indices, unsigned int nthreads) const{
+  for (std::size_t j=0; j<indices.size(); j++){
+    if (indices[j] >= pointcount()){
+      cout << "PointCloud: subset index " << indices[j] << " is out of range" << endl;
+      throw -1;
+    }
+  }
+
+  PointCloud cloud_subset = empty_like(indices.size());
+  csg::parallel_for(indices.size(), nthreads, [&](std::size_t b, std::size_t e, unsigned int t){
+    if (e > b) gather_into(cloud_subset, &indices[b], e-b, b);
+  });
+
+  cloud_subset.calc_extents();
   return cloud_subset;
 }
 
-PointCloud PointCloud::subset(const unsigned int & keep_inds_ref, const unsigned int keep_count){
-  // declare vars
-  bool * keep;
-  const unsigned int * keep_inds = &keep_inds_ref;
-  PointCloud cloud_subset;
+PointCloud PointCloud::empty_like(std::size_t n) const{
+  PointCloud cloud;
+  cloud.set_mapped(mapped());
+  cloud._quantized = _quantized;
+  for (int d=0; d<3; d++) {cloud._qscale[d] = _qscale[d]; cloud._qoffset[d] = _qoffset[d];}
+  if (_quantized){
+    cloud._qx.resize(n);
+    cloud._qy.resize(n);
+    cloud._qz.resize(n);
+  }
+  else {
+    cloud._x.resize(n);
+    cloud._y.resize(n);
+    cloud._z.resize(n);
+  }
+  if (intensity_present()) cloud._intensity.resize(n);
+  if (classification_present()) cloud._classification.resize(n);
+  if (return_info_present()) cloud._return_info.resize(n);
+  if (gpstime_present()) cloud._gpstime.resize(n);
+  if (RGB_present()) cloud._RGB.resize(n);
+  cloud._attributes = _attributes.empty_like(n);
+  return cloud;
+}
 
-  keep = new bool[pointcount()];
+template <class V>
+static void gather_column(const V & src, V & dst, const std::size_t * idx, std::size_t m, std::size_t o){
+  if (src.size() == 0) return;
+  auto s = src.data();
+  auto d = dst.data() + o;
+  for (std::size_t j=0; j<m; j++) d[j] = s[idx[j]];
+}
 
-  for (unsigned int i=0; i<pointcount(); i++) keep[i] = false;
-  for (unsigned int j=0; j<keep_count; j++) keep[keep_inds[j]] = true;
+void PointCloud::gather_into(PointCloud & dst, const std::size_t * idx, std::size_t m, std::size_t o) const{
+  if (_quantized){
+    gather_column(_qx, dst._qx, idx, m, o);
+    gather_column(_qy, dst._qy, idx, m, o);
+    gather_column(_qz, dst._qz, idx, m, o);
+  }
+  else {
+    gather_column(_x, dst._x, idx, m, o);
+    gather_column(_y, dst._y, idx, m, o);
+    gather_column(_z, dst._z, idx, m, o);
+  }
+  gather_column(_intensity, dst._intensity, idx, m, o);
+  gather_column(_classification, dst._classification, idx, m, o);
+  gather_column(_return_info, dst._return_info, idx, m, o);
+  gather_column(_gpstime, dst._gpstime, idx, m, o);
+  gather_column(_RGB, dst._RGB, idx, m, o);
+  _attributes.gather_into(dst._attributes, idx, m, o);
+}
 
-  cloud_subset = subset(*keep);
+template <class V>
+static void permute(V & v, const std::vector<std::size_t> & order){
+  V w(order.size(), typename V::value_type(), v.get_allocator());
+  for (std::size_t i=0; i<order.size(); i++) w[i] = v[order[i]];
+  v.swap(w);
+}
 
-  delete[] keep;
+void PointCloud::reorder(const std::vector<std::size_t> & order){
+  if (order.size() != pointcount()){
+    cout << "PointCloud: reorder needs exactly one index per point" << endl;
+    throw -1;
+  }
 
-  return cloud_subset;
+  if (_quantized){
+    permute(_qx, order);
+    permute(_qy, order);
+    permute(_qz, order);
+    _x.clear(); _y.clear(); _z.clear();
+  }
+  else {
+    permute(_x, order);
+    permute(_y, order);
+    permute(_z, order);
+  }
+  if (gpstime_present()) permute(_gpstime, order);
+  if (intensity_present()) permute(_intensity, order);
+  if (classification_present()) permute(_classification, order);
+  if (return_info_present()) permute(_return_info, order);
+  if (RGB_present()) permute(_RGB, order);
+  _attributes.permute(order);
+}
+
+// curve order of the columns within their bounding box
+// (works on the doubles or directly on the quantized integers)
+template <class V>
+static std::vector<std::size_t> curve_order(csg::CurveType curve,
+                                            const V & x,
+                                            const V & y,
+                                            const V & z){
+  typedef typename V::value_type T;
+  auto mx = minmax_element(x.begin(), x.end());
+  auto my = minmax_element(y.begin(), y.end());
+  auto mz = minmax_element(z.begin(), z.end());
+  csg::Box<3, T> bx(csg::GeneralPoint<3, T>(*mx.first, *my.first, *mz.first),
+                    csg::GeneralPoint<3, T>(*mx.second, *my.second, *mz.second));
+  const T * coords[3] = {&x.front(), &y.front(), &z.front()};
+  std::vector<std::uint64_t> keys(x.size());
+  csg::curve_encode<std::uint64_t, 3, T>(curve, coords, x.size(), bx, &keys.front());
+  return csg::curve_order(keys);
+}
+
+void PointCloud::sort_morton(){
+  if (pointcount() == 0) return;
+  if (_quantized) reorder(curve_order(csg::MORTON, _qx, _qy, _qz));
+  else reorder(curve_order(csg::MORTON, _x, _y, _z));
+}
+
+void PointCloud::sort_hilbert(){
+  if (pointcount() == 0) return;
+  if (_quantized) reorder(curve_order(csg::HILBERT, _qx, _qy, _qz));
+  else reorder(curve_order(csg::HILBERT, _x, _y, _z));
+}
+
+// apply fn to blocks of the x,y,z columns in parallel, taking each
+// block's extents while it is still in cache; the extents are
+// combined once at the end
+void PointCloud::transform_xyz(unsigned int nthreads, std::function<void(std::size_t n, double * x, double * y, double * z)> fn){
+  dequantize();
+  _stats_valid = false;
+  std::size_t n = pointcount();
+  if (n == 0) return;
+  if (nthreads == 0) nthreads = csg::default_threads();
+
+  const std::size_t block = 4096;
+  const double inf = std::numeric_limits<double>::infinity();
+  std::vector<double> lo(3*nthreads, inf), hi(3*nthreads, -inf);
+  csg::parallel_for(n, nthreads, [&](std::size_t b, std::size_t e, unsigned int t){
+    double * l = &lo[3*t], * h = &hi[3*t];
+    for (std::size_t s=b; s<e; s+=block){
+      std::size_t m = std::min(block, e-s);
+      double * x = &_x[s], * y = &_y[s], * z = &_z[s];
+      fn(m, x, y, z);
+      for (std::size_t i=0; i<m; i++){
+        l[0] = std::min(l[0], x[i]); h[0] = std::max(h[0], x[i]);
+        l[1] = std::min(l[1], y[i]); h[1] = std::max(h[1], y[i]);
+        l[2] = std::min(l[2], z[i]); h[2] = std::max(h[2], z[i]);
+      }
+    }
+  });
+
+  for (unsigned int t=1; t<nthreads; t++){
+    for (int d=0; d<3; d++){
+      lo[d] = std::min(lo[d], lo[3*t+d]);
+      hi[d] = std::max(hi[d], hi[3*t+d]);
+    }
+  }
+  _xmin = lo[0]; _xmax = hi[0];
+  _ymin = lo[1]; _ymax = hi[1];
+  _zmin = lo[2]; _zmax = hi[2];
+}
+
+void PointCloud::geodetic_to_ECEF(const csg::ReferenceEllipsoid & ell, unsigned int nthreads){
+  transform_xyz(nthreads, [&](std::size_t n, double * x, double * y, double * z){
+    csg::geodetic_to_ECEF(ell, n, x, y, z, x, y, z);
+  });
+}
+
+void PointCloud::ECEF_to_geodetic(const csg::ReferenceEllipsoid & ell, unsigned int nthreads){
+  transform_xyz(nthreads, [&](std::size_t n, double * x, double * y, double * z){
+    csg::ECEF_to_geodetic(ell, n, x, y, z, x, y, z);
+  });
+}
+
+int PointCloud::geodetic_to_UTM(int zone, bool north, const csg::ReferenceEllipsoid & ell, unsigned int nthreads){
+  if (zone == 0){
+    if (_quantized) calc_extents();
+    zone = csg::UTM_zone(0.5*(_xmin + _xmax));
+    north = 0.5*(_ymin + _ymax) >= 0.0;
+  }
+  csg::TransverseMercator tm = csg::TransverseMercator::UTM(zone, north, ell);
+  transform_xyz(nthreads, [&](std::size_t n, double * x, double * y, double * z){
+    tm.forward(n, x, y, x, y);
+  });
+  return north? zone : -zone;
+}
+
+void PointCloud::UTM_to_geodetic(int zone, bool north, const csg::ReferenceEllipsoid & ell, unsigned int nthreads){
+  csg::TransverseMercator tm = csg::TransverseMercator::UTM(zone, north, ell);
+  transform_xyz(nthreads, [&](std::size_t n, double * x, double * y, double * z){
+    tm.reverse(n, x, y, x, y);
+  });
 }
 
 
 #ifdef _TEST_
 
 // compile with:
-// g++ -std=c++11 PointCloud.cpp -o pointcloud_test
+// g++ -std=c++14 -pthread -I../include -D_TEST_ PointCloud.cpp LASFile.cpp -o pointcloud_test
 
 int main(int argc, char * argv[]){
   // declare vars
@@ -677,6 +1793,24 @@ int main(int argc, char * argv[]){
   cloud_sub.print_summary();
   delete[] keep_inds;
 
+  // write_ASCII with coordinates too large for the integer formatter
+  // (these used to run past the end of the line buffer)
+  FILE * f = fopen("pointcloud_test_huge.txt", "w");
+  for (int i=0; i<1000; i++) fprintf(f, "1e30 -1e30 %de305\n", i%100 + 1);
+  fclose(f);
+  ASCIIOptions aopts;
+  aopts.precision = 9;
+  PointCloud huge = PointCloud::read_ASCII("pointcloud_test_huge.txt", aopts);
+  huge.write_ASCII("pointcloud_test_huge.txt", aopts);
+  PointCloud back = PointCloud::read_ASCII("pointcloud_test_huge.txt", aopts);
+  remove("pointcloud_test_huge.txt");
+  bool same = (back.pointcount() == huge.pointcount() && huge.pointcount() == 1000);
+  for (std::size_t i=0; same && i<huge.pointcount(); i++){
+    same = (back.x(i) == huge.x(i) && back.y(i) == huge.y(i) && back.z(i) == huge.z(i));
+  }
+  cout << "write_ASCII of huge coordinates: " << (same? "ok" : "FAILED") << endl;
+  if (!same) return 1;
+
   return 0;
 }
 #endif
\ No newline at end of file
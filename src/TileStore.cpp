@@ -0,0 +1,341 @@
+// out-of-core tiler and tile store
+//
+// tiles are plain LAS files, so anything that reads LAS can read
+// them; the index is a flat binary file with one fixed-size entry
+// per tile
+#include "TileStore.hpp"
+#include "LASFile.hpp"
+#include "SpaceFillingCurve.hpp"
+#include "Parallel.hpp"
+
+#include <memory>
+#include <tuple>
+#include <errno.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static const char tile_index_magic[8] = {'C', 'S', 'G', 'T', 'I', 'L', 'E', '1'};
+
+static csg::Box<3> cloud_bounds(const PointCloud & cloud){
+  return csg::Box<3>(csg::GeneralPoint<3, double>(cloud.xmin(), cloud.ymin(), cloud.zmin()),
+                     csg::GeneralPoint<3, double>(cloud.xmax(), cloud.ymax(), cloud.zmax()));
+}
+
+static bool boxes_overlap(const csg::Box<3> & a, const csg::Box<3> & b){
+  for (int d=0; d<3; d++){
+    if (a.hi.x[d] < b.lo.x[d] || a.lo.x[d] > b.hi.x[d]) return false;
+  }
+  return true;
+}
+
+static bool box_inside(const csg::Box<3> & a, const csg::Box<3> & b){
+  for (int d=0; d<3; d++){
+    if (a.lo.x[d] < b.lo.x[d] || a.hi.x[d] > b.hi.x[d]) return false;
+  }
+  return true;
+}
+
+// the non-empty cells of a cell-sorted run of records: cell[k] holds
+// records start[k] to start[k+1]. Only occupied cells are kept, so the
+// size follows the points rather than the 4^levels grid
+struct CellRanges{
+  std::vector<std::uint32_t> cell;
+  std::vector<std::size_t> start;     // cell.size()+1 entries
+
+  // first and one-past-last record of the cells in [cb, ce)
+  std::pair<std::size_t, std::size_t> range(std::size_t cb, std::size_t ce) const{
+    std::size_t b = lower_bound(cell.begin(), cell.end(), cb) - cell.begin();
+    std::size_t e = lower_bound(cell.begin() + b, cell.end(), ce) - cell.begin();
+    return std::make_pair(start[b], start[e]);
+  }
+};
+
+
+
+TileStore::TileStore(string directory)
+: _directory(directory){
+  read_index();
+}
+
+TileStore TileStore::build(const std::vector<std::string> & inputs, string directory, const TilerOptions & opts){
+  if (opts.levels > 15){
+    cout << "TileStore: at most 15 levels are supported" << endl;
+    throw -1;
+  }
+  if (opts.buffer_points == 0){
+    cout << "TileStore: buffer_points must be positive" << endl;
+    throw -1;
+  }
+  if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST){
+    cout << "TileStore: could not create " << directory << endl;
+    throw -1;
+  }
+
+  // the xy region to tile comes from the input headers alone
+  double xlo = std::numeric_limits<double>::max(), xhi = -std::numeric_limits<double>::max();
+  double ylo = xlo, yhi = xhi;
+  for (auto & f : inputs){
+    LASFile las(f);
+    if (las.pointcount() == 0) continue;
+    xlo = std::min(xlo, las.header().x_min); xhi = std::max(xhi, las.header().x_max);
+    ylo = std::min(ylo, las.header().y_min); yhi = std::max(yhi, las.header().y_max);
+  }
+  if (opts.read.use_box){
+    xlo = std::max(xlo, opts.read.box.lo.x[0]); xhi = std::min(xhi, opts.read.box.hi.x[0]);
+    ylo = std::max(ylo, opts.read.box.lo.x[1]); yhi = std::min(yhi, opts.read.box.hi.x[1]);
+  }
+  if (xhi < xlo || yhi < ylo) {xlo = xhi = ylo = yhi = 0;}
+
+  TileStore store;
+  store._directory = directory;
+  store._levels = opts.levels;
+  store._lo[0] = xlo; store._lo[1] = ylo;
+  store._side = std::max(xhi - xlo, yhi - ylo);
+  if (store._side <= 0) store._side = 1.0;
+
+  const std::uint32_t side_cells = std::uint32_t(1) << opts.levels;
+  const std::size_t ncells = std::size_t(side_cells)*side_cells;
+  const double cell = store._side/side_cells;
+  auto fragment_filename = [&](std::size_t k){return directory + "/fragment_" + to_string(k) + ".las";};
+
+  // buffered points are sorted by the Morton key of their cell and
+  // spilled to a fragment, so that any quadtree node is one
+  // contiguous range of records in every fragment
+  std::vector<CellRanges> fragment_cells;
+  std::vector<PointCloud> buffer;
+  std::size_t buffered = 0;
+  auto spill = [&](){
+    if (buffered == 0) return;
+    PointCloud pts;
+    pts.merge(std::move(buffer));
+    buffer.clear();
+    buffered = 0;
+
+    std::size_t n = pts.pointcount();
+    std::vector<std::uint32_t> key(n);
+    csg::parallel_for(n, opts.read.nthreads, [&](std::size_t b, std::size_t e, unsigned int t){
+      for (std::size_t i=b; i<e; i++){
+        // clamped before the conversion: header extents can be stale, so
+        // points may lie far outside the grid (and NaN goes to cell 0)
+        double fx = (pts.x(i) - store._lo[0])/cell, fy = (pts.y(i) - store._lo[1])/cell;
+        std::uint32_t ix = (fx > 0)? std::uint32_t(std::min(double(side_cells-1), fx)) : 0;
+        std::uint32_t iy = (fy > 0)? std::uint32_t(std::min(double(side_cells-1), fy)) : 0;
+        key[i] = csg::sfc::spread<2>(ix) | (csg::sfc::spread<2>(iy) << 1);
+      }
+    });
+
+    // counting sort on the cell keys while the grid is no bigger than
+    // the buffer, a comparison sort past that
+    std::vector<std::size_t> order;
+    if (ncells <= n){
+      std::vector<std::size_t> pos(ncells, 0);
+      for (std::size_t i=0; i<n; i++) pos[key[i]]++;
+      std::size_t sum = 0;
+      for (std::size_t c=0; c<ncells; c++) {std::size_t m = pos[c]; pos[c] = sum; sum += m;}
+      order.resize(n);
+      for (std::size_t i=0; i<n; i++) order[pos[key[i]]++] = i;
+    }
+    else order = csg::curve_order(key);
+
+    CellRanges cr;
+    for (std::size_t i=0; i<n; i++){
+      std::uint32_t k = key[order[i]];
+      if (cr.cell.size() == 0 || cr.cell.back() != k){
+        cr.cell.push_back(k);
+        cr.start.push_back(i);
+      }
+    }
+    cr.start.push_back(n);
+    key = std::vector<std::uint32_t>();
+    pts.reorder(order);
+
+    pts.write_LAS(fragment_filename(fragment_cells.size()), -1, (n > 0xffffffffull)? 4 : 2, opts.read.nthreads);
+    fragment_cells.push_back(std::move(cr));
+  };
+
+  for (auto & f : inputs){
+    LASChunkReader reader(f, opts.chunk_size, opts.read);
+    PointCloud chunk;
+    while (reader.next(chunk)){
+      if (chunk.pointcount() == 0) continue;
+      buffered += chunk.pointcount();
+      buffer.push_back(std::move(chunk));
+      chunk = PointCloud();
+      if (buffered >= opts.buffer_points) spill();
+    }
+  }
+  spill();
+
+  // point counts of the occupied cells, then the tiles are the
+  // quadtree nodes that are small enough (or the finest cells)
+  std::vector<std::pair<std::uint32_t, std::size_t>> cell_counts;
+  for (auto & cr : fragment_cells){
+    for (std::size_t k=0; k<cr.cell.size(); k++) cell_counts.push_back(std::make_pair(cr.cell[k], cr.start[k+1] - cr.start[k]));
+  }
+  std::sort(cell_counts.begin(), cell_counts.end());
+  CellRanges counts;                  // "records" here are the points of all fragments
+  counts.start.push_back(0);
+  for (auto & cc : cell_counts){
+    if (counts.cell.size() == 0 || counts.cell.back() != cc.first){
+      counts.cell.push_back(cc.first);
+      counts.start.push_back(counts.start.back());
+    }
+    counts.start.back() += cc.second;
+  }
+  cell_counts = std::vector<std::pair<std::uint32_t, std::size_t>>();
+
+  std::vector<std::size_t> first_cell;
+  std::function<void(unsigned int, std::uint32_t)> add_node = [&](unsigned int level, std::uint32_t code){
+    unsigned int shift = 2*(opts.levels - level);
+    std::size_t cb = std::size_t(code) << shift, ce = std::size_t(code+1) << shift;
+    std::pair<std::size_t, std::size_t> r = counts.range(cb, ce);
+    std::size_t count = r.second - r.first;
+    if (count == 0) return;
+    if (level == opts.levels || (opts.max_points > 0 && count <= opts.max_points)){
+      TileInfo tile;
+      tile.level = level;
+      tile.ix = csg::sfc::gather<2>(code);
+      tile.iy = csg::sfc::gather<2>(code >> 1);
+      tile.count = count;
+      store._tiles.push_back(tile);
+      first_cell.push_back(cb);
+      return;
+    }
+    for (std::uint32_t c=0; c<4; c++) add_node(level+1, 4*code + c);
+  };
+  add_node(0, 0);
+
+  // assemble every tile from its range of each fragment
+  LASReadOptions fopts = opts.read;
+  fopts.use_box = false;
+  fopts.use_time = false;
+  std::vector<std::unique_ptr<LASFile>> fragments;
+  for (std::size_t k=0; k<fragment_cells.size(); k++) fragments.emplace_back(new LASFile(fragment_filename(k)));
+  for (std::size_t j=0; j<store._tiles.size(); j++){
+    TileInfo & tile = store._tiles[j];
+    std::size_t cb = first_cell[j], ce = cb + (std::size_t(1) << 2*(opts.levels - tile.level));
+    std::vector<PointCloud> parts;
+    for (std::size_t k=0; k<fragments.size(); k++){
+      std::size_t b, e;
+      std::tie(b, e) = fragment_cells[k].range(cb, ce);
+      if (e == b) continue;
+      PointCloud part;
+      part.load_LAS(*fragments[k], b, e, fopts);
+      fragments[k]->release_records(b, e);
+      parts.push_back(std::move(part));
+    }
+    PointCloud cloud;
+    cloud.merge(std::move(parts));
+    cloud.write_LAS(store.tile_filename(j), -1, (cloud.pointcount() > 0xffffffffull)? 4 : 2, opts.read.nthreads);
+    tile.count = cloud.pointcount();
+    tile.bounds = cloud_bounds(cloud);
+  }
+  fragments.clear();
+  for (std::size_t k=0; k<fragment_cells.size(); k++) unlink(fragment_filename(k).c_str());
+
+  store.write_index();
+  return store;
+}
+
+std::size_t TileStore::pointcount() const{
+  std::size_t n = 0;
+  for (auto & t : _tiles) n += t.count;
+  return n;
+}
+
+csg::Box<3> TileStore::bounds() const{
+  if (_tiles.size() == 0) return csg::Box<3>();
+  csg::Box<3> bx = _tiles.front().bounds;
+  for (auto & t : _tiles) bx = csg::bounding_box(bx, t.bounds);
+  return bx;
+}
+
+std::string TileStore::tile_filename(std::size_t k) const{
+  const TileInfo & t = _tiles.at(k);
+  return _directory + "/L" + to_string(t.level) + "_" + to_string(t.ix) + "_" + to_string(t.iy) + ".las";
+}
+
+std::vector<std::size_t> TileStore::intersecting(const csg::Box<3> & box) const{
+  std::vector<std::size_t> found;
+  for (std::size_t k=0; k<_tiles.size(); k++){
+    if (boxes_overlap(_tiles[k].bounds, box)) found.push_back(k);
+  }
+  return found;
+}
+
+PointCloud TileStore::load_tile(std::size_t k, const LASReadOptions & opts) const{
+  return PointCloud::read_LAS(tile_filename(k), opts);
+}
+
+PointCloud TileStore::query(const csg::Box<3> & box, const LASReadOptions & opts) const{
+  std::vector<PointCloud> parts;
+  for (auto k : intersecting(box)){
+    // tiles entirely inside the box need no per-point test
+    LASReadOptions o = opts;
+    if (box_inside(_tiles[k].bounds, box)) o.use_box = false;
+    else o.set_box(box);
+    parts.push_back(PointCloud::read_LAS(tile_filename(k), o));
+  }
+  PointCloud cloud;
+  cloud.merge(std::move(parts));
+  return cloud;
+}
+
+void TileStore::write_index() const{
+  ofstream out(_directory + "/tiles.idx", ios::binary | ios::trunc);
+  if (!out){
+    cout << "TileStore: could not write the index in " << _directory << endl;
+    throw -1;
+  }
+  std::uint32_t levels = _levels;
+  std::uint64_t ntiles = _tiles.size();
+  out.write(tile_index_magic, 8);
+  out.write((const char *)&levels, sizeof(levels));
+  out.write((const char *)_lo, 2*sizeof(double));
+  out.write((const char *)&_side, sizeof(double));
+  out.write((const char *)&ntiles, sizeof(ntiles));
+  for (auto & t : _tiles){
+    std::uint32_t node[3] = {t.level, t.ix, t.iy};
+    std::uint64_t count = t.count;
+    out.write((const char *)node, sizeof(node));
+    out.write((const char *)&count, sizeof(count));
+    out.write((const char *)t.bounds.lo.x, 3*sizeof(double));
+    out.write((const char *)t.bounds.hi.x, 3*sizeof(double));
+  }
+  if (!out){
+    cout << "TileStore: failed writing the index in " << _directory << endl;
+    throw -1;
+  }
+}
+
+void TileStore::read_index(){
+  ifstream in(_directory + "/tiles.idx", ios::binary);
+  char magic[8];
+  if (!in || !in.read(magic, 8) || memcmp(magic, tile_index_magic, 8) != 0){
+    cout << "TileStore: no tile index in " << _directory << endl;
+    throw -1;
+  }
+  std::uint32_t levels;
+  std::uint64_t ntiles;
+  in.read((char *)&levels, sizeof(levels));
+  in.read((char *)_lo, 2*sizeof(double));
+  in.read((char *)&_side, sizeof(double));
+  in.read((char *)&ntiles, sizeof(ntiles));
+  _levels = levels;
+  _tiles.resize(ntiles);
+  for (auto & t : _tiles){
+    std::uint32_t node[3];
+    std::uint64_t count;
+    in.read((char *)node, sizeof(node));
+    in.read((char *)&count, sizeof(count));
+    in.read((char *)t.bounds.lo.x, 3*sizeof(double));
+    in.read((char *)t.bounds.hi.x, 3*sizeof(double));
+    t.level = node[0]; t.ix = node[1]; t.iy = node[2];
+    t.count = count;
+  }
+  if (!in){
+    cout << "TileStore: truncated tile index in " << _directory << endl;
+    throw -1;
+  }
+}